@@ -318,9 +318,12 @@ int main (int argc, char **argv) {
 		timing_set(&t3);
 	
 		/* Choose proper decoding method */
-		if (tech == Reed_Sol_Van || tech == Reed_Sol_R6_Op) {
+		if (tech == Reed_Sol_Van) {
 			i = jerasure_matrix_decode(k, m, w, matrix, 1, erasures, data, coding, blocksize);
 		}
+		else if (tech == Reed_Sol_R6_Op) {
+			i = reed_sol_r6_decode(k, w, erasures, data, coding, blocksize);
+		}
 		else if (tech == Cauchy_Orig || tech == Cauchy_Good || tech == Liberation || tech == Blaum_Roth || tech == Liber8tion) {
 			i = jerasure_schedule_decode_lazy(k, m, w, bitmatrix, erasures, data, coding, blocksize, packetsize, 1);
 		}
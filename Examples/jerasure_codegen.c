@@ -0,0 +1,287 @@
+/* *
+ * Copyright (c) 2014, James S. Plank and Kevin Greenan
+ * All rights reserved.
+ *
+ * Jerasure - A C/C++ Library for a Variety of Reed-Solomon and RAID-6 Erasure
+ * Coding Techniques
+ *
+ * Revision 2.0: Galois Field backend now links to GF-Complete
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  - Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ *  - Neither the name of the University of Tennessee nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Jerasure's authors:
+
+   Revision 2.x - 2014: James S. Plank and Kevin M. Greenan.
+   Revision 1.2 - 2008: James S. Plank, Scott Simmerman and Catherine D. Schuman.
+   Revision 1.0 - 2007: James S. Plank.
+ */
+
+/* Turns the encoding and decoding schedules of a bitmatrix code into
+   straight-line C.  Consecutive operations on the same destination packet
+   become one loop over the packet, which XORs all of the sources in vector
+   registers and stores the result once.  The loops have constant bounds,
+   so the compiler unrolls them. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "jerasure.h"
+#include "jerasure_codec.h"
+
+#define talloc(type, num) (type *) malloc(sizeof(type)*(num))
+
+static char *Methods[] = { "cauchy_orig", "cauchy_good", "liberation", "blaum_roth", "liber8tion", NULL };
+static jerasure_technique Techniques[] = { JERASURE_CAUCHY_ORIG, JERASURE_CAUCHY_GOOD,
+                                           JERASURE_LIBERATION, JERASURE_BLAUM_ROTH,
+                                           JERASURE_LIBER8TION };
+static char *Enums[] = { "JERASURE_CAUCHY_ORIG", "JERASURE_CAUCHY_GOOD", "JERASURE_LIBERATION",
+                         "JERASURE_BLAUM_ROTH", "JERASURE_LIBER8TION" };
+
+static void usage(char *s)
+{
+  fprintf(stderr, "usage: jerasure_codegen [-a] [-e erasures] ... [-v vector_bytes] technique k m w packetsize\n");
+  fprintf(stderr, "       \n");
+  fprintf(stderr, "       Writes C for the schedules of a bitmatrix code to standard output: an encoding\n");
+  fprintf(stderr, "       kernel, and a decoding kernel for each erasure pattern.  -e takes a comma-\n");
+  fprintf(stderr, "       separated list of erased device ids, and may be given more than once.  -a\n");
+  fprintf(stderr, "       makes kernels for every pattern of 1 to m erasures.  -v is 8, 16 or 32 (the\n");
+  fprintf(stderr, "       default), and must divide packetsize.  k+m must be <= 64.\n");
+  fprintf(stderr, "       \n");
+  fprintf(stderr, "       technique is one of cauchy_orig, cauchy_good, liberation, blaum_roth and\n");
+  fprintf(stderr, "       liber8tion.  Build the output into a plugin with something like\n");
+  fprintf(stderr, "         cc -O3 -march=native -shared -fPIC -I/usr/local/include/jerasure out.c -o out.so\n");
+  fprintf(stderr, "       and name it in JERASURE_PLUGINS, or link it in and pass jerasure_kernel_sets\n");
+  fprintf(stderr, "       to jerasure_codec_register_kernels().\n");
+  fprintf(stderr, "       \n");
+  fprintf(stderr, "This tests:        jerasure_smart_bitmatrix_to_schedule()\n");
+  fprintf(stderr, "                   jerasure_generate_decoding_schedule()\n");
+  fprintf(stderr, "                   jerasure_scheduled_decoding_ids()\n");
+  if (s != NULL) fprintf(stderr, "%s\n", s);
+  exit(1);
+}
+
+static int k, m, w, packetsize, vbytes;
+
+static int cmp_masks(const void *a, const void *b)
+{
+  uint64_t x, y;
+
+  x = *(const uint64_t *) a;
+  y = *(const uint64_t *) b;
+  return (x < y) ? -1 : (x > y);
+}
+
+/* Adds every mask with n more bits set above bit 'from' to masks */
+
+static void all_patterns(uint64_t mask, int from, int n, uint64_t *masks, int *nmasks)
+{
+  int i;
+
+  if (mask != 0) masks[(*nmasks)++] = mask;
+  if (n == 0) return;
+  for (i = from; i < k+m; i++) {
+    all_patterns(mask | ((uint64_t) 1 << i), i+1, n-1, masks, nmasks);
+  }
+}
+
+/* Prints the body of a kernel.  ids[i] is the device id of schedule device i. */
+
+static void print_kernel(char *name, int **schedule, int *ids)
+{
+  int i, j, op, end;
+  int used[64];
+
+  /* Only the devices that the schedule touches get a pointer */
+
+  for (i = 0; i < k+m; i++) used[i] = 0;
+  for (op = 0; schedule[op][0] >= 0; op++) {
+    used[schedule[op][0]] = 1;
+    used[schedule[op][2]] = 1;
+  }
+
+  printf("static void %s(char **data_ptrs, char **coding_ptrs, int size)\n{\n", name);
+  for (i = 0; i < k+m; i++) {
+    if (!used[i]) continue;
+    if (ids[i] < k) {
+      printf("  char *p%d = data_ptrs[%d];\n", i, ids[i]);
+    } else {
+      printf("  char *p%d = coding_ptrs[%d];\n", i, ids[i]-k);
+    }
+  }
+  printf("  int o, i;\n\n");
+  printf("  for (o = 0; o < size; o += W*PS) {\n");
+
+  for (op = 0; schedule[op][0] >= 0; op = end) {
+
+    /* A run of operations on one destination packet */
+
+    for (end = op+1; schedule[end][0] >= 0 && schedule[end][2] == schedule[op][2] &&
+                     schedule[end][3] == schedule[op][3] && schedule[end][4]; end++) ;
+
+    printf("    for (i = 0; i < NV; i++) V(p%d, %d) = ", schedule[op][2], schedule[op][3]);
+    if (schedule[op][4]) printf("V(p%d, %d) ^ ", schedule[op][2], schedule[op][3]);
+    for (j = op; j < end; j++) {
+      printf("%sV(p%d, %d)", (j == op) ? "" : " ^ ", schedule[j][0], schedule[j][1]);
+    }
+    printf(";\n");
+  }
+  printf("  }\n}\n\n");
+}
+
+int main(int argc, char **argv)
+{
+  int c, i, t, tech, all, nmasks, erasures[65], *ids;
+  long total, comb;
+  uint64_t *masks, mask;
+  char *s, name[64];
+  jerasure_codec *codec;
+  int **schedule;
+
+  all = 0;
+  vbytes = 32;
+  nmasks = 0;
+  masks = NULL;
+
+  while ((c = getopt(argc, argv, "ae:v:")) != -1) {
+    switch (c) {
+      case 'a':
+        all = 1;
+        break;
+      case 'e':
+        masks = (uint64_t *) realloc(masks, sizeof(uint64_t)*(nmasks+1));
+        mask = 0;
+        for (s = strtok(optarg, ","); s != NULL; s = strtok(NULL, ",")) {
+          if (sscanf(s, "%d", &i) != 1 || i < 0 || i >= 64) usage("Bad erasures");
+          mask |= ((uint64_t) 1 << i);
+        }
+        if (mask == 0) usage("Bad erasures");
+        masks[nmasks++] = mask;
+        break;
+      case 'v':
+        if (sscanf(optarg, "%d", &vbytes) != 1 || (vbytes != 8 && vbytes != 16 && vbytes != 32)) {
+          usage("Bad vector_bytes");
+        }
+        break;
+      default:
+        usage(NULL);
+    }
+  }
+  if (argc - optind != 5) usage(NULL);
+
+  for (tech = 0; Methods[tech] != NULL && strcmp(Methods[tech], argv[optind]) != 0; tech++) ;
+  if (Methods[tech] == NULL) usage("Bad technique");
+  if (sscanf(argv[optind+1], "%d", &k) == 0 || k <= 0) usage("Bad k");
+  if (sscanf(argv[optind+2], "%d", &m) == 0 || m <= 0) usage("Bad m");
+  if (sscanf(argv[optind+3], "%d", &w) == 0 || w <= 0 || w > 32) usage("Bad w");
+  if (sscanf(argv[optind+4], "%d", &packetsize) == 0 || packetsize <= 0 ||
+      packetsize%sizeof(long) != 0) usage("Bad packetsize");
+  if (k+m > 64) usage("k+m must be <= 64");
+  if (packetsize%vbytes != 0) usage("vector_bytes must divide packetsize");
+
+  /* Make the bitmatrix just as the codec does */
+
+  codec = jerasure_codec_new(Techniques[tech], k, m, w, packetsize);
+  if (codec == NULL) usage("The technique doesn't work with these parameters");
+
+  if (all) {
+    total = 0;
+    comb = 1;
+    for (i = 1; i <= m; i++) {
+      comb = comb*(k+m-i+1)/i;
+      total += comb;
+    }
+    if (total > 100000) usage("Too many erasure patterns for -a");
+    masks = (uint64_t *) realloc(masks, sizeof(uint64_t)*total);
+    nmasks = 0;
+    all_patterns(0, 0, m, masks, &nmasks);
+  }
+  if (nmasks > 0) qsort(masks, nmasks, sizeof(uint64_t), cmp_masks);
+  for (i = 0; i < nmasks; i++) {
+    if (masks[i] >> (k+m) != 0) usage("Bad erasures");
+    if (i > 0 && masks[i] == masks[i-1]) usage("An erasure pattern is given twice");
+  }
+
+  printf("/* Generated by jerasure_codegen %s %d %d %d %d: an encoding kernel and %d decoding kernels. */\n\n",
+         Methods[tech], k, m, w, packetsize, nmasks);
+  printf("#include <stddef.h>\n");
+  printf("#include \"jerasure_codec.h\"\n\n");
+  printf("#define W  %d\n", w);
+  printf("#define PS %d\n", packetsize);
+  printf("#define NV (PS/%d)\n\n", vbytes);
+  if (vbytes == 8) {
+    printf("typedef long jv __attribute__((may_alias));\n\n");
+  } else {
+    printf("typedef long long jv __attribute__((vector_size(%d), aligned(8), may_alias));\n\n", vbytes);
+  }
+  printf("/* Element i of packet n of device p */\n\n");
+  printf("#define V(p, n) (((jv *) ((p) + o + (n)*PS))[i])\n\n");
+
+  ids = talloc(int, k+m);
+  for (i = 0; i < k+m; i++) ids[i] = i;
+  schedule = jerasure_smart_bitmatrix_to_schedule(k, m, w, jerasure_codec_bitmatrix(codec));
+  print_kernel("encode", schedule, ids);
+  jerasure_free_schedule(schedule);
+
+  for (i = 0; i < nmasks; i++) {
+    c = 0;
+    for (t = 0; t < k+m; t++) if (masks[i] & ((uint64_t) 1 << t)) erasures[c++] = t;
+    erasures[c] = -1;
+    if (c > m) usage("An erasure pattern has more than m erasures");
+    schedule = jerasure_generate_decoding_schedule(k, m, w, jerasure_codec_bitmatrix(codec), erasures, 1);
+    if (schedule == NULL || jerasure_scheduled_decoding_ids(k, m, erasures, ids) < 0) {
+      usage("Can't make a decoding schedule");
+    }
+    sprintf(name, "decode_%llx", (unsigned long long) masks[i]);
+    print_kernel(name, schedule, ids);
+    jerasure_free_schedule(schedule);
+  }
+
+  if (nmasks > 0) {
+    printf("static const jerasure_decode_kernel decoders[] = {\n");
+    for (i = 0; i < nmasks; i++) {
+      printf("  { 0x%llxULL, decode_%llx },\n", (unsigned long long) masks[i], (unsigned long long) masks[i]);
+    }
+    printf("};\n\n");
+  }
+
+  printf("const jerasure_kernel_set jerasure_kernel_sets[] = {\n");
+  printf("  { %s, %d, %d, %d, %d, encode, %d, %s },\n", Enums[tech], k, m, w, packetsize,
+         nmasks, (nmasks > 0) ? "decoders" : "NULL");
+  printf("  { %s, 0, 0, 0, 0, NULL, 0, NULL }\n", Enums[tech]);
+  printf("};\n");
+
+  jerasure_codec_free(codec);
+  free(ids);
+  free(masks);
+  return 0;
+}
@@ -0,0 +1,144 @@
+/* *
+ * Copyright (c) 2014, James S. Plank and Kevin Greenan
+ * All rights reserved.
+ *
+ * Jerasure - A C/C++ Library for a Variety of Reed-Solomon and RAID-6 Erasure
+ * Coding Techniques
+ *
+ * Revision 2.0: Galois Field backend now links to GF-Complete
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  - Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ *  - Neither the name of the University of Tennessee nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Jerasure's authors:
+
+   Revision 2.x - 2014: James S. Plank and Kevin M. Greenan.
+   Revision 1.2 - 2008: James S. Plank, Scott Simmerman and Catherine D. Schuman.
+   Revision 1.0 - 2007: James S. Plank.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "jerasure.h"
+#include "jerasure_codec.h"
+
+static char *Methods[] = { "cauchy_orig", "cauchy_good", "liberation", "blaum_roth", "liber8tion", NULL };
+static jerasure_technique Techniques[] = { JERASURE_CAUCHY_ORIG, JERASURE_CAUCHY_GOOD,
+                                           JERASURE_LIBERATION, JERASURE_BLAUM_ROTH,
+                                           JERASURE_LIBER8TION };
+
+static void usage(char *s)
+{
+  fprintf(stderr, "usage: jerasure_schedule_xors [-e erasures] technique k m w - Compare schedulers.\n");
+  fprintf(stderr, "       \n");
+  fprintf(stderr, "       technique is one of cauchy_orig, cauchy_good, liberation, blaum_roth and\n");
+  fprintf(stderr, "       liber8tion.  Makes the encoding schedule of the technique's bitmatrix, or\n");
+  fprintf(stderr, "       with -e, the decoding schedule for a comma separated list of erased\n");
+  fprintf(stderr, "       devices, with the dumb, smart and CSE schedulers.  For each, prints the\n");
+  fprintf(stderr, "       number of XORs, copies and temporary packets, and XORs per output word.\n");
+  fprintf(stderr, "       \n");
+  fprintf(stderr, "This tests:        jerasure_dumb_bitmatrix_to_schedule()\n");
+  fprintf(stderr, "                   jerasure_smart_bitmatrix_to_schedule()\n");
+  fprintf(stderr, "                   jerasure_cse_bitmatrix_to_schedule()\n");
+  fprintf(stderr, "                   jerasure_generate_decoding_schedule()\n");
+  if (s != NULL) fprintf(stderr, "%s\n", s);
+  exit(1);
+}
+
+static void report(char *name, int **schedule, int outputs, int tdev)
+{
+  int i, xors, copies, ntemps;
+
+  if (schedule == NULL) {
+    printf("%8s %10s\n", name, "failed");
+    return;
+  }
+  xors = 0;
+  copies = 0;
+  ntemps = 0;
+  for (i = 0; schedule[i][0] >= 0; i++) {
+    if (schedule[i][4]) xors++; else copies++;
+    if (schedule[i][2] == tdev && schedule[i][3] >= ntemps) ntemps = schedule[i][3]+1;
+  }
+  printf("%8s %10d %10d %10d %12.3f\n", name, xors, copies, ntemps, (double) xors / outputs);
+  jerasure_free_schedule(schedule);
+}
+
+int main(int argc, char **argv)
+{
+  int c, i, tech, k, m, w, ne, erasures[65];
+  int *bitmatrix;
+  char *s;
+  jerasure_codec *codec;
+
+  ne = 0;
+  while ((c = getopt(argc, argv, "e:")) != -1) {
+    switch (c) {
+      case 'e':
+        for (s = strtok(optarg, ","); s != NULL; s = strtok(NULL, ",")) {
+          if (ne == 64 || sscanf(s, "%d", &i) != 1 || i < 0) usage("Bad erasures");
+          erasures[ne++] = i;
+        }
+        break;
+      default:
+        usage(NULL);
+    }
+  }
+  if (argc - optind != 4) usage(NULL);
+
+  for (tech = 0; Methods[tech] != NULL && strcmp(Methods[tech], argv[optind]) != 0; tech++) ;
+  if (Methods[tech] == NULL) usage("Bad technique");
+  if (sscanf(argv[optind+1], "%d", &k) == 0 || k <= 0) usage("Bad k");
+  if (sscanf(argv[optind+2], "%d", &m) == 0 || m <= 0) usage("Bad m");
+  if (sscanf(argv[optind+3], "%d", &w) == 0 || w <= 0 || w > 32) usage("Bad w");
+  if (ne > m) usage("More than m erasures");
+  for (i = 0; i < ne; i++) if (erasures[i] >= k+m) usage("Bad erasures");
+  erasures[ne] = -1;
+
+  codec = jerasure_codec_new(Techniques[tech], k, m, w, sizeof(long));
+  if (codec == NULL) usage("The technique doesn't work with these parameters");
+  bitmatrix = jerasure_codec_bitmatrix(codec);
+
+  printf("%8s %10s %10s %10s %12s\n", "", "XORs", "Copies", "Temps", "XORs/word");
+  if (ne == 0) {
+    report("dumb", jerasure_dumb_bitmatrix_to_schedule(k, m, w, bitmatrix), m*w, k+m);
+    report("smart", jerasure_smart_bitmatrix_to_schedule(k, m, w, bitmatrix), m*w, k+m);
+    report("cse", jerasure_cse_bitmatrix_to_schedule(k, m, w, bitmatrix, NULL), m*w, k+m);
+  } else {
+    report("dumb", jerasure_generate_decoding_schedule(k, m, w, bitmatrix, erasures, 0), ne*w, k+m);
+    report("smart", jerasure_generate_decoding_schedule(k, m, w, bitmatrix, erasures, 1), ne*w, k+m);
+    report("cse", jerasure_generate_decoding_schedule(k, m, w, bitmatrix, erasures,
+                                                      JERASURE_SCHEDULE_CSE), ne*w, k+m);
+  }
+  jerasure_codec_free(codec);
+  return 0;
+}
@@ -0,0 +1,144 @@
+/* *
+ * Copyright (c) 2014, James S. Plank and Kevin Greenan
+ * All rights reserved.
+ *
+ * Jerasure - A C/C++ Library for a Variety of Reed-Solomon and RAID-6 Erasure
+ * Coding Techniques
+ *
+ * Revision 2.0: Galois Field backend now links to GF-Complete
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  - Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ *  - Neither the name of the University of Tennessee nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Jerasure's authors:
+
+   Revision 2.x - 2014: James S. Plank and Kevin M. Greenan.
+   Revision 1.2 - 2008: James S. Plank, Scott Simmerman and Catherine D. Schuman.
+   Revision 1.0 - 2007: James S. Plank.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <gf_rand.h>
+#include "jerasure.h"
+#include "cauchy.h"
+#include "timing.h"
+
+#define talloc(type, num) (type *) malloc(sizeof(type)*(num))
+
+static void usage(char *s)
+{
+  fprintf(stderr, "usage: jerasure_time_schedule k m w packetsize bufsize iterations - Time flat schedules.\n");
+  fprintf(stderr, "       \n");
+  fprintf(stderr, "       k+m must be <= 2^w.  packetsize must be a multiple of sizeof(long), and\n");
+  fprintf(stderr, "       bufsize must be a multiple of w*packetsize.  Encodes k devices of bufsize\n");
+  fprintf(stderr, "       bytes with the smart schedule of a good Cauchy bitmatrix, first with\n");
+  fprintf(stderr, "       jerasure_schedule_encode() and then with its flat version, and prints the\n");
+  fprintf(stderr, "       throughput and the time per schedule operation of each.\n");
+  fprintf(stderr, "       \n");
+  fprintf(stderr, "This tests:        jerasure_schedule_encode()\n");
+  fprintf(stderr, "                   jerasure_flatten_schedule()\n");
+  fprintf(stderr, "                   jerasure_flat_schedule_encode()\n");
+  if (s != NULL) fprintf(stderr, "%s\n", s);
+  exit(1);
+}
+
+int main(int argc, char **argv)
+{
+  int k, m, w, packetsize, bufsize, iterations;
+  int i, j, nops;
+  int *matrix, *bitmatrix, **schedule;
+  jerasure_flat_schedule *flat;
+  char **data, **coding, **check;
+  double start, legacy_time, flat_time, total_ops;
+
+  if (argc != 7) usage(NULL);
+  if (sscanf(argv[1], "%d", &k) == 0 || k <= 0) usage("Bad k");
+  if (sscanf(argv[2], "%d", &m) == 0 || m <= 0) usage("Bad m");
+  if (sscanf(argv[3], "%d", &w) == 0 || w <= 0 || w > 32) usage("Bad w");
+  if (sscanf(argv[4], "%d", &packetsize) == 0 || packetsize <= 0 ||
+      packetsize%sizeof(long) != 0) usage("Bad packetsize");
+  if (sscanf(argv[5], "%d", &bufsize) == 0 || bufsize <= 0 ||
+      bufsize%(w*packetsize) != 0) usage("Bad bufsize");
+  if (sscanf(argv[6], "%d", &iterations) == 0 || iterations <= 0) usage("Bad iterations");
+  if (w < 30 && k + m > (1 << w)) usage("k + m is too big");
+
+  MOA_Seed(17);
+  matrix = cauchy_good_general_coding_matrix(k, m, w);
+  if (matrix == NULL) usage("Couldn't make the coding matrix");
+  bitmatrix = jerasure_matrix_to_bitmatrix(k, m, w, matrix);
+  schedule = jerasure_smart_bitmatrix_to_schedule(k, m, w, bitmatrix);
+  flat = jerasure_flatten_schedule(schedule, packetsize);
+  if (flat == NULL) usage("Couldn't flatten the schedule");
+  nops = flat->nops;
+
+  data = talloc(char *, k);
+  for (i = 0; i < k; i++) {
+    data[i] = talloc(char, bufsize);
+    MOA_Fill_Random_Region(data[i], bufsize);
+  }
+  coding = talloc(char *, m);
+  check = talloc(char *, m);
+  for (i = 0; i < m; i++) {
+    coding[i] = talloc(char, bufsize);
+    check[i] = talloc(char, bufsize);
+  }
+
+  legacy_time = 0;
+  for (i = 0; i < iterations; i++) {
+    start = timing_now();
+    jerasure_schedule_encode(k, m, w, schedule, data, check, bufsize, packetsize);
+    legacy_time += timing_now() - start;
+  }
+
+  flat_time = 0;
+  for (i = 0; i < iterations; i++) {
+    start = timing_now();
+    jerasure_flat_schedule_encode(k, m, w, flat, data, coding, bufsize);
+    flat_time += timing_now() - start;
+  }
+
+  for (j = 0; j < m; j++) {
+    if (memcmp(coding[j], check[j], bufsize) != 0) {
+      fprintf(stderr, "Coding device %d is wrong!\n", j);
+      exit(1);
+    }
+  }
+
+  total_ops = (double) nops * (bufsize / (w*packetsize)) * iterations;
+  printf("Schedule operations: %d\n", nops);
+  printf("%8s %10s %10s\n", "", "MB/s", "ns/op");
+  printf("%8s %10.2f %10.2f\n", "legacy", (double) k * bufsize * iterations / 1024 / 1024 / legacy_time,
+         legacy_time * 1e9 / total_ops);
+  printf("%8s %10.2f %10.2f\n", "flat", (double) k * bufsize * iterations / 1024 / 1024 / flat_time,
+         flat_time * 1e9 / total_ops);
+  return 0;
+}
@@ -0,0 +1,216 @@
+/* *
+ * Copyright (c) 2014, James S. Plank and Kevin Greenan
+ * All rights reserved.
+ *
+ * Jerasure - A C/C++ Library for a Variety of Reed-Solomon and RAID-6 Erasure
+ * Coding Techniques
+ *
+ * Revision 2.0: Galois Field backend now links to GF-Complete
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  - Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ *  - Neither the name of the University of Tennessee nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Jerasure's authors:
+
+   Revision 2.x - 2014: James S. Plank and Kevin M. Greenan.
+   Revision 1.2 - 2008: James S. Plank, Scott Simmerman and Catherine D. Schuman.
+   Revision 1.0 - 2007: James S. Plank.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <gf_rand.h>
+#ifdef HAVE_LINUX_PERF_EVENT_H
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+#include "jerasure.h"
+#include "reed_sol.h"
+#include "timing.h"
+
+#define talloc(type, num) (type *) malloc(sizeof(type)*(num))
+
+static void usage(char *s)
+{
+  fprintf(stderr, "usage: jerasure_time_tiles k m w bufsize iterations cache_kb tile_size ... - Time tiled matrix encoding.\n");
+  fprintf(stderr, "       \n");
+  fprintf(stderr, "       w must be 4, 8, 16 or 32.  k+m must be <= 2^w.  bufsize must be a multiple of 64.\n");
+  fprintf(stderr, "       Encodes k devices of bufsize bytes with a Vandermonde-based distribution\n");
+  fprintf(stderr, "       matrix, once for each tile size given.  A tile size of 0 turns tiling off.\n");
+  fprintf(stderr, "       For each tile size, it prints the throughput and the memory traffic of\n");
+  fprintf(stderr, "       one encoding: last-level cache misses times 64 bytes, counted with\n");
+  fprintf(stderr, "       perf_event_open.  If the counter can't be opened, it prints a model of\n");
+  fprintf(stderr, "       the traffic instead, which only holds when the k+m devices don't fit\n");
+  fprintf(stderr, "       in cache_kb KB of cache, and '-' otherwise.\n");
+  fprintf(stderr, "       \n");
+  fprintf(stderr, "This tests:        jerasure_matrix_encode()\n");
+  fprintf(stderr, "                   jerasure_set_tile_size()\n");
+  if (s != NULL) fprintf(stderr, "%s\n", s);
+  exit(1);
+}
+
+/* Counts last-level cache misses of this thread, or returns -1 */
+
+static int open_llc_misses(void)
+{
+#ifdef HAVE_LINUX_PERF_EVENT_H
+  struct perf_event_attr pe;
+
+  memset(&pe, 0, sizeof(pe));
+  pe.type = PERF_TYPE_HARDWARE;
+  pe.size = sizeof(pe);
+  pe.config = PERF_COUNT_HW_CACHE_MISSES;
+  pe.disabled = 1;
+  pe.exclude_kernel = 1;
+  pe.exclude_hv = 1;
+  return syscall(__NR_perf_event_open, &pe, 0, -1, -1, 0);
+#else
+  return -1;
+#endif
+}
+
+static void start_llc_misses(int fd)
+{
+#ifdef HAVE_LINUX_PERF_EVENT_H
+  ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+  ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+}
+
+static uint64_t stop_llc_misses(int fd)
+{
+  uint64_t n = 0;
+
+#ifdef HAVE_LINUX_PERF_EVENT_H
+  ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+  if (read(fd, &n, sizeof(n)) != sizeof(n)) n = 0;
+#endif
+  return n;
+}
+
+int main(int argc, char **argv)
+{
+  int k, m, w, bufsize, iterations, cache_kb, tile_size;
+  int i, j, t, fd;
+  int *matrix;
+  char **data, **coding, **check;
+  double start, total_time;
+  double traffic;
+  uint64_t misses;
+
+  if (argc < 8) usage(NULL);
+  if (sscanf(argv[1], "%d", &k) == 0 || k <= 0) usage("Bad k");
+  if (sscanf(argv[2], "%d", &m) == 0 || m <= 0) usage("Bad m");
+  if (sscanf(argv[3], "%d", &w) == 0 || (w != 4 && w != 8 && w != 16 && w != 32)) usage("Bad w");
+  if (sscanf(argv[4], "%d", &bufsize) == 0 || bufsize <= 0 || bufsize%64 != 0) usage("Bad bufsize");
+  if (sscanf(argv[5], "%d", &iterations) == 0 || iterations <= 0) usage("Bad iterations");
+  if (sscanf(argv[6], "%d", &cache_kb) == 0 || cache_kb <= 0) usage("Bad cache_kb");
+  if (w <= 16 && k + m > (1 << w)) usage("k + m is too big");
+
+  MOA_Seed(17);
+  matrix = reed_sol_vandermonde_coding_matrix(k, m, w);
+
+  data = talloc(char *, k);
+  for (i = 0; i < k; i++) {
+    data[i] = talloc(char, bufsize);
+    MOA_Fill_Random_Region(data[i], bufsize);
+  }
+  coding = talloc(char *, m);
+  check = talloc(char *, m);
+  for (i = 0; i < m; i++) {
+    coding[i] = talloc(char, bufsize);
+    check[i] = talloc(char, bufsize);
+  }
+
+  /* The reference encoding is done without tiling */
+
+  jerasure_set_tile_size(0);
+  jerasure_matrix_encode(k, m, w, matrix, data, check, bufsize);
+
+  fd = open_llc_misses();
+  printf("%6s %10s %14s\n", "Tile", "MB/s", (fd >= 0) ? "LLC miss MB" : "Model MB");
+
+  for (t = 7; t < argc; t++) {
+    if (sscanf(argv[t], "%d", &tile_size) == 0 || tile_size < 0) usage("Bad tile_size");
+    jerasure_set_tile_size(tile_size);
+    tile_size = jerasure_get_tile_size();
+
+    total_time = 0;
+    misses = 0;
+    for (i = 0; i < iterations; i++) {
+      if (fd >= 0) start_llc_misses(fd);
+      start = timing_now();
+      jerasure_matrix_encode(k, m, w, matrix, data, coding, bufsize);
+      total_time += timing_now() - start;
+      if (fd >= 0) misses += stop_llc_misses(fd);
+    }
+
+    for (j = 0; j < m; j++) {
+      if (memcmp(coding[j], check[j], bufsize) != 0) {
+        fprintf(stderr, "Tile size %d: coding device %d is wrong!\n", tile_size, j);
+        exit(1);
+      }
+    }
+
+    /* The model, when the devices don't fit in cache: every data device is read
+       once.  Untiled, each coding device is written by the first source, then read
+       and written by each of the other k-1.  Tiled, it is only written once. */
+
+    if (fd >= 0) {
+      traffic = (double) misses * 64 / iterations;
+    } else if ((double) (k+m) * bufsize > (double) cache_kb * 1024) {
+      traffic = (double) k * bufsize;
+      if (tile_size == 0 || tile_size >= bufsize) {
+        traffic += (double) m * bufsize * (2*k - 1);
+      } else {
+        traffic += (double) m * bufsize;
+      }
+    } else {
+      traffic = -1;
+    }
+
+    printf("%6d %10.2f ", tile_size, (double) k * bufsize * iterations / 1024 / 1024 / total_time);
+    if (traffic < 0) {
+      printf("%14s\n", "-");
+    } else {
+      printf("%14.2f\n", traffic / 1024 / 1024);
+    }
+  }
+  if (fd >= 0) close(fd);
+  return 0;
+}
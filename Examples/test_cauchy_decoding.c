@@ -0,0 +1,166 @@
+/* *
+ * Copyright (c) 2014, James S. Plank and Kevin Greenan
+ * All rights reserved.
+ *
+ * Jerasure - A C/C++ Library for a Variety of Reed-Solomon and RAID-6 Erasure
+ * Coding Techniques
+ *
+ * Revision 2.0: Galois Field backend now links to GF-Complete
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  - Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ *  - Neither the name of the University of Tennessee nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Checks that the closed-form Cauchy decoding matrices are the ones that
+   elimination gives, for every erasure pattern, for original, improved and
+   X/Y Cauchy matrices, and that other matrices are turned down. */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <gf_rand.h>
+#include "jerasure.h"
+#include "cauchy.h"
+#include "reed_sol.h"
+
+#define talloc(type, num) (type *) malloc(sizeof(type)*(num))
+
+static void test(int k, int m, int w, int *matrix, int *X, int *Y, int scaled)
+{
+  int *erased, *dm1, *dm2, *ids1, *ids2, *bm, *bdm1, *bdm2, *rows, *row_ids;
+  int mask, ne, i, n;
+
+  erased = talloc(int, k+m);
+  dm1 = talloc(int, k*k);
+  dm2 = talloc(int, k*k);
+  rows = talloc(int, k*k);
+  row_ids = talloc(int, k);
+  ids1 = talloc(int, k);
+  ids2 = talloc(int, k);
+  bm = jerasure_matrix_to_bitmatrix(k, m, w, matrix);
+  bdm1 = talloc(int, k*k*w*w);
+  bdm2 = talloc(int, k*k*w*w);
+
+  for (mask = 0; mask < (1 << (k+m)); mask++) {
+    ne = 0;
+    for (i = 0; i < k+m; i++) {
+      erased[i] = (mask >> i) & 1;
+      ne += erased[i];
+    }
+    if (ne > m) continue;
+
+    assert(jerasure_make_decoding_matrix(k, m, w, matrix, erased, dm1, ids1) == 0);
+    assert(cauchy_make_decoding_matrix(k, m, w, matrix, X, Y, erased, dm2, ids2) == 0);
+    assert(memcmp(dm1, dm2, sizeof(int)*k*k) == 0);
+    assert(memcmp(ids1, ids2, sizeof(int)*k) == 0);
+    if (!scaled) {
+      assert(cauchy_make_decoding_matrix(k, m, w, NULL, X, Y, erased, dm2, ids2) == 0);
+      assert(memcmp(dm1, dm2, sizeof(int)*k*k) == 0);
+    }
+
+    n = 0;
+    for (i = k-1; i >= 0; i -= 2) row_ids[n++] = i;
+    assert(cauchy_make_decoding_rows(k, m, w, matrix, X, Y, erased, n, row_ids, rows, ids2) == 0);
+    for (i = 0; i < n; i++) assert(memcmp(rows+i*k, dm1+row_ids[i]*k, sizeof(int)*k) == 0);
+
+    if (mask % 5 == 0) {
+      assert(jerasure_make_decoding_bitmatrix(k, m, w, bm, erased, bdm1, ids1) == 0);
+      assert(cauchy_make_decoding_bitmatrix(k, m, w, matrix, X, Y, erased, bdm2, ids2) == 0);
+      assert(memcmp(bdm1, bdm2, sizeof(int)*k*k*w*w) == 0);
+    }
+  }
+
+  free(erased);
+  free(dm1);
+  free(dm2);
+  free(rows);
+  free(row_ids);
+  free(ids1);
+  free(ids2);
+  free(bm);
+  free(bdm1);
+  free(bdm2);
+}
+
+int main(int argc, char **argv)
+{
+  int X[16], Y[16], erased[16], dm[64], ids[8];
+  int *matrix, k, m, w, i, j;
+
+  MOA_Seed(9);
+
+  /* Original and improved Cauchy matrices have X[i] = i and Y[j] = m+j */
+
+  k = 6; m = 4; w = 8;
+  for (i = 0; i < m; i++) X[i] = i;
+  for (i = 0; i < k; i++) Y[i] = m+i;
+  matrix = cauchy_original_coding_matrix(k, m, w);
+  test(k, m, w, matrix, X, Y, 0);
+  cauchy_improve_coding_matrix(k, m, w, matrix);
+  test(k, m, w, matrix, X, Y, 1);
+  free(matrix);
+
+  k = 5; m = 3; w = 16;
+  for (i = 0; i < m; i++) X[i] = i;
+  for (i = 0; i < k; i++) Y[i] = m+i;
+  matrix = cauchy_good_general_coding_matrix(k, m, w);
+  test(k, m, w, matrix, X, Y, 1);
+  free(matrix);
+
+  /* Random distinct X and Y */
+
+  k = 7; m = 3; w = 8;
+  for (i = 0; i < k+m; i++) {
+    do {
+      X[i] = MOA_Random_W(w, 1);
+      for (j = 0; j < i && X[j] != X[i]; j++) ;
+    } while (j < i);
+  }
+  for (i = 0; i < k; i++) Y[i] = X[m+i];
+  matrix = cauchy_xy_coding_matrix(k, m, w, X, Y);
+  test(k, m, w, matrix, X, Y, 0);
+  free(matrix);
+
+  /* Not Cauchy: the RAID-6 "good" matrix, and a Vandermonde matrix */
+
+  k = 4; m = 2; w = 8;
+  for (i = 0; i < m; i++) X[i] = i;
+  for (i = 0; i < k; i++) Y[i] = m+i;
+  for (i = 0; i < k+m; i++) erased[i] = (i == 1);
+  matrix = cauchy_good_general_coding_matrix(k, m, w);
+  assert(cauchy_make_decoding_matrix(k, m, w, matrix, X, Y, erased, dm, ids) == -1);
+  free(matrix);
+  matrix = reed_sol_vandermonde_coding_matrix(k, m, w);
+  assert(cauchy_make_decoding_matrix(k, m, w, matrix, X, Y, erased, dm, ids) == -1);
+  free(matrix);
+
+  printf("test_cauchy_decoding: OK\n");
+  return 0;
+}
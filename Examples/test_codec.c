@@ -0,0 +1,192 @@
+/* *
+ * Copyright (c) 2014, James S. Plank and Kevin Greenan
+ * All rights reserved.
+ *
+ * Jerasure - A C/C++ Library for a Variety of Reed-Solomon and RAID-6 Erasure
+ * Coding Techniques
+ *
+ * Revision 2.0: Galois Field backend now links to GF-Complete
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  - Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ *  - Neither the name of the University of Tennessee nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Checks that a codec encodes exactly as the matching jerasure routines do,
+   and decodes every pattern of up to m erasures, for each technique. */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <gf_rand.h>
+#include "galois.h"
+#include "jerasure.h"
+#include "jerasure_codec.h"
+#include "test_regions.h"
+
+#define talloc(type, num) (type *) malloc(sizeof(type)*(num))
+
+static void test(jerasure_technique technique, int k, int m, int w, int packetsize, int size)
+{
+  jerasure_codec *codec;
+  char **data, **coding, **check, **saved;
+  int *erasures, mask, ne, i, pass;
+
+  codec = jerasure_codec_new(technique, k, m, w, packetsize);
+  assert(codec != NULL);
+  data = alloc_regions(k, size, 1);
+  coding = alloc_regions(m, size, 0);
+  check = alloc_regions(m, size, 0);
+  saved = alloc_regions(k, size, 0);
+  erasures = talloc(int, k+m+1);
+
+  if (jerasure_codec_bitmatrix(codec) != NULL) {
+    jerasure_bitmatrix_encode(k, m, w, jerasure_codec_bitmatrix(codec), data, check, size, packetsize);
+  } else {
+    jerasure_matrix_encode(k, m, w, jerasure_codec_matrix(codec), data, check, size);
+  }
+  assert(jerasure_codec_encode(codec, data, coding, size) == 0);
+  for (i = 0; i < m; i++) assert(memcmp(coding[i], check[i], size) == 0);
+  for (i = 0; i < k; i++) memcpy(saved[i], data[i], size);
+
+  /* Twice, so that the second time decodes from the codec's caches */
+
+  for (pass = 0; pass < 2; pass++) {
+    for (mask = 1; mask < (1 << (k+m)); mask++) {
+      ne = 0;
+      for (i = 0; i < k+m; i++) if (mask & (1 << i)) erasures[ne++] = i;
+      erasures[ne] = -1;
+      if (ne > m) continue;
+      for (i = 0; i < ne; i++) {
+        if (erasures[i] < k) {
+          memset(data[erasures[i]], 0, size);
+        } else {
+          memset(coding[erasures[i]-k], 0, size);
+        }
+      }
+      assert(jerasure_codec_decode(codec, erasures, data, coding, size) == 0);
+      for (i = 0; i < k; i++) assert(memcmp(data[i], saved[i], size) == 0);
+      for (i = 0; i < m; i++) assert(memcmp(coding[i], check[i], size) == 0);
+    }
+  }
+
+  assert(jerasure_codec_encode(codec, data, coding, size+1) == -1);
+
+  jerasure_codec_free(codec);
+  free_regions(data, k);
+  free_regions(coding, m);
+  free_regions(check, m);
+  free_regions(saved, k);
+  free(erasures);
+}
+
+/* An ALTMAP codec, against a plain one, converting at the edges */
+
+static void test_altmap(int k, int m, int w, int size)
+{
+  jerasure_codec *codec, *plain;
+  char **data, **coding, **check, **saved;
+  int *erasures, mask, ne, i;
+
+  codec = jerasure_codec_new_altmap(JERASURE_REED_SOL_VAN, k, m, w, 0);
+  plain = jerasure_codec_new(JERASURE_REED_SOL_VAN, k, m, w, 0);
+  assert(codec != NULL && plain != NULL);
+  data = alloc_regions(k, size, 1);
+  coding = alloc_regions(m, size, 0);
+  check = alloc_regions(m, size, 0);
+  saved = alloc_regions(k, size, 0);
+  erasures = talloc(int, k+m+1);
+
+  assert(jerasure_codec_encode(plain, data, check, size) == 0);
+  for (i = 0; i < k; i++) {
+    galois_to_altmap(w, data[i], data[i], size);
+    memcpy(saved[i], data[i], size);
+  }
+  assert(jerasure_codec_encode(codec, data, coding, size) == 0);
+  for (i = 0; i < m; i++) {
+    galois_from_altmap(w, coding[i], coding[i], size);
+    assert(memcmp(coding[i], check[i], size) == 0);
+    galois_to_altmap(w, check[i], check[i], size);
+    memcpy(coding[i], check[i], size);
+  }
+
+  for (mask = 1; mask < (1 << (k+m)); mask++) {
+    ne = 0;
+    for (i = 0; i < k+m; i++) if (mask & (1 << i)) erasures[ne++] = i;
+    erasures[ne] = -1;
+    if (ne > m) continue;
+    for (i = 0; i < ne; i++) {
+      if (erasures[i] < k) {
+        memset(data[erasures[i]], 0, size);
+      } else {
+        memset(coding[erasures[i]-k], 0, size);
+      }
+    }
+    assert(jerasure_codec_decode(codec, erasures, data, coding, size) == 0);
+    for (i = 0; i < k; i++) assert(memcmp(data[i], saved[i], size) == 0);
+    for (i = 0; i < m; i++) assert(memcmp(coding[i], check[i], size) == 0);
+  }
+
+  assert(jerasure_codec_encode(codec, data, coding, size+8) == -1);
+
+  jerasure_codec_free(codec);
+  jerasure_codec_free(plain);
+  free_regions(data, k);
+  free_regions(coding, m);
+  free_regions(check, m);
+  free_regions(saved, k);
+  free(erasures);
+}
+
+int main(int argc, char **argv)
+{
+  MOA_Seed(8);
+
+  test(JERASURE_REED_SOL_VAN, 6, 3, 8, 0, 4096);
+  test(JERASURE_REED_SOL_VAN, 9, 4, 4, 0, 1000);
+  test(JERASURE_REED_SOL_VAN, 4, 2, 16, 0, 1000);
+  test(JERASURE_REED_SOL_R6, 5, 2, 32, 0, 256);
+  test(JERASURE_CAUCHY_ORIG, 5, 3, 4, 16, 16*4*10);
+  test(JERASURE_CAUCHY_GOOD, 4, 4, 5, 8, 8*5*3);
+  test(JERASURE_LIBERATION, 5, 2, 7, 16, 16*7*4);
+  test(JERASURE_BLAUM_ROTH, 4, 2, 6, 8, 8*6*2);
+  test(JERASURE_LIBER8TION, 6, 2, 8, 32, 32*8*2);
+
+  assert(jerasure_codec_new(JERASURE_REED_SOL_R6, 5, 3, 8, 0) == NULL);
+  assert(jerasure_codec_new(JERASURE_LIBER8TION, 6, 2, 7, 32) == NULL);
+  assert(jerasure_codec_new(JERASURE_REED_SOL_VAN, 6, 3, 7, 0) == NULL);
+  assert(jerasure_codec_new(JERASURE_REED_SOL_VAN, 13, 4, 4, 0) == NULL);
+
+  test_altmap(5, 3, 8, 512);
+  test_altmap(6, 3, 16, 32*37);
+  test_altmap(4, 4, 32, 64*600);
+  assert(jerasure_codec_new_altmap(JERASURE_REED_SOL_R6, 5, 2, 16, 0) == NULL);
+  assert(jerasure_codec_new_altmap(JERASURE_CAUCHY_GOOD, 4, 4, 5, 8) == NULL);
+  return 0;
+}
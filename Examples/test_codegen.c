@@ -0,0 +1,117 @@
+/* *
+ * Copyright (c) 2014, James S. Plank and Kevin Greenan
+ * All rights reserved.
+ *
+ * Jerasure - A C/C++ Library for a Variety of Reed-Solomon and RAID-6 Erasure
+ * Coding Techniques
+ *
+ * Revision 2.0: Galois Field backend now links to GF-Complete
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  - Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ *  - Neither the name of the University of Tennessee nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Checks that a codec picks up the kernels that jerasure_codegen generated
+   into test_codegen_kernels.c, and that they code exactly as the schedules
+   do, for every erasure pattern. */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <gf_rand.h>
+#include "jerasure.h"
+#include "jerasure_codec.h"
+
+#define talloc(type, num) (type *) malloc(sizeof(type)*(num))
+
+extern const jerasure_kernel_set jerasure_kernel_sets[];
+
+int main(int argc, char **argv)
+{
+  const jerasure_kernel_set *set;
+  jerasure_codec *codec, *other;
+  char **data, **coding, **check, **saved;
+  int *erasures, k, m, w, size, mask, ne, i;
+
+  MOA_Seed(10);
+
+  set = jerasure_kernel_sets;
+  k = set->k;
+  m = set->m;
+  w = set->w;
+  size = set->packetsize*w*3;
+
+  other = jerasure_codec_new(set->technique, k, m, w, set->packetsize*2);
+  assert(jerasure_codec_register_kernels(jerasure_kernel_sets) == 0);
+  codec = jerasure_codec_new(set->technique, k, m, w, set->packetsize);
+  assert(codec != NULL && jerasure_codec_has_kernels(codec));
+  assert(other != NULL && !jerasure_codec_has_kernels(other));
+  jerasure_codec_free(other);
+
+  data = talloc(char *, k);
+  saved = talloc(char *, k);
+  coding = talloc(char *, m);
+  check = talloc(char *, m);
+  for (i = 0; i < k; i++) {
+    data[i] = talloc(char, size);
+    saved[i] = talloc(char, size);
+    MOA_Fill_Random_Region(data[i], size);
+    memcpy(saved[i], data[i], size);
+  }
+  for (i = 0; i < m; i++) {
+    coding[i] = talloc(char, size);
+    check[i] = talloc(char, size);
+  }
+  erasures = talloc(int, k+m+1);
+
+  jerasure_bitmatrix_encode(k, m, w, jerasure_codec_bitmatrix(codec), data, check, size, set->packetsize);
+  assert(jerasure_codec_encode(codec, data, coding, size) == 0);
+  for (i = 0; i < m; i++) assert(memcmp(coding[i], check[i], size) == 0);
+
+  for (mask = 1; mask < (1 << (k+m)); mask++) {
+    ne = 0;
+    for (i = 0; i < k+m; i++) if (mask & (1 << i)) erasures[ne++] = i;
+    erasures[ne] = -1;
+    if (ne > m) continue;
+    for (i = 0; i < ne; i++) {
+      if (erasures[i] < k) {
+        memset(data[erasures[i]], 0, size);
+      } else {
+        memset(coding[erasures[i]-k], 0, size);
+      }
+    }
+    assert(jerasure_codec_decode(codec, erasures, data, coding, size) == 0);
+    for (i = 0; i < k; i++) assert(memcmp(data[i], saved[i], size) == 0);
+    for (i = 0; i < m; i++) assert(memcmp(coding[i], check[i], size) == 0);
+  }
+
+  jerasure_codec_free(codec);
+  return 0;
+}
@@ -0,0 +1,164 @@
+/* *
+ * Copyright (c) 2014, James S. Plank and Kevin Greenan
+ * All rights reserved.
+ *
+ * Jerasure - A C/C++ Library for a Variety of Reed-Solomon and RAID-6 Erasure
+ * Coding Techniques
+ *
+ * Revision 2.0: Galois Field backend now links to GF-Complete
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  - Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ *  - Neither the name of the University of Tennessee nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Checks that CSE schedules encode as jerasure_bitmatrix_encode does, and
+   that CSE decoding schedules recover every erasure pattern, both directly
+   and from a schedule cache. */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <gf_rand.h>
+#include "jerasure.h"
+#include "cauchy.h"
+#include "liberation.h"
+#include "test_regions.h"
+
+#define talloc(type, num) (type *) malloc(sizeof(type)*(num))
+
+static void test(int k, int m, int w, int *bitmatrix, int packetsize)
+{
+  char **data, **coding, **expected, **ptrs, *temps;
+  int **schedule, ***scache, *erasures;
+  int size, mask, ne, i, j, ntemps;
+
+  size = w*packetsize*3;
+  data = alloc_regions(k, size, 1);
+  coding = alloc_regions(m, size, 0);
+  expected = alloc_regions(m, size, 0);
+  erasures = talloc(int, k+m+1);
+
+  jerasure_bitmatrix_encode(k, m, w, bitmatrix, data, expected, size, packetsize);
+  schedule = jerasure_cse_bitmatrix_to_schedule(k, m, w, bitmatrix, &ntemps);
+  assert(schedule != NULL && ntemps >= 0);
+  assert(jerasure_schedule_ntemps(schedule) == ntemps);
+  if (ntemps > 0) assert(jerasure_flatten_schedule(schedule, packetsize) == NULL);
+  jerasure_schedule_encode(k, m, w, schedule, data, coding, size, packetsize);
+  for (i = 0; i < m; i++) assert(memcmp(coding[i], expected[i], size) == 0);
+
+  ptrs = talloc(char *, k+m+1);
+  temps = talloc(char, (ntemps+1)*packetsize);
+  for (i = 0; i < m; i++) memset(coding[i], 0, size);
+  jerasure_schedule_encode_scratch(k, m, w, schedule, data, coding, size, packetsize, ptrs, temps);
+  for (i = 0; i < m; i++) assert(memcmp(coding[i], expected[i], size) == 0);
+  jerasure_free_schedule(schedule);
+  free(temps);
+
+  scache = (m == 2) ? jerasure_generate_schedule_cache(k, m, w, bitmatrix, JERASURE_SCHEDULE_CSE) : NULL;
+
+  /* Scratch for decoding from the cache holds the most temporaries of any schedule */
+
+  ntemps = 0;
+  if (scache != NULL) {
+    for (i = 0; i < k+m; i++) {
+      for (j = 0; j <= i; j++) {
+        if (jerasure_schedule_ntemps(scache[i*(k+m)+j]) > ntemps) {
+          ntemps = jerasure_schedule_ntemps(scache[i*(k+m)+j]);
+        }
+      }
+    }
+  }
+  temps = talloc(char, (ntemps+1)*packetsize);
+
+  for (mask = 1; mask < (1 << (k+m)); mask++) {
+    ne = 0;
+    for (i = 0; i < k+m; i++) if (mask & (1 << i)) erasures[ne++] = i;
+    if (ne > m) continue;
+    erasures[ne] = -1;
+
+    for (i = 0; i < ne; i++) {
+      if (erasures[i] < k) {
+        memset(data[erasures[i]], 0, size);
+      } else {
+        memset(coding[erasures[i]-k], 0, size);
+      }
+    }
+    if (scache != NULL && mask % 2 == 0) {
+      assert(jerasure_schedule_decode_cache_scratch(k, m, w, scache, erasures, data, coding, size,
+                                                    packetsize, ptrs, temps) == 0);
+    } else if (scache != NULL) {
+      assert(jerasure_schedule_decode_cache(k, m, w, scache, erasures, data, coding, size,
+                                            packetsize) == 0);
+    } else {
+      assert(jerasure_schedule_decode_lazy(k, m, w, bitmatrix, erasures, data, coding, size,
+                                           packetsize, JERASURE_SCHEDULE_CSE) == 0);
+    }
+    for (i = 0; i < m; i++) assert(memcmp(coding[i], expected[i], size) == 0);
+  }
+
+  /* The data is checked through the coding devices, by encoding again */
+
+  jerasure_bitmatrix_encode(k, m, w, bitmatrix, data, coding, size, packetsize);
+  for (i = 0; i < m; i++) assert(memcmp(coding[i], expected[i], size) == 0);
+
+  if (scache != NULL) jerasure_free_schedule_cache(k, m, scache);
+  free_regions(data, k);
+  free_regions(coding, m);
+  free_regions(expected, m);
+  free(erasures);
+  free(ptrs);
+  free(temps);
+}
+
+int main(int argc, char **argv)
+{
+  int *matrix, *bitmatrix;
+
+  MOA_Seed(5);
+
+  matrix = cauchy_good_general_coding_matrix(6, 3, 8);
+  bitmatrix = jerasure_matrix_to_bitmatrix(6, 3, 8, matrix);
+  test(6, 3, 8, bitmatrix, 16);
+  free(matrix);
+  free(bitmatrix);
+
+  matrix = cauchy_original_coding_matrix(5, 4, 4);
+  bitmatrix = jerasure_matrix_to_bitmatrix(5, 4, 4, matrix);
+  test(5, 4, 4, bitmatrix, 8);
+  free(matrix);
+  free(bitmatrix);
+
+  bitmatrix = liberation_coding_bitmatrix(5, 7);
+  test(5, 2, 7, bitmatrix, 8);
+  free(bitmatrix);
+
+  printf("test_cse_schedule: OK\n");
+  return 0;
+}
@@ -0,0 +1,194 @@
+/* *
+ * Copyright (c) 2014, James S. Plank and Kevin Greenan
+ * All rights reserved.
+ *
+ * Jerasure - A C/C++ Library for a Variety of Reed-Solomon and RAID-6 Erasure
+ * Coding Techniques
+ *
+ * Revision 2.0: Galois Field backend now links to GF-Complete
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  - Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ *  - Neither the name of the University of Tennessee nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Checks that decoding plans, and the plan cache, decode every erasure
+   pattern exactly as jerasure_matrix_decode does.  The cache is kept
+   smaller than the number of patterns, so that plans get thrown out.
+   Also checks jerasure_make_decoding_matrix and _rows against inverting
+   the survivors' rows of the distribution matrix. */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <gf_rand.h>
+#include "jerasure.h"
+#include "reed_sol.h"
+#include "cauchy.h"
+#include "test_regions.h"
+
+#define talloc(type, num) (type *) malloc(sizeof(type)*(num))
+
+static void erase(int k, int *erasures, char **data, char **coding, int size)
+{
+  int i;
+
+  for (i = 0; erasures[i] != -1; i++) {
+    if (erasures[i] < k) {
+      memset(data[erasures[i]], 0, size);
+    } else {
+      memset(coding[erasures[i]-k], 0, size);
+    }
+  }
+}
+
+static void check_same(char **r1, char **r2, int n, int size)
+{
+  int i;
+
+  for (i = 0; i < n; i++) assert(memcmp(r1[i], r2[i], size) == 0);
+}
+
+static void check_decoding_matrix(int k, int m, int w, int *matrix, int *erasures)
+{
+  int *erased, *survivors, *inverse, *dm, *rows, *dm_ids, *ids;
+  int i, j, n;
+
+  erased = jerasure_erasures_to_erased(k, m, erasures);
+  survivors = talloc(int, k*k);
+  inverse = talloc(int, k*k);
+  dm = talloc(int, k*k);
+  rows = talloc(int, (k+1)*k);
+  dm_ids = talloc(int, k);
+  ids = talloc(int, k+1);
+
+  assert(jerasure_make_decoding_matrix(k, m, w, matrix, erased, dm, dm_ids) == 0);
+  for (i = 0; i < k; i++) {
+    for (j = 0; j < k; j++) {
+      if (dm_ids[i] < k) {
+        survivors[i*k+j] = (j == dm_ids[i]);
+      } else {
+        survivors[i*k+j] = matrix[(dm_ids[i]-k)*k+j];
+      }
+    }
+  }
+  assert(jerasure_invert_matrix(survivors, inverse, k, w) == 0);
+  assert(memcmp(dm, inverse, sizeof(int)*k*k) == 0);
+
+  n = 0;
+  for (i = k-1; i >= 0; i--) if (erased[i]) ids[n++] = i;
+  ids[n++] = 0;
+  assert(jerasure_make_decoding_rows(k, m, w, matrix, erased, n, ids, rows, dm_ids) == 0);
+  for (i = 0; i < n; i++) assert(memcmp(rows+i*k, inverse+ids[i]*k, sizeof(int)*k) == 0);
+
+  free(erased);
+  free(survivors);
+  free(inverse);
+  free(dm);
+  free(rows);
+  free(dm_ids);
+  free(ids);
+}
+
+static void test(int k, int m, int w, int *matrix, int row_k_ones, int size)
+{
+  jerasure_plan_cache *cache;
+  jerasure_decoding_plan *plan;
+  char **data, **coding, **saved_data, **saved_coding;
+  int *erasures, mask, ne, i, pass;
+
+  data = alloc_regions(k, size, 1);
+  coding = alloc_regions(m, size, 0);
+  saved_data = alloc_regions(k, size, 0);
+  saved_coding = alloc_regions(m, size, 0);
+  erasures = talloc(int, k+m+1);
+
+  jerasure_matrix_encode(k, m, w, matrix, data, coding, size);
+  for (i = 0; i < k; i++) memcpy(saved_data[i], data[i], size);
+  for (i = 0; i < m; i++) memcpy(saved_coding[i], coding[i], size);
+
+  cache = jerasure_generate_plan_cache(k, m, w, matrix, row_k_ones, 3);
+  assert(cache != NULL);
+
+  /* Twice through, so that the second pass has both hits and misses */
+
+  for (pass = 0; pass < 2; pass++) {
+    for (mask = 1; mask < (1 << (k+m)); mask++) {
+      ne = 0;
+      for (i = 0; i < k+m; i++) if (mask & (1 << i)) erasures[ne++] = i;
+      erasures[ne] = -1;
+
+      if (ne > m) {
+        assert(jerasure_make_decoding_plan(k, m, w, matrix, row_k_ones, erasures) == NULL);
+        assert(jerasure_plan_decode_cache(cache, erasures, data, coding, size) == -1);
+        continue;
+      }
+
+      if (pass == 0) check_decoding_matrix(k, m, w, matrix, erasures);
+      plan = jerasure_make_decoding_plan(k, m, w, matrix, row_k_ones, erasures);
+      assert(plan != NULL);
+      erase(k, erasures, data, coding, size);
+      assert(jerasure_plan_decode(plan, data, coding, size) == 0);
+      check_same(data, saved_data, k, size);
+      check_same(coding, saved_coding, m, size);
+      jerasure_free_decoding_plan(plan);
+
+      erase(k, erasures, data, coding, size);
+      assert(jerasure_plan_decode_cache(cache, erasures, data, coding, size) == 0);
+      check_same(data, saved_data, k, size);
+      check_same(coding, saved_coding, m, size);
+    }
+  }
+
+  /* The plans own their copies of the matrix */
+
+  free(matrix);
+  erasures[0] = 0;
+  erasures[1] = -1;
+  erase(k, erasures, data, coding, size);
+  assert(jerasure_plan_decode_cache(cache, erasures, data, coding, size) == 0);
+  check_same(data, saved_data, k, size);
+
+  jerasure_free_plan_cache(cache);
+  free_regions(data, k);
+  free_regions(coding, m);
+  free_regions(saved_data, k);
+  free_regions(saved_coding, m);
+  free(erasures);
+}
+
+int main(int argc, char **argv)
+{
+  MOA_Seed(5);
+
+  test(4, 3, 8, reed_sol_vandermonde_coding_matrix(4, 3, 8), 1, 1024);
+  test(5, 2, 16, reed_sol_vandermonde_coding_matrix(5, 2, 16), 1, 1000);
+  test(3, 3, 32, cauchy_good_general_coding_matrix(3, 3, 32), 0, 64);
+  return 0;
+}
@@ -1,8 +1,277 @@
 #include <assert.h>
+#include <stdlib.h>
+#include <string.h>
 #include "galois.h"
+#include "jerasure.h"
+
+/* The log tables must agree with galois_single_multiply, zero included */
+
+static void test_log_tables(int w, int step)
+{
+  const uint32_t *lg;
+  const uint16_t *alg;
+  int x, y, n;
+
+  n = (1 << w) - 1;
+  assert(galois_log_tables(w, &lg, &alg) == 0);
+  for (x = 0; x <= n; x += step) {
+    for (y = 0; y <= n; y += step) {
+      assert(alg[lg[x]+lg[y]] == galois_single_multiply(x, y, w));
+      if (y != 0) assert(alg[lg[x]+n-lg[y]] == galois_single_divide(x, y, w));
+    }
+  }
+}
+
+/* Inverts random matrices, and checks that the product is the identity */
+
+static void test_invert_matrix(int rows, int w)
+{
+  int *mat, *copy, *inv, i, j, l, x, trial, ninv;
+
+  mat = (int *) malloc(sizeof(int)*rows*rows);
+  copy = (int *) malloc(sizeof(int)*rows*rows);
+  inv = (int *) malloc(sizeof(int)*rows*rows);
+  ninv = 0;
+  for (trial = 0; trial < 4; trial++) {
+    for (i = 0; i < rows*rows; i++) mat[i] = rand() & ((w == 32) ? 0x7fffffff : (1 << w) - 1);
+    if (trial == 3) for (j = 0; j < rows; j++) mat[(rows-1)*rows+j] = galois_single_multiply(mat[j], 3, w);
+    memcpy(copy, mat, sizeof(int)*rows*rows);
+    x = jerasure_invertible_matrix(copy, rows, w);
+    memcpy(copy, mat, sizeof(int)*rows*rows);
+    assert(jerasure_invert_matrix(copy, inv, rows, w) == (x ? 0 : -1));
+    if (trial == 3) assert(!x);
+    if (!x) continue;
+    ninv++;
+    for (i = 0; i < rows; i++) {
+      for (j = 0; j < rows; j++) {
+        x = 0;
+        for (l = 0; l < rows; l++) x ^= galois_single_multiply(mat[i*rows+l], inv[l*rows+j], w);
+        assert(x == (i == j));
+      }
+    }
+  }
+  assert(ninv > 0);
+  free(mat);
+  free(copy);
+  free(inv);
+}
+
+/* galois_region_xor_multi against XORing byte by byte */
+
+static void test_region_xor_multi(void)
+{
+  char *src[5], *dest, *expect;
+  int trial, nsrc, nbytes, off, add, i, j;
+
+  for (i = 0; i < 5; i++) src[i] = (char *) malloc(1040);
+  dest = (char *) malloc(1040);
+  expect = (char *) malloc(1040);
+  for (trial = 0; trial < 40; trial++) {
+    nsrc = 1 + rand() % 5;
+    nbytes = rand() % 1024;
+    off = rand() % 16;
+    add = trial % 2;
+    for (i = 0; i < 1040; i++) {
+      for (j = 0; j < 5; j++) src[j][i] = rand();
+      dest[i] = rand();
+    }
+    memcpy(expect, dest, 1040);
+    for (i = off; i < off+nbytes; i++) {
+      if (!add) expect[i] = 0;
+      for (j = 0; j < nsrc; j++) expect[i] ^= src[j][i];
+    }
+    for (j = 0; j < nsrc; j++) src[j] += off;
+    galois_region_xor_multi(src, nsrc, dest+off, nbytes, add);
+    for (j = 0; j < nsrc; j++) src[j] -= off;
+    assert(memcmp(dest, expect, 1040) == 0);
+  }
+  for (i = 0; i < 5; i++) free(src[i]);
+  free(dest);
+  free(expect);
+}
+
+/* Region tables, and for w=4 and w=8 the region multiplies without them,
+   must agree with galois_single_multiply on unaligned regions of any length,
+   and aren't made for ALTMAP fields */
+
+static void test_region_tables(int w)
+{
+  galois_region_table *t;
+  char *src, *dest, *expect, *orig;
+  uint32_t x, y;
+  int trial, multby, nbytes, off, add, i, nb;
+
+  nb = (w == 4) ? 1 : w/8;
+  src = (char *) malloc(1040);
+  dest = (char *) malloc(1040);
+  expect = (char *) malloc(1040);
+  orig = (char *) malloc(1040);
+  for (trial = 0; trial < 40; trial++) {
+    multby = rand() & ((w == 32) ? 0x7fffffff : (1 << w) - 1);
+    if (trial == 0) multby = 2;
+    nbytes = (rand() % (1024/nb)) * nb;
+    off = rand() % 16;
+    add = trial % 2;
+    for (i = 0; i < 1040; i++) {
+      src[i] = rand();
+      dest[i] = rand();
+    }
+    memcpy(expect, dest, 1040);
+    memcpy(orig, dest, 1040);
+    for (i = 0; i < nbytes; i += nb) {
+      x = y = 0;
+      memcpy(&x, src+off+i, nb);
+      memcpy(&y, dest+off+i, nb);
+      if (w == 4) {
+        x = galois_single_multiply(x & 0xf, multby, 4) | (galois_single_multiply(x >> 4, multby, 4) << 4);
+      } else {
+        x = galois_single_multiply(x, multby, w);
+      }
+      if (add) x ^= y;
+      memcpy(expect+off+i, &x, nb);
+    }
+    t = galois_make_region_table(w, multby);
+    assert(t != NULL);
+    galois_table_region_multiply(t, src+off, nbytes, dest+off, add);
+    galois_free_region_table(t);
+    assert(memcmp(dest, expect, 1040) == 0);
+    if (w <= 8) {
+      memcpy(dest, orig, 1040);
+      if (w == 4) {
+        galois_w04_region_multiply(src+off, multby, nbytes, dest+off, add);
+      } else {
+        galois_w08_region_multiply(src+off, multby, nbytes, dest+off, add);
+      }
+      assert(memcmp(dest, expect, 1040) == 0);
+      if (!add) {
+        memcpy(dest, orig, 1040);
+        memcpy(dest+off, src+off, nbytes);
+        if (w == 4) {
+          galois_w04_region_multiply(dest+off, multby, nbytes, NULL, 0);
+        } else {
+          galois_w08_region_multiply(dest+off, multby, nbytes, NULL, 0);
+        }
+        assert(memcmp(dest, expect, 1040) == 0);
+      }
+    }
+  }
+  free(src);
+  free(dest);
+  free(expect);
+  free(orig);
+}
+
+/* ALTMAP tables, against converting out, multiplying the words and converting back */
+
+static void test_altmap_region_tables(int w)
+{
+  galois_region_table *t;
+  char *src, *dest, *expect, *plain;
+  uint32_t x, y;
+  int trial, multby, nbytes, add, i, nb;
+
+  nb = w/8;
+  src = (char *) malloc(1024);
+  dest = (char *) malloc(1024);
+  expect = (char *) malloc(1024);
+  plain = (char *) malloc(1024);
+  for (trial = 0; trial < 20; trial++) {
+    multby = rand() & ((w == 32) ? 0x7fffffff : (1 << w) - 1);
+    nbytes = (rand() % (1024/(2*w)+1)) * 2*w;
+    add = trial % 2;
+    for (i = 0; i < 1024; i++) {
+      src[i] = rand();
+      dest[i] = rand();
+    }
+    galois_from_altmap(w, src, plain, nbytes);
+    galois_from_altmap(w, dest, expect, nbytes);
+    for (i = 0; i < nbytes; i += nb) {
+      x = y = 0;
+      memcpy(&x, plain+i, nb);
+      memcpy(&y, expect+i, nb);
+      x = galois_single_multiply(x, multby, w);
+      if (add) x ^= y;
+      memcpy(expect+i, &x, nb);
+    }
+    galois_to_altmap(w, expect, expect, nbytes);
+    memcpy(expect+nbytes, dest+nbytes, 1024-nbytes);
+
+    t = galois_make_altmap_region_table(w, multby);
+    assert(t != NULL);
+    galois_table_region_multiply(t, src, nbytes, dest, add);
+    galois_free_region_table(t);
+    assert(memcmp(dest, expect, 1024) == 0);
+
+    /* And the conversions are inverses, in place or not */
+
+    galois_to_altmap(w, plain, dest, nbytes);
+    assert(memcmp(dest, src, nbytes) == 0);
+    galois_from_altmap(w, dest, dest, nbytes);
+    assert(memcmp(dest, plain, nbytes) == 0);
+  }
+  free(src);
+  free(dest);
+  free(expect);
+  free(plain);
+}
+
+/* With an ALTMAP field, there are no tables, and old ones use the field.
+   ALTMAP tables match the field's own products. */
+
+static void test_region_tables_altmap(void)
+{
+  galois_region_table *t;
+  gf_t *gf;
+  char *src, *dest, *expect;
+  int i;
+
+  src = (char *) malloc(256);
+  dest = (char *) malloc(256);
+  expect = (char *) malloc(256);
+  for (i = 0; i < 256; i++) src[i] = rand();
+
+  t = galois_make_region_table(16, 0x1234);
+  assert(t != NULL);
+  gf = galois_init_field(16, GF_MULT_SPLIT_TABLE, GF_REGION_ALTMAP, GF_DIVIDE_DEFAULT, 0, 16, 4);
+  galois_change_technique(gf, 16);
+  assert(galois_make_region_table(16, 0x1234) == NULL);
+  galois_w16_region_multiply(src, 0x1234, 256, expect, 0);
+  galois_table_region_multiply(t, src, 256, dest, 0);
+  assert(memcmp(dest, expect, 256) == 0);
+  galois_free_region_table(t);
+  t = galois_make_altmap_region_table(16, 0x1234);
+  assert(t != NULL);
+  galois_table_region_multiply(t, src, 256, dest, 0);
+  assert(memcmp(dest, expect, 256) == 0);
+  galois_free_region_table(t);
+  assert(galois_uninit_field(16) == 0);
+  free(src);
+  free(dest);
+  free(expect);
+}
+
+/* A field that the caller made goes back to the caller when it's replaced,
+   and may be freed at once.  The field in use is freed by the library. */
+
+static void test_change_technique(void)
+{
+  gf_t *gf1, *gf2;
+
+  gf1 = galois_init_field(8, GF_MULT_DEFAULT, GF_REGION_DEFAULT, GF_DIVIDE_DEFAULT, 0, 0, 0);
+  gf2 = galois_init_field(8, GF_MULT_DEFAULT, GF_REGION_DEFAULT, GF_DIVIDE_DEFAULT, 0, 0, 0);
+  galois_change_technique(gf1, 8);
+  assert(galois_single_multiply(0x80, 2, 8) == 0x1d);
+  galois_change_technique(gf2, 8);
+  free(gf1);
+  assert(galois_single_multiply(0x80, 2, 8) == 0x1d);
+  assert(galois_uninit_field(8) == 0);
+}
 
 int main(int argc, char **argv)
 {
+  galois_isa top;
+  int isa;
+
   assert(galois_init_default_field(4) == 0);
   assert(galois_uninit_field(4) == 0);
   assert(galois_init_default_field(4) == 0);
@@ -13,6 +282,41 @@ int main(int argc, char **argv)
   assert(galois_init_default_field(8) == 0);
   assert(galois_uninit_field(8) == 0);
 
+  test_log_tables(4, 1);
+  test_log_tables(8, 1);
+  test_log_tables(11, 7);
+  test_log_tables(16, 251);
+  assert(galois_uninit_field(8) == 0);
+  test_log_tables(8, 1);
+
+  srand(11);
+  test_invert_matrix(5, 4);
+  test_invert_matrix(16, 8);
+  test_invert_matrix(40, 16);
+  test_invert_matrix(12, 32);
+
+  /* The kernels, with each instruction set that the CPU has */
+
+  top = galois_get_isa();
+  for (isa = GALOIS_ISA_GENERIC; isa <= GALOIS_ISA_GFNI; isa++) {
+    if (galois_set_isa((galois_isa) isa) < 0) continue;
+    test_region_xor_multi();
+    test_region_tables(4);
+    test_region_tables(8);
+    test_region_tables(16);
+    test_region_tables(32);
+    test_altmap_region_tables(8);
+    test_altmap_region_tables(16);
+    test_altmap_region_tables(32);
+  }
+  assert(galois_set_isa(top) == 0);
+  assert(galois_set_isa((galois_isa) (GALOIS_ISA_GFNI+1)) == -1);
+  assert(strcmp(galois_isa_name(GALOIS_ISA_SSSE3), "ssse3") == 0);
+
+  test_region_tables_altmap();
+  test_change_technique();
+  test_region_tables(16);
+
   return 0;
 }
 /*
@@ -0,0 +1,163 @@
+/* *
+ * Copyright (c) 2014, James S. Plank and Kevin Greenan
+ * All rights reserved.
+ *
+ * Jerasure - A C/C++ Library for a Variety of Reed-Solomon and RAID-6 Erasure
+ * Coding Techniques
+ *
+ * Revision 2.0: Galois Field backend now links to GF-Complete
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  - Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ *  - Neither the name of the University of Tennessee nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Checks that the _mt coding routines produce the same bytes as the
+   single-threaded ones, for several thread counts and region sizes. */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <gf_rand.h>
+#include "jerasure.h"
+#include "reed_sol.h"
+#include "cauchy.h"
+#include "test_regions.h"
+
+static void check_same(char **r1, char **r2, int n, int size)
+{
+  int i;
+
+  for (i = 0; i < n; i++) assert(memcmp(r1[i], r2[i], size) == 0);
+}
+
+static void test_matrix(int k, int m, int w, int size)
+{
+  int *matrix, erasures[3], i;
+  char **data, **coding, **check, **saved;
+
+  matrix = reed_sol_vandermonde_coding_matrix(k, m, w);
+  data = alloc_regions(k, size, 1);
+  coding = alloc_regions(m, size, 0);
+  check = alloc_regions(m, size, 0);
+
+  jerasure_matrix_encode(k, m, w, matrix, data, check, size);
+  jerasure_matrix_encode_mt(k, m, w, matrix, data, coding, size);
+  check_same(coding, check, m, size);
+
+  /* Erase a data device and a coding device, and decode */
+
+  saved = alloc_regions(k, size, 0);
+  for (i = 0; i < k; i++) memcpy(saved[i], data[i], size);
+  erasures[0] = 1;
+  erasures[1] = k;
+  erasures[2] = -1;
+  memset(data[1], 0, size);
+  memset(coding[0], 0, size);
+  assert(jerasure_matrix_decode_mt(k, m, w, matrix, 1, erasures, data, coding, size) == 0);
+  check_same(data, saved, k, size);
+  check_same(coding, check, m, size);
+
+  free_regions(data, k);
+  free_regions(coding, m);
+  free_regions(check, m);
+  free_regions(saved, k);
+  free(matrix);
+}
+
+static void test_bitmatrix(int k, int m, int w, int packetsize, int size)
+{
+  int *matrix, *bitmatrix, **schedule, ***scache, erasures[3], i;
+  char **data, **coding, **check, **saved;
+
+  matrix = cauchy_good_general_coding_matrix(k, m, w);
+  bitmatrix = jerasure_matrix_to_bitmatrix(k, m, w, matrix);
+  schedule = jerasure_smart_bitmatrix_to_schedule(k, m, w, bitmatrix);
+  data = alloc_regions(k, size, 1);
+  coding = alloc_regions(m, size, 0);
+  check = alloc_regions(m, size, 0);
+
+  jerasure_bitmatrix_encode(k, m, w, bitmatrix, data, check, size, packetsize);
+  jerasure_bitmatrix_encode_mt(k, m, w, bitmatrix, data, coding, size, packetsize);
+  check_same(coding, check, m, size);
+
+  memset(coding[0], 0, size);
+  jerasure_schedule_encode_mt(k, m, w, schedule, data, coding, size, packetsize);
+  check_same(coding, check, m, size);
+
+  if (m == 2) {
+    scache = jerasure_generate_schedule_cache(k, m, w, bitmatrix, 1);
+    saved = alloc_regions(k, size, 0);
+    for (i = 0; i < k; i++) memcpy(saved[i], data[i], size);
+    erasures[0] = 0;
+    erasures[1] = k-1;
+    erasures[2] = -1;
+    memset(data[0], 0, size);
+    memset(data[k-1], 0, size);
+    assert(jerasure_schedule_decode_cache_mt(k, m, w, scache, erasures, data, coding,
+                                             size, packetsize) == 0);
+    check_same(data, saved, k, size);
+    free_regions(saved, k);
+    jerasure_free_schedule_cache(k, m, scache);
+  }
+
+  free_regions(data, k);
+  free_regions(coding, m);
+  free_regions(check, m);
+  jerasure_free_schedule(schedule);
+  free(bitmatrix);
+  free(matrix);
+}
+
+int main(int argc, char **argv)
+{
+  int threads[4] = { 1, 2, 3, 8 };
+  int i;
+
+  MOA_Seed(4);
+
+  /* The pool starts by itself the first time */
+
+  test_matrix(6, 3, 8, 64*1024);
+
+  for (i = 0; i < 4; i++) {
+    assert(jerasure_mt_set_threads(threads[i], i & 1) == 0);
+    assert(jerasure_mt_get_threads() == threads[i]);
+    test_matrix(6, 3, 8, 64*1024);
+    test_matrix(10, 4, 16, 100*1000);
+    test_matrix(4, 2, 32, 8);
+    test_bitmatrix(5, 2, 8, 64, 5*8*64);
+    test_bitmatrix(6, 3, 4, 8, 1000*4*8);
+  }
+
+  jerasure_mt_shutdown();
+  test_matrix(6, 3, 8, 4096);
+  jerasure_mt_shutdown();
+  return 0;
+}
@@ -0,0 +1,274 @@
+/* *
+ * Copyright (c) 2014, James S. Plank and Kevin Greenan
+ * All rights reserved.
+ *
+ * Jerasure - A C/C++ Library for a Variety of Reed-Solomon and RAID-6 Erasure
+ * Coding Techniques
+ *
+ * Revision 2.0: Galois Field backend now links to GF-Complete
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  - Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ *  - Neither the name of the University of Tennessee nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Checks that packed bitmatrices convert to and from int bitmatrices, that
+   the packed encoder, inversion and schedule makers give the same results
+   as the int bitmatrix versions, and that bitmatrix inversion is right. */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <gf_rand.h>
+#include "jerasure.h"
+#include "cauchy.h"
+#include "liberation.h"
+#include "test_regions.h"
+
+#define talloc(type, num) (type *) malloc(sizeof(type)*(num))
+
+static void same_schedule(int **s1, int **s2)
+{
+  int i, j;
+
+  assert(s1 != NULL && s2 != NULL);
+  for (i = 0; s1[i][0] >= 0; i++) {
+    for (j = 0; j < 5; j++) assert(s1[i][j] == s2[i][j]);
+  }
+  assert(s2[i][0] == s1[i][0] && s2[i][0] < 0);
+  jerasure_free_schedule(s1);
+  jerasure_free_schedule(s2);
+}
+
+/* Whether a rows*rows bitmatrix is invertible, by plain elimination */
+
+static int full_rank(int *mat, int rows)
+{
+  int *a, i, j, l, tmp, ret;
+
+  a = talloc(int, rows*rows);
+  memcpy(a, mat, sizeof(int)*rows*rows);
+  ret = 1;
+  for (i = 0; i < rows && ret; i++) {
+    for (j = i; j < rows && a[j*rows+i] == 0; j++) ;
+    if (j == rows) {
+      ret = 0;
+      break;
+    }
+    for (l = 0; l < rows; l++) {
+      tmp = a[i*rows+l]; a[i*rows+l] = a[j*rows+l]; a[j*rows+l] = tmp;
+    }
+    for (j = i+1; j < rows; j++) {
+      if (a[j*rows+i]) for (l = 0; l < rows; l++) a[j*rows+l] ^= a[i*rows+l];
+    }
+  }
+  free(a);
+  return ret;
+}
+
+/* Random bitmatrices are inverted and the product checked against the
+   identity.  Half of them are made from the identity with row operations,
+   so they are invertible. */
+
+static void test_inversion(int rows)
+{
+  int *mat, *copy, *inv;
+  int trial, i, j, l, x, rank, ninv;
+  jerasure_packed_bitmatrix *pb;
+
+  mat = talloc(int, rows*rows);
+  copy = talloc(int, rows*rows);
+  inv = talloc(int, rows*rows);
+  ninv = 0;
+  for (trial = 0; trial < 8; trial++) {
+    if (trial%2 == 0) {
+      for (i = 0; i < rows*rows; i++) mat[i] = (i/rows == i%rows);
+      for (x = 0; x < 4*rows && rows > 1; x++) {
+        i = MOA_Random_W(32, 1)%rows;
+        j = MOA_Random_W(32, 1)%rows;
+        if (i != j) for (l = 0; l < rows; l++) mat[i*rows+l] ^= mat[j*rows+l];
+      }
+    } else {
+      for (i = 0; i < rows*rows; i++) mat[i] = (MOA_Random_W(8, 1) < 40);
+    }
+    if (trial == 7 && rows > 1) for (j = 0; j < rows; j++) mat[(rows-1)*rows+j] = mat[j];
+    rank = full_rank(mat, rows);
+
+    memcpy(copy, mat, sizeof(int)*rows*rows);
+    assert(jerasure_invertible_bitmatrix(copy, rows) == rank);
+    pb = jerasure_pack_bitmatrix(mat, rows, rows);
+    assert(jerasure_invertible_packed_bitmatrix(pb) == rank);
+    jerasure_free_packed_bitmatrix(pb);
+
+    memcpy(copy, mat, sizeof(int)*rows*rows);
+    assert(jerasure_invert_bitmatrix(copy, inv, rows) == (rank ? 0 : -1));
+    if (!rank) continue;
+    ninv++;
+    for (i = 0; i < rows; i++) {
+      for (j = 0; j < rows; j++) {
+        x = 0;
+        for (l = 0; l < rows; l++) x ^= (mat[i*rows+l] & inv[l*rows+j]);
+        assert(x == (i == j));
+      }
+    }
+  }
+  assert(ninv > 0);
+  free(mat);
+  free(copy);
+  free(inv);
+}
+
+static void test(int k, int m, int w, int *matrix, int *bitmatrix, int packetsize)
+{
+  jerasure_packed_bitmatrix *pb, *pb2, *pinv;
+  char **data, **coding, **expected;
+  int *unpacked, *mat, *inv, *erasures;
+  int size, i, j, t1, t2, e1, e2, rows;
+
+  pb = jerasure_pack_bitmatrix(bitmatrix, m*w, k*w);
+  assert(pb != NULL && pb->rows == m*w && pb->cols == k*w);
+  unpacked = jerasure_unpack_bitmatrix(pb);
+  assert(memcmp(unpacked, bitmatrix, sizeof(int)*k*m*w*w) == 0);
+  free(unpacked);
+
+  if (matrix != NULL) {
+    pb2 = jerasure_matrix_to_packed_bitmatrix(k, m, w, matrix);
+    assert(memcmp(pb2->bits, pb->bits, sizeof(uint64_t)*pb->rows*pb->words) == 0);
+    jerasure_free_packed_bitmatrix(pb2);
+  }
+
+  /* Encoding */
+
+  size = w*packetsize*3;
+  data = alloc_regions(k, size, 1);
+  coding = alloc_regions(m, size, 0);
+  expected = alloc_regions(m, size, 0);
+  jerasure_bitmatrix_encode(k, m, w, bitmatrix, data, expected, size, packetsize);
+  jerasure_packed_bitmatrix_encode(k, m, w, pb, data, coding, size, packetsize);
+  for (i = 0; i < m; i++) assert(memcmp(coding[i], expected[i], size) == 0);
+
+  /* Schedules */
+
+  same_schedule(jerasure_dumb_bitmatrix_to_schedule(k, m, w, bitmatrix),
+                jerasure_dumb_packed_bitmatrix_to_schedule(k, m, w, pb));
+  same_schedule(jerasure_smart_bitmatrix_to_schedule(k, m, w, bitmatrix),
+                jerasure_smart_packed_bitmatrix_to_schedule(k, m, w, pb));
+  same_schedule(jerasure_cse_bitmatrix_to_schedule(k, m, w, bitmatrix, &t1),
+                jerasure_cse_packed_bitmatrix_to_schedule(k, m, w, pb, &t2));
+  assert(t1 == t2);
+
+  erasures = talloc(int, 3);
+  for (e1 = 0; e1 < k+m; e1++) {
+    for (e2 = e1; e2 < k+m; e2++) {
+      erasures[0] = e1;
+      erasures[1] = (e2 == e1) ? -1 : e2;
+      erasures[2] = -1;
+      if (e2 != e1 && m < 2) continue;
+      for (i = 0; i <= JERASURE_SCHEDULE_CSE; i++) {
+        same_schedule(jerasure_generate_decoding_schedule(k, m, w, bitmatrix, erasures, i),
+                      jerasure_generate_packed_decoding_schedule(k, m, w, pb, erasures, i));
+      }
+    }
+  }
+  free(erasures);
+
+  /* Inversion, of the square bitmatrix made from the first k*w rows of the
+     distribution bitmatrix, with the identity on top */
+
+  rows = k*w;
+  mat = talloc(int, rows*rows);
+  inv = talloc(int, rows*rows);
+  for (i = 0; i < rows; i++) {
+    for (j = 0; j < rows; j++) {
+      if (i < rows-w || m == 0) {
+        mat[i*rows+j] = (i == j);
+      } else {
+        mat[i*rows+j] = bitmatrix[(i-(rows-w))*rows+j];
+      }
+    }
+  }
+  pb2 = jerasure_pack_bitmatrix(mat, rows, rows);
+  pinv = jerasure_new_packed_bitmatrix(rows, rows);
+  t1 = jerasure_invert_bitmatrix(mat, inv, rows);
+  t2 = jerasure_invert_packed_bitmatrix(pb2, pinv);
+  assert(t1 == t2);
+  if (t1 == 0) {
+    unpacked = jerasure_unpack_bitmatrix(pinv);
+    assert(memcmp(unpacked, inv, sizeof(int)*rows*rows) == 0);
+    free(unpacked);
+  }
+  jerasure_free_packed_bitmatrix(pb2);
+  jerasure_free_packed_bitmatrix(pinv);
+
+  /* A singular matrix: two equal rows */
+
+  for (j = 0; j < rows; j++) mat[j] = mat[rows+j] = (j < 2);
+  pb2 = jerasure_pack_bitmatrix(mat, rows, rows);
+  assert(jerasure_invertible_packed_bitmatrix(pb2) == 0);
+  jerasure_free_packed_bitmatrix(pb2);
+
+  free(mat);
+  free(inv);
+  free_regions(data, k);
+  free_regions(coding, m);
+  free_regions(expected, m);
+  jerasure_free_packed_bitmatrix(pb);
+}
+
+int main(int argc, char **argv)
+{
+  int *matrix, *bitmatrix;
+
+  MOA_Seed(7);
+
+  matrix = cauchy_good_general_coding_matrix(6, 3, 8);
+  bitmatrix = jerasure_matrix_to_bitmatrix(6, 3, 8, matrix);
+  test(6, 3, 8, matrix, bitmatrix, 16);
+  free(matrix);
+  free(bitmatrix);
+
+  matrix = cauchy_original_coding_matrix(12, 4, 16);
+  bitmatrix = jerasure_matrix_to_bitmatrix(12, 4, 16, matrix);
+  test(12, 4, 16, matrix, bitmatrix, 8);
+  free(matrix);
+  free(bitmatrix);
+
+  bitmatrix = liberation_coding_bitmatrix(5, 7);
+  test(5, 2, 7, NULL, bitmatrix, 8);
+  free(bitmatrix);
+
+  test_inversion(1);
+  test_inversion(7);
+  test_inversion(64);
+  test_inversion(100);
+  test_inversion(193);
+
+  printf("test_packed_bitmatrix: OK\n");
+  return 0;
+}
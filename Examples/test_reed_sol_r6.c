@@ -0,0 +1,146 @@
+/* *
+ * Copyright (c) 2014, James S. Plank and Kevin Greenan
+ * All rights reserved.
+ *
+ * Jerasure - A C/C++ Library for a Variety of Reed-Solomon and RAID-6 Erasure
+ * Coding Techniques
+ *
+ * Revision 2.0: Galois Field backend now links to GF-Complete
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  - Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ *  - Neither the name of the University of Tennessee nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Checks reed_sol_r6_encode against jerasure_matrix_encode with the
+   RAID-6 coding matrix, for sizes that exercise both the vector loops and
+   the word-at-a-time loop at the end.  Then checks that reed_sol_r6_decode
+   recovers every pattern of one or two erasures. */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <gf_rand.h>
+#include "galois.h"
+#include "jerasure.h"
+#include "reed_sol.h"
+#include "test_regions.h"
+
+static void test_encode(int k, int w, int size)
+{
+  char **data, **coding, **expected;
+  int *matrix, i;
+
+  matrix = reed_sol_r6_coding_matrix(k, w);
+  assert(matrix != NULL);
+  data = alloc_regions(k, size, 1);
+  coding = alloc_regions(2, size, 0);
+  expected = alloc_regions(2, size, 0);
+
+  jerasure_matrix_encode(k, 2, w, matrix, data, expected, size);
+  assert(reed_sol_r6_encode(k, w, data, coding, size) == 1);
+  for (i = 0; i < 2; i++) assert(memcmp(coding[i], expected[i], size) == 0);
+
+  free_regions(data, k);
+  free_regions(coding, 2);
+  free_regions(expected, 2);
+  free(matrix);
+}
+
+static void test_decode(int k, int w, int size)
+{
+  char **data, **coding, **saved;
+  int erasures[4], e1, e2, i;
+
+  data = alloc_regions(k, size, 1);
+  coding = alloc_regions(2, size, 0);
+  saved = alloc_regions(k+2, size, 0);
+  assert(reed_sol_r6_encode(k, w, data, coding, size) == 1);
+  for (i = 0; i < k+2; i++) memcpy(saved[i], (i < k) ? data[i] : coding[i-k], size);
+
+  for (e1 = 0; e1 < k+2; e1++) {
+    for (e2 = e1; e2 < k+2; e2++) {
+      erasures[0] = e1;
+      erasures[1] = (e2 == e1) ? -1 : e2;
+      erasures[2] = -1;
+      for (i = 0; erasures[i] != -1; i++) {
+        memset((erasures[i] < k) ? data[erasures[i]] : coding[erasures[i]-k], 0x5a, size);
+      }
+      assert(reed_sol_r6_decode(k, w, erasures, data, coding, size) == 0);
+      for (i = 0; i < k+2; i++) {
+        assert(memcmp(saved[i], (i < k) ? data[i] : coding[i-k], size) == 0);
+      }
+    }
+  }
+
+  erasures[0] = 0;
+  erasures[1] = 1;
+  erasures[2] = k;
+  erasures[3] = -1;
+  assert(reed_sol_r6_decode(k, w, erasures, data, coding, size) == -1);
+
+  free_regions(data, k);
+  free_regions(coding, 2);
+  free_regions(saved, k+2);
+}
+
+int main(int argc, char **argv)
+{
+  int sizes[] = { 8, 24, 40, 136, 1000, 4096, 65544 };
+  int ws[] = { 8, 16, 32 };
+  int ks[] = { 1, 2, 3, 6, 12 };
+  galois_isa top;
+  int i, j, l, isa;
+
+  MOA_Seed(3);
+
+  /* With each instruction set that the CPU has */
+
+  top = galois_get_isa();
+  for (isa = GALOIS_ISA_GENERIC; isa <= GALOIS_ISA_GFNI; isa++) {
+    if (galois_set_isa((galois_isa) isa) < 0) continue;
+    for (i = 0; i < (int) (sizeof(ws)/sizeof(int)); i++) {
+      for (j = 0; j < (int) (sizeof(ks)/sizeof(int)); j++) {
+        for (l = 0; l < (int) (sizeof(sizes)/sizeof(int)); l++) {
+          test_encode(ks[j], ws[i], sizes[l]);
+        }
+      }
+    }
+    for (i = 0; i < (int) (sizeof(ws)/sizeof(int)); i++) {
+      test_decode(2, ws[i], 40);
+      test_decode(6, ws[i], 8192+136);
+      test_decode(12, ws[i], 1000);
+    }
+  }
+  galois_set_isa(top);
+  assert(reed_sol_r6_encode(4, 7, NULL, NULL, 8) == 0);
+
+  printf("test_reed_sol_r6: OK\n");
+  return 0;
+}
@@ -0,0 +1,40 @@
+/* Regions for the tests: n regions of size bytes, filled with random bytes
+   if fill is set.  The tests exit if they can't be allocated. */
+
+#ifndef JERASURE_INCLUDED__TEST_REGIONS_H
+#define JERASURE_INCLUDED__TEST_REGIONS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <gf_rand.h>
+
+static char **alloc_regions(int n, int size, int fill)
+{
+  char **regions;
+  int i;
+
+  regions = (char **) malloc(sizeof(char *)*n);
+  if (regions == NULL) {
+    fprintf(stderr, "alloc_regions - can't allocate %d regions\n", n);
+    exit(1);
+  }
+  for (i = 0; i < n; i++) {
+    regions[i] = (char *) malloc(size);
+    if (regions[i] == NULL) {
+      fprintf(stderr, "alloc_regions - can't allocate %d bytes\n", size);
+      exit(1);
+    }
+    if (fill) MOA_Fill_Random_Region(regions[i], size);
+  }
+  return regions;
+}
+
+static void free_regions(char **regions, int n)
+{
+  int i;
+
+  for (i = 0; i < n; i++) free(regions[i]);
+  free(regions);
+}
+
+#endif
@@ -0,0 +1,137 @@
+/* *
+ * Copyright (c) 2014, James S. Plank and Kevin Greenan
+ * All rights reserved.
+ *
+ * Jerasure - A C/C++ Library for a Variety of Reed-Solomon and RAID-6 Erasure
+ * Coding Techniques
+ *
+ * Revision 2.0: Galois Field backend now links to GF-Complete
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  - Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ *  - Neither the name of the University of Tennessee nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Checks that the lazy schedule cache decodes every erasure pattern for
+   m > 2, that it counts hits and misses, and that it stays under its
+   memory cap. */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <gf_rand.h>
+#include "jerasure.h"
+#include "cauchy.h"
+#include "test_regions.h"
+
+/* Decodes every pattern of 1 to m erasures once, and returns how many there were */
+
+static int decode_all(int k, int m, int size, jerasure_lazy_schedule_cache *cache,
+                      char **data, char **coding, char **saved_data, char **saved_coding)
+{
+  int erasures[32], mask, ne, i, n;
+
+  n = 0;
+  for (mask = 1; mask < (1 << (k+m)); mask++) {
+    ne = 0;
+    for (i = 0; i < k+m; i++) if (mask & (1 << i)) erasures[ne++] = i;
+    erasures[ne] = -1;
+    if (ne > m) {
+      assert(jerasure_schedule_decode_lazy_cache(cache, erasures, data, coding, size, 8) == -1);
+      continue;
+    }
+    for (i = 0; i < ne; i++) {
+      if (erasures[i] < k) {
+        memset(data[erasures[i]], 0, size);
+      } else {
+        memset(coding[erasures[i]-k], 0, size);
+      }
+    }
+    assert(jerasure_schedule_decode_lazy_cache(cache, erasures, data, coding, size, 8) == 0);
+    for (i = 0; i < k; i++) assert(memcmp(data[i], saved_data[i], size) == 0);
+    for (i = 0; i < m; i++) assert(memcmp(coding[i], saved_coding[i], size) == 0);
+    n++;
+  }
+  return n;
+}
+
+static void test(int k, int m, int w, int smart)
+{
+  int *matrix, *bitmatrix, size, i, n;
+  char **data, **coding, **saved_data, **saved_coding;
+  jerasure_lazy_schedule_cache *cache;
+  long stats[5];
+
+  size = w*8*10;
+  matrix = cauchy_good_general_coding_matrix(k, m, w);
+  bitmatrix = jerasure_matrix_to_bitmatrix(k, m, w, matrix);
+  data = alloc_regions(k, size, 1);
+  coding = alloc_regions(m, size, 0);
+  saved_data = alloc_regions(k, size, 0);
+  saved_coding = alloc_regions(m, size, 0);
+  jerasure_bitmatrix_encode(k, m, w, bitmatrix, data, coding, size, 8);
+  for (i = 0; i < k; i++) memcpy(saved_data[i], data[i], size);
+  for (i = 0; i < m; i++) memcpy(saved_coding[i], coding[i], size);
+
+  /* A big cache misses once per pattern, and then always hits */
+
+  cache = jerasure_make_lazy_schedule_cache(k, m, w, bitmatrix, smart, 1 << 30);
+  assert(cache != NULL);
+  n = decode_all(k, m, size, cache, data, coding, saved_data, saved_coding);
+  decode_all(k, m, size, cache, data, coding, saved_data, saved_coding);
+  jerasure_get_lazy_schedule_cache_stats(cache, stats);
+  assert(stats[0] == n && stats[1] == n && stats[2] == 0 && stats[3] == n);
+  jerasure_free_lazy_schedule_cache(cache);
+
+  /* A small one has to throw schedules out, and stays under its cap */
+
+  cache = jerasure_make_lazy_schedule_cache(k, m, w, bitmatrix, smart, 8192);
+  assert(cache != NULL);
+  decode_all(k, m, size, cache, data, coding, saved_data, saved_coding);
+  jerasure_get_lazy_schedule_cache_stats(cache, stats);
+  assert(stats[0] + stats[1] == n && stats[2] > 0 && stats[4] <= 8192);
+  jerasure_free_lazy_schedule_cache(cache);
+
+  free_regions(data, k);
+  free_regions(coding, m);
+  free_regions(saved_data, k);
+  free_regions(saved_coding, m);
+  free(bitmatrix);
+  free(matrix);
+}
+
+int main(int argc, char **argv)
+{
+  MOA_Seed(6);
+
+  test(5, 3, 4, 1);
+  test(4, 4, 5, 0);
+  test(6, 2, 8, 1);
+  return 0;
+}
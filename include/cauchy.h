@@ -49,6 +49,23 @@ extern void cauchy_improve_coding_matrix(int k, int m, int w, int *matrix);
 extern int *cauchy_good_general_coding_matrix(int k, int m, int w);
 extern int cauchy_n_ones(int n, int w);
 
+/* These are jerasure_make_decoding_rows, _matrix and _bitmatrix for a Cauchy
+   matrix with matrix[i*k+j] = 1/(X[i]+Y[j]), as from cauchy_xy_coding_matrix
+   (cauchy_original_coding_matrix has X[i] = i and Y[j] = m+j), with its rows
+   and columns possibly scaled, as cauchy_improve_coding_matrix does.  Matrix
+   may be NULL for an unscaled one.  The inverse is computed in closed form,
+   in O(k*e) for e erased data devices, instead of by elimination, and is the
+   same.  They return -1 if the matrix isn't such a Cauchy matrix, so that
+   the caller can fall back on the jerasure_ routines.  The bitmatrix
+   routine takes the GF matrix, and not the bitmatrix. */
+
+extern int cauchy_make_decoding_rows(int k, int m, int w, int *matrix, int *X, int *Y, int *erased,
+                                     int nrows, int *row_ids, int *decoding_rows, int *dm_ids);
+extern int cauchy_make_decoding_matrix(int k, int m, int w, int *matrix, int *X, int *Y, int *erased,
+                                       int *decoding_matrix, int *dm_ids);
+extern int cauchy_make_decoding_bitmatrix(int k, int m, int w, int *matrix, int *X, int *Y,
+                                          int *erased, int *decoding_matrix, int *dm_ids);
+
 #ifdef __cplusplus
 }
 #endif
@@ -46,6 +46,20 @@
 extern "C" {
 #endif
 
+/* The fields are set up the first time they are used, and any number of
+   threads may do that at once.  galois_change_technique may also be called
+   while other threads are coding: they use either the old field or the new
+   one, and the old one isn't freed until galois_uninit_field(w), which must
+   only be called when no other thread is using field w.
+
+   A gf_t passed to galois_change_technique must be malloc'd.  The library
+   owns it while it is the field in use: galois_uninit_field(w) calls gf_free
+   on it and frees it, as it always has.  When galois_change_technique
+   replaces it, the gf_t itself goes back to the caller, who may free it
+   then, as before -- once no other thread can be using it.  What gf_free
+   releases stays the library's either way, and for a replaced field that
+   happens in galois_uninit_field(w) rather than in galois_change_technique. */
+
 extern int galois_init_default_field(int w);
 extern int galois_uninit_field(int w);
 extern void galois_change_technique(gf_t *gf, int w);
@@ -54,12 +68,43 @@ extern int galois_single_multiply(int a, int b, int w);
 extern int galois_single_divide(int a, int b, int w);
 extern int galois_inverse(int x, int w);
 
+/* Log and antilog tables of field w, for w <= GALOIS_LOG_MAX_W.  With
+   n = 2^w-1, log has n+1 entries and antilog 4n+1, so that for any x and y in
+   the field, including zero:
+
+     x*y = antilog[log[x]+log[y]]
+     x/y = antilog[log[x]+n-log[y]]    (y != 0)
+
+   The tables belong to the field, and stay valid until galois_uninit_field(w).
+   Returns 0, or -1 if w is too big or the tables can't be allocated. */
+
+#define GALOIS_LOG_MAX_W 16
+
+extern int galois_log_tables(int w, const uint32_t **log, const uint16_t **antilog);
+
 void galois_region_xor(           char *src,         /* Source Region */
                                   char *dest,        /* Dest Region (holds result) */
                                   int nbytes);      /* Number of bytes in region */
 
-/* These multiply regions in w=8, w=16 and w=32.  They are much faster
-   than calling galois_single_multiply.  The regions must be long word aligned. */
+/* dest = src[0] ^ ... ^ src[nsrc-1], or dest ^= src[0] ^ ... ^ src[nsrc-1] if
+   add is set, in a single pass over dest.  dest may not overlap any source. */
+
+void galois_region_xor_multi(     char **src,        /* Source Regions */
+                                  int nsrc,          /* Number of source regions */
+                                  char *dest,        /* Dest Region (holds result) */
+                                  int nbytes,        /* Number of bytes in region */
+                                  int add);          /* If set, XOR the sources into dest */
+
+/* These multiply regions in w=4, w=8, w=16 and w=32.  They are much faster
+   than calling galois_single_multiply.  The regions must be long word aligned.
+   With w=4, each byte holds two words, the low nibble first. */
+
+void galois_w04_region_multiply(char *region,       /* Region to multiply */
+                                  int multby,       /* Number to multiply by */
+                                  int nbytes,       /* Number of bytes in region */
+                                  char *r2,         /* If r2 != NULL, products go here.  
+                                                       Otherwise region is overwritten */
+                                  int add);         /* If (r2 != NULL && add) the produce is XOR'd with r2 */
 
 void galois_w08_region_multiply(char *region,       /* Region to multiply */
                                   int multby,       /* Number to multiply by */
@@ -82,6 +127,66 @@ void galois_w32_region_multiply(char *region,       /* Region to multiply */
                                                        Otherwise region is overwritten */
                                   int add);         /* If (r2 != NULL && add) the produce is XOR'd with r2 */
 
+/* A region table holds the multiplication tables for one multby, so that
+   they're built once rather than in every region multiply -- for a
+   coefficient of a coding matrix, say, that is used on every stripe.
+   galois_make_region_table returns NULL if w is not 4, 8, 16 or 32, or if the
+   field doesn't keep regions as plain words (ALTMAP).  galois_table_region_multiply
+   is then the same as galois_wXX_region_multiply(region, multby, nbytes, r2,
+   add), except that r2 may not be NULL.  Regions need no alignment, and
+   nbytes must be a multiple of w/8 (or anything, for w=4).  If the field is changed after the table
+   is made, the field's own region multiply is used.  Free tables before
+   galois_uninit_field(w). */
+
+typedef struct galois_region_table galois_region_table;
+
+galois_region_table *galois_make_region_table(int w, int multby);
+void galois_table_region_multiply(const galois_region_table *t, char *region, int nbytes,
+                                  char *r2, int add);
+void galois_free_region_table(galois_region_table *t);
+
+/* The region kernels -- galois_region_xor_multi, the table multiplies and the
+   ALTMAP conversions here, and the RAID-6 coding of reed_sol.h -- come in a
+   variant for each instruction set, and the best one that the CPU supports
+   is picked the first time one is used.  Setting the environment variable
+   JERASURE_ISA to generic, sse2, ssse3, avx2, avx512 or gfni caps the choice.
+   With GFNI, w=4 and w=8 regions, with or without tables, are multiplied
+   with GF2P8AFFINEQB.
+
+   galois_get_isa returns the instruction set in use.  galois_set_isa changes
+   it, and returns -1 if the CPU doesn't support isa.  It must not be called
+   while any regions are being coded.  galois_isa_name returns the name
+   that JERASURE_ISA uses for isa. */
+
+typedef enum {
+  GALOIS_ISA_GENERIC,
+  GALOIS_ISA_SSE2,
+  GALOIS_ISA_SSSE3,
+  GALOIS_ISA_AVX2,
+  GALOIS_ISA_AVX512,              /* AVX-512F and AVX-512BW */
+  GALOIS_ISA_GFNI                 /* Those and GFNI */
+} galois_isa;
+
+galois_isa galois_get_isa(void);
+int galois_set_isa(galois_isa isa);
+const char *galois_isa_name(galois_isa isa);
+
+/* ALTMAP regions hold each 16 words of w=16 or w=32 as w/8 runs of 16 bytes:
+   the highest bytes of the 16 words first, then the next, down to the lowest
+   -- the layout of GF-Complete's GF_REGION_ALTMAP.  Products of whole words
+   need no shuffling of bytes in this layout, so tables made by
+   galois_make_altmap_region_table run faster, but their regions must be
+   ALTMAP and nbytes a multiple of 2*w.  Their products are those of the field
+   when they were made, and they work whatever the field's region layout.
+   For w=8, ALTMAP is the plain layout.
+
+   galois_to_altmap and galois_from_altmap convert nbytes, a multiple of 2*w,
+   between the two layouts.  src may be dest. */
+
+galois_region_table *galois_make_altmap_region_table(int w, int multby);
+void galois_to_altmap(int w, char *src, char *dest, int nbytes);
+void galois_from_altmap(int w, char *src, char *dest, int nbytes);
+
 gf_t* galois_init_field(int w,
                              int mult_type,
                              int region_type,
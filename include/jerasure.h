@@ -44,6 +44,7 @@
 
 /* This uses procedures from the Galois Field arithmetic library */
 
+#include <stddef.h>
 #include "galois.h"
 
 #ifdef __cplusplus
@@ -88,11 +89,15 @@ extern "C" {
 
    operation = an array of 5 integers:
 
-          0 = operation: 0 for copy, 1 for xor (-1 for end)
-          1 = source device (0 - k+m-1)
-          2 = source packet (0 - w-1)
-          3 = destination device (0 - k+m-1)
-          4 = destination packet (0 - w-1)
+          0 = source device (0 - k+m-1) (-1 for end)
+          1 = source packet (0 - w-1)
+          2 = destination device (0 - k+m-1)
+          3 = destination packet (0 - w-1)
+          4 = operation: 0 for copy, 1 for xor
+
+   flat schedule = the same operations in one contiguous array of 16-byte
+              jerasure_flat_ops, with the packet numbers turned into byte
+              offsets for one packetsize.  See jerasure_flatten_schedule.
  */
 
 /* ---------------------------------------------------------------  */
@@ -113,6 +118,27 @@ extern "C" {
                               calculate new ones.  This is the optimization
                               explained in the original Liberation code paper.
 
+ - jerasure_cse_bitmatrix_to_schedule turns a bitmatrix into a schedule by
+                              common subexpression elimination: XORs of pairs
+                              of packets that several rows share are computed
+                              once, into temporary packets.  The temporaries
+                              are device k+m of the schedule, packets 0 to
+                              *ntemps-1.  jerasure_schedule_encode and the
+                              schedule decoders below provide that device;
+                              flat schedules and the lazy schedule cache do not
+                              support temporaries, and jerasure_flatten_schedule
+                              returns NULL for them.  Passing JERASURE_SCHEDULE_CSE
+                              as "smart" to jerasure_generate_decoding_schedule,
+                              jerasure_schedule_decode_lazy or
+                              jerasure_generate_schedule_cache schedules
+                              decoding this way.
+
+ - jerasure_schedule_ntemps returns the number of temporary packets that
+                              a schedule needs.  It is stored in the
+                              schedule when it is made: the first element
+                              of its last operation is -1-ntemps, rather
+                              than -1.
+
  - jerasure_generate_schedule_cache precalcalculate all the schedule for the
                               given distribution bitmatrix.  M must equal 2.
  
@@ -121,20 +147,157 @@ extern "C" {
  
  - jerasure_free_schedule_cache frees a schedule cache that was created with 
                               jerasure_generate_schedule_cache.
+
+ - jerasure_make_lazy_schedule_cache makes an empty schedule cache for any m.
+                              Decoding schedules are generated the first time
+                              that a set of erasures is decoded with
+                              jerasure_schedule_decode_lazy_cache, and kept
+                              until the schedules take more than max_bytes of
+                              memory.  Then the least recently used schedules
+                              are freed.  The cache has its own copy of the
+                              bitmatrix, and may be shared by threads.
+
+ - jerasure_get_lazy_schedule_cache_stats fills in five longs: the number of
+                              hits, misses and evictions, and the number of
+                              schedules and bytes that the cache holds.
+
+ - jerasure_set_lazy_schedule_cache_decoder gives the cache a routine that
+                              makes rows of the GF decoding matrix, with the
+                              arguments of jerasure_make_decoding_rows after
+                              matrix, for codes whose inverse has a closed
+                              form.  On a miss, the cache builds the rows for
+                              the erased data devices with it rather than
+                              inverting the bitmatrix, and falls back on the
+                              inversion if it returns -1.  Set it before the
+                              cache is used.
+
+ - jerasure_free_lazy_schedule_cache frees a lazy schedule cache.
+
+ - jerasure_flatten_schedule turns a schedule into a flat schedule for the
+                              given packetsize.  Each operation is 16 bytes,
+                              all in one array, with its byte offsets worked
+                              out ahead of time, so executing it doesn't
+                              chase a pointer or multiply per operation.
+                              It returns NULL if a device id doesn't fit in
+                              16 bits or an offset in 32 bits.
+
+ - jerasure_flat_schedule_encode is jerasure_schedule_encode with a flat
+                              schedule.  Size must be a multiple of
+                              w*packetsize.
+
+ - jerasure_free_flat_schedule frees a flat schedule.
  */
 
+typedef struct {
+  uint16_t op;                  /* JERASURE_FLAT_COPY or JERASURE_FLAT_XOR */
+  uint16_t src;                 /* Source device */
+  uint16_t dst;                 /* Destination device */
+  uint16_t pad;
+  uint32_t src_offset;          /* Byte offsets into the w*packetsize block */
+  uint32_t dst_offset;
+} jerasure_flat_op;
+
+#define JERASURE_FLAT_COPY 0
+#define JERASURE_FLAT_XOR  1
+
+typedef struct {
+  int nops;
+  int packetsize;
+  jerasure_flat_op *ops;
+} jerasure_flat_schedule;
+
 int *jerasure_matrix_to_bitmatrix(int k, int m, int w, int *matrix);
 int **jerasure_dumb_bitmatrix_to_schedule(int k, int m, int w, int *bitmatrix);
 int **jerasure_smart_bitmatrix_to_schedule(int k, int m, int w, int *bitmatrix);
+int **jerasure_cse_bitmatrix_to_schedule(int k, int m, int w, int *bitmatrix, int *ntemps);
 int ***jerasure_generate_schedule_cache(int k, int m, int w, int *bitmatrix, int smart);
+int jerasure_schedule_ntemps(int **schedule);
+
+/* The value of "smart" that schedules decoding with common subexpression
+   elimination */
+
+#define JERASURE_SCHEDULE_CSE 2
 
 void jerasure_free_schedule(int **schedule);
 void jerasure_free_schedule_cache(int k, int m, int ***cache);
 
+typedef struct jerasure_lazy_schedule_cache jerasure_lazy_schedule_cache;
+
+jerasure_lazy_schedule_cache *jerasure_make_lazy_schedule_cache(int k, int m, int w, int *bitmatrix,
+                                                                int smart, size_t max_bytes);
+void jerasure_get_lazy_schedule_cache_stats(jerasure_lazy_schedule_cache *cache, long *fill_in);
+void jerasure_free_lazy_schedule_cache(jerasure_lazy_schedule_cache *cache);
+
+typedef int (*jerasure_decoding_rows_func)(void *arg, int *erased, int nrows, int *row_ids,
+                                           int *decoding_rows, int *dm_ids);
+
+void jerasure_set_lazy_schedule_cache_decoder(jerasure_lazy_schedule_cache *cache,
+                                              jerasure_decoding_rows_func rows, void *arg);
+
+jerasure_flat_schedule *jerasure_flatten_schedule(int **schedule, int packetsize);
+void jerasure_free_flat_schedule(jerasure_flat_schedule *schedule);
+
+/* ------------------------------------------------------------ */
+/* Packed bitmatrices ----------------------------------------- */
+/*
+   A packed bitmatrix holds each row of a bitmatrix as 64-bit words: bit c
+   of row r is bit c%64 of bits[r*words + c/64].  Bits past cols are zero.
+   It is 32 times smaller than the int bitmatrix, and the routines that
+   take one work on whole words: rows are XOR'd 64 columns at a time, and
+   the ones in a row are found with count-trailing-zeros.
+
+ - jerasure_new_packed_bitmatrix returns a rows X cols packed bitmatrix of
+                              zeros.
+ - jerasure_pack_bitmatrix / jerasure_unpack_bitmatrix convert from and to
+                              an int bitmatrix.  The int bitmatrix is not
+                              freed, and the unpacked one is malloc'd.
+ - jerasure_matrix_to_packed_bitmatrix is jerasure_matrix_to_bitmatrix,
+                              producing a packed wm X wk bitmatrix.
+ - jerasure_free_packed_bitmatrix frees one.
+
+   The packed versions of the schedule makers, jerasure_bitmatrix_encode,
+   jerasure_bitmatrix_dotprod (which takes the first of w rows in pb),
+   jerasure_generate_decoding_schedule and the bitmatrix inversion
+   routines behave as their int bitmatrix versions.  The int versions of
+   the schedule makers pack the bitmatrix and call the packed ones.  The
+   packed decoding schedule returns NULL if the decoding matrix is not
+   invertible.
+ */
+
+typedef struct {
+  int rows;
+  int cols;
+  int words;                    /* Words per row: (cols+63)/64 */
+  uint64_t *bits;
+} jerasure_packed_bitmatrix;
+
+jerasure_packed_bitmatrix *jerasure_new_packed_bitmatrix(int rows, int cols);
+jerasure_packed_bitmatrix *jerasure_pack_bitmatrix(int *bitmatrix, int rows, int cols);
+int *jerasure_unpack_bitmatrix(jerasure_packed_bitmatrix *pb);
+jerasure_packed_bitmatrix *jerasure_matrix_to_packed_bitmatrix(int k, int m, int w, int *matrix);
+void jerasure_free_packed_bitmatrix(jerasure_packed_bitmatrix *pb);
+
+int **jerasure_dumb_packed_bitmatrix_to_schedule(int k, int m, int w, jerasure_packed_bitmatrix *pb);
+int **jerasure_smart_packed_bitmatrix_to_schedule(int k, int m, int w, jerasure_packed_bitmatrix *pb);
+int **jerasure_cse_packed_bitmatrix_to_schedule(int k, int m, int w, jerasure_packed_bitmatrix *pb,
+                                                int *ntemps);
+int **jerasure_generate_packed_decoding_schedule(int k, int m, int w, jerasure_packed_bitmatrix *pb,
+                                                 int *erasures, int smart);
+
+void jerasure_packed_bitmatrix_encode(int k, int m, int w, jerasure_packed_bitmatrix *pb,
+                                      char **data_ptrs, char **coding_ptrs, int size, int packetsize);
+void jerasure_packed_bitmatrix_dotprod(int k, int w, jerasure_packed_bitmatrix *pb, int row,
+                                       int *src_ids, int dest_id,
+                                       char **data_ptrs, char **coding_ptrs, int size, int packetsize);
+
+int jerasure_invert_packed_bitmatrix(jerasure_packed_bitmatrix *mat, jerasure_packed_bitmatrix *inv);
+int jerasure_invertible_packed_bitmatrix(jerasure_packed_bitmatrix *mat);
+
 
 /* ------------------------------------------------------------ */
 /* Encoding - these are all straightforward.  jerasure_matrix_encode only 
-   works with w = 8|16|32.  */
+   works with w = 4|8|16|32.  With w = 4, each byte holds two words, the
+   low nibble first, so k+m must be <= 16.  */
 
 void jerasure_do_parity(int k, char **data_ptrs, char *parity_ptr, int size);
 
@@ -147,6 +310,18 @@ void jerasure_bitmatrix_encode(int k, int m, int w, int *bitmatrix,
 void jerasure_schedule_encode(int k, int m, int w, int **schedule,
                                   char **data_ptrs, char **coding_ptrs, int size, int packetsize);
 
+/* jerasure_schedule_encode allocates an array of k+m+1 pointers, and the
+   temporaries of a CSE schedule, on each call.  jerasure_schedule_encode_scratch
+   uses ptrs, room for k+m+1 pointers, and temps, jerasure_schedule_ntemps(schedule)
+   * packetsize bytes (or NULL if that is 0), instead, and doesn't allocate. */
+
+void jerasure_schedule_encode_scratch(int k, int m, int w, int **schedule,
+                                  char **data_ptrs, char **coding_ptrs, int size, int packetsize,
+                                  char **ptrs, char *temps);
+
+void jerasure_flat_schedule_encode(int k, int m, int w, jerasure_flat_schedule *schedule,
+                                  char **data_ptrs, char **coding_ptrs, int size);
+
 /* ------------------------------------------------------------ */
 /* Decoding. -------------------------------------------------- */
 
@@ -162,7 +337,18 @@ void jerasure_schedule_encode(int k, int m, int w, int **schedule,
 
    jerasure_schedule_decode_lazy generates the schedule on the fly.
 
-   jerasure_matrix_decode only works when w = 8|16|32.
+   jerasure_schedule_decode_cache_scratch is jerasure_schedule_decode_cache
+   with the scratch space of jerasure_schedule_encode_scratch, so it doesn't
+   allocate.  Both return -1 if there are no erasures or more than two.
+
+   jerasure_schedule_decode_lazy_cache looks the schedule up in a lazy
+   schedule cache, and generates and adds it on a miss.  It returns -1
+   if there are more than m erasures.
+   jerasure_schedule_decode_lazy_cache_scratch is the same, but it uses
+   scratch, an array of k+m pointers, instead of allocating one, so when
+   the schedule is in the cache it doesn't allocate memory at all.
+
+   jerasure_matrix_decode only works when w = 4|8|16|32.
 
    jerasure_make_decoding_matrix/bitmatrix make the k*k decoding matrix
          (or wk*wk bitmatrix) by taking the rows corresponding to k
@@ -178,8 +364,22 @@ void jerasure_schedule_encode(int k, int m, int w, int **schedule,
          Both of these routines take "erased" instead of "erasures".
          Erased is a vector with k+m elements, which has 0 or 1 for 
          each device's id, according to whether the device is erased.
+
+   jerasure_make_decoding_rows makes only nrows rows of the decoding
+         matrix: row i of decoding_rows is row row_ids[i] of what
+         jerasure_make_decoding_matrix makes.  It inverts an e*e matrix,
+         where e is the number of erased data devices, so it costs
+         O(e^3 + nrows*e*k) instead of O(k^3).
  
    jerasure_erasures_to_erased allocates and returns erased from erasures.
+
+   jerasure_generate_decoding_schedule returns the schedule that the
+         schedule decoding routines use.  Its device numbers are not device
+         ids: they index an array of k+m pointers that is arranged so that
+         the decoded devices come last.  jerasure_scheduled_decoding_ids
+         fills in ids, a vector of k+m integers, so that ids[i] is the
+         device id for pointer i of that array.  Both return NULL/-1 if
+         there are too many erasures.
     
  */
 
@@ -198,14 +398,125 @@ int jerasure_schedule_decode_lazy(int k, int m, int w, int *bitmatrix, int *eras
 int jerasure_schedule_decode_cache(int k, int m, int w, int ***scache, int *erasures,
                             char **data_ptrs, char **coding_ptrs, int size, int packetsize);
 
+int jerasure_schedule_decode_cache_scratch(int k, int m, int w, int ***scache, int *erasures,
+                            char **data_ptrs, char **coding_ptrs, int size, int packetsize,
+                            char **ptrs, char *temps);
+
+int jerasure_schedule_decode_lazy_cache(jerasure_lazy_schedule_cache *cache, int *erasures,
+                            char **data_ptrs, char **coding_ptrs, int size, int packetsize);
+
+int jerasure_schedule_decode_lazy_cache_scratch(jerasure_lazy_schedule_cache *cache, int *erasures,
+                            char **data_ptrs, char **coding_ptrs, int size, int packetsize,
+                            char **scratch);
+
 int jerasure_make_decoding_matrix(int k, int m, int w, int *matrix, int *erased, 
                                   int *decoding_matrix, int *dm_ids);
 
+int jerasure_make_decoding_rows(int k, int m, int w, int *matrix, int *erased, int nrows,
+                                int *row_ids, int *decoding_rows, int *dm_ids);
+
 int jerasure_make_decoding_bitmatrix(int k, int m, int w, int *matrix, int *erased, 
                                   int *decoding_matrix, int *dm_ids);
 
 int *jerasure_erasures_to_erased(int k, int m, int *erasures);
 
+int **jerasure_generate_decoding_schedule(int k, int m, int w, int *bitmatrix, int *erasures,
+                                         int smart);
+int jerasure_scheduled_decoding_ids(int k, int m, int *erasures, int *ids);
+
+/* ------------------------------------------------------------ */
+/* Decoding plans --------------------------------------------- */
+/*
+   jerasure_matrix_decode does its work in two steps: it makes a decoding
+   plan from the matrix and the erasures (this is where the decoding matrix
+   is inverted), and then it executes the plan on the data.  When the same
+   erasures are decoded many times, you can make the plan once and execute
+   it for each stripe.  A plan owns copies of everything it needs, so the
+   matrix may be freed afterward, and executing it doesn't allocate memory.
+   A plan may be executed by several threads at once.
+
+   jerasure_make_decoding_plan returns NULL if w is not 4|8|16|32, if there
+         are too many erasures, or if it can't allocate memory.
+
+   jerasure_plan_decode decodes the erased devices in place, exactly as
+         jerasure_matrix_decode would.  It returns 0.
+
+   A plan cache holds up to capacity plans for one matrix, keyed by the set
+   of erased devices, and throws out the least recently used plan when it is
+   full.  jerasure_plan_decode_cache makes the plan on a miss, and returns -1
+   where jerasure_matrix_decode would.  The cache may be shared by threads.
+
+   jerasure_make_altmap_decoding_plan makes a plan for regions in the ALTMAP
+   layout of galois.h, whose sizes must be multiples of 2*w.  It multiplies
+   with ALTMAP region tables only, and returns NULL if it can't make them.
+   jerasure_set_plan_cache_altmap makes a cache's plans this way; call it
+   before the cache is first used.
+ */
+
+typedef struct jerasure_decoding_plan jerasure_decoding_plan;
+typedef struct jerasure_plan_cache jerasure_plan_cache;
+
+jerasure_decoding_plan *jerasure_make_decoding_plan(int k, int m, int w, int *matrix,
+                                                    int row_k_ones, int *erasures);
+int jerasure_plan_decode(jerasure_decoding_plan *plan,
+                         char **data_ptrs, char **coding_ptrs, int size);
+void jerasure_free_decoding_plan(jerasure_decoding_plan *plan);
+jerasure_decoding_plan *jerasure_make_altmap_decoding_plan(int k, int m, int w, int *matrix,
+                                                           int row_k_ones, int *erasures);
+
+jerasure_plan_cache *jerasure_generate_plan_cache(int k, int m, int w, int *matrix,
+                                                  int row_k_ones, int capacity);
+int jerasure_plan_decode_cache(jerasure_plan_cache *cache, int *erasures,
+                               char **data_ptrs, char **coding_ptrs, int size);
+void jerasure_free_plan_cache(jerasure_plan_cache *cache);
+void jerasure_set_plan_cache_altmap(jerasure_plan_cache *cache, int altmap);
+
+/* ------------------------------------------------------------ */
+/* Multithreaded coding --------------------------------------- */
+/*
+   The _mt routines take the same arguments and return the same values as
+   the routines above.  They split the regions across a persistent pool of
+   worker threads -- on longword (or 64-byte) boundaries for matrix coding,
+   and on packetsize*w boundaries for bitmatrix and schedule coding -- and
+   code each piece with the single-threaded routine.  The calling thread
+   codes one of the pieces.  Calls from different threads share the pool,
+   and are run one after the other.
+
+   jerasure_mt_set_threads sets the number of threads, including the calling
+   thread.  If nthreads <= 0, it uses the number of online processors,
+   which is also what the pool starts with if it is never set.  If pin is
+   non-zero, worker i is pinned to processor i (mod the number of
+   processors), where that is supported.  It returns 0 on success and -1 if
+   the threads couldn't be created, in which case the routines run in the
+   calling thread.
+
+   jerasure_mt_shutdown stops the worker threads.  The next _mt call starts
+   them again with the default number of threads.
+
+   jerasure_matrix_decode_mt makes one decoding plan and executes it on
+   each piece.
+ */
+
+int jerasure_mt_set_threads(int nthreads, int pin);
+int jerasure_mt_get_threads();
+void jerasure_mt_shutdown();
+
+void jerasure_matrix_encode_mt(int k, int m, int w, int *matrix,
+                          char **data_ptrs, char **coding_ptrs, int size);
+
+void jerasure_bitmatrix_encode_mt(int k, int m, int w, int *bitmatrix,
+                            char **data_ptrs, char **coding_ptrs, int size, int packetsize);
+
+void jerasure_schedule_encode_mt(int k, int m, int w, int **schedule,
+                                  char **data_ptrs, char **coding_ptrs, int size, int packetsize);
+
+int jerasure_matrix_decode_mt(int k, int m, int w, 
+                          int *matrix, int row_k_ones, int *erasures,
+                          char **data_ptrs, char **coding_ptrs, int size);
+
+int jerasure_schedule_decode_cache_mt(int k, int m, int w, int ***scache, int *erasures,
+                            char **data_ptrs, char **coding_ptrs, int size, int packetsize);
+
 /* ------------------------------------------------------------ */
 /* These perform dot products and schedules. -------------------*/
 /*
@@ -213,23 +524,74 @@ int *jerasure_erasures_to_erased(int k, int m, int *erasures);
    for coding devices) that identify the source devices.  Dest_id is
    the id of the destination device.
 
-   jerasure_matrix_dotprod only works when w = 8|16|32.
+   jerasure_matrix_dotprod only works when w = 4|8|16|32.
+
+   jerasure_matrix_multi_dotprod performs nrows dot products at once.  Each
+   source region is read a tile at a time and folded into every destination
+   while it is in cache, rather than being streamed from memory once per
+   destination.  Row r of the product uses matrix+row_ids[r]*k, and its result
+   is stored in device dest_ids[r].  If row_ids is NULL, row r is used.  If
+   dest_ids is NULL, the result of row i of the matrix goes to coding device
+   i (id k+i), which is what encoding wants.  The destinations may not be
+   sources.  Like jerasure_matrix_dotprod, it only works when w = 4|8|16|32.
+   jerasure_matrix_encode and jerasure_matrix_decode use it.
+
+   jerasure_matrix_multi_dotprod_tables is the same, but multiplies by
+   matrix[i] with the region table tables[i], made ahead of time, rather
+   than building the multiplication tables in every region multiply.  This
+   matters with small regions, and with tiles.  tables may be NULL, and so may
+   any of its entries.  jerasure_matrix_to_region_tables makes the tables for
+   a rows*cols matrix, with NULL for 0 and 1, and returns NULL if w isn't
+   4|8|16|32 or the field can't use them.  Decoding plans and plan caches make
+   tables for their rows, so they are built once for each plan;
+   jerasure_matrix_decode, which uses its plan once, doesn't.  jerasure_free_region_tables
+   frees the n tables and the array.  jerasure_matrix_to_altmap_region_tables
+   makes ALTMAP tables (see galois.h), with which the regions must be ALTMAP
+   and size a multiple of 2*w; every coefficient but 0 and 1 needs its table.
+
+   Both matrix dot products are tiled: all of the sources are applied to one
+   tile of the destination before moving on to the next, so the destination
+   stays in cache instead of being re-read from memory for every source.
+   jerasure_set_tile_size sets the tile size in bytes (rounded up to a
+   multiple of 64).  The default of 16K suits L1/L2 for up to four or so
+   destinations.  A tile size of 0 turns tiling off, so each source is
+   applied to the whole region in turn.
 
    jerasure_do_scheduled_operations executes the schedule on w*packetsize worth of
    bytes from each device.  ptrs is an array of pointers which should have as many
    elements as the highest referenced device in the schedule.
 
+   jerasure_do_flat_operations does the same with a flat schedule, whose
+   packetsize is built in.
+
  */
  
 void jerasure_matrix_dotprod(int k, int w, int *matrix_row,
                           int *src_ids, int dest_id,
                           char **data_ptrs, char **coding_ptrs, int size);
 
+void jerasure_matrix_multi_dotprod(int k, int w, int *matrix, int *row_ids, int nrows,
+                                int *src_ids, int *dest_ids,
+                                char **data_ptrs, char **coding_ptrs, int size);
+
+void jerasure_matrix_multi_dotprod_tables(int k, int w, int *matrix, galois_region_table **tables,
+                                          int *row_ids, int nrows, int *src_ids, int *dest_ids,
+                                          char **data_ptrs, char **coding_ptrs, int size);
+
+galois_region_table **jerasure_matrix_to_region_tables(int rows, int cols, int w, int *matrix);
+galois_region_table **jerasure_matrix_to_altmap_region_tables(int rows, int cols, int w,
+                                                              int *matrix);
+void jerasure_free_region_tables(galois_region_table **tables, int n);
+
+void jerasure_set_tile_size(int tile_size);
+int jerasure_get_tile_size();
+
 void jerasure_bitmatrix_dotprod(int k, int w, int *bitmatrix_row,
                              int *src_ids, int dest_id,
                              char **data_ptrs, char **coding_ptrs, int size, int packetsize);
 
 void jerasure_do_scheduled_operations(char **ptrs, int **schedule, int packetsize);
+void jerasure_do_flat_operations(char **ptrs, jerasure_flat_schedule *schedule);
 
 /* ------------------------------------------------------------ */
 /* Matrix Inversion ------------------------------------------- */
@@ -285,11 +647,13 @@ int *jerasure_matrix_multiply(int *m1, int *m2, int r1, int c1, int r2, int c2,
   jerasure_get_stats fills in a vector of three doubles:
 
       fill_in[0] is the number of bytes that have been XOR'd
-      fill_in[1] is the number of bytes that have been copied
-      fill_in[2] is the number of bytes that have been multiplied
+      fill_in[1] is the number of bytes that have been multiplied
                  by a constant in GF(2^w)
+      fill_in[2] is the number of bytes that have been copied
 
-  When jerasure_get_stats() is called, it resets its values.
+  When jerasure_get_stats() is called, it resets its values.  The counts
+  cover all threads.  If the library was configured with --disable-stats,
+  nothing is counted and the values are always zero.
  */
 
 void jerasure_get_stats(double *fill_in);
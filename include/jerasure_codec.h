@@ -0,0 +1,147 @@
+/* *
+ * Copyright (c) 2013, James S. Plank and Kevin Greenan
+ * All rights reserved.
+ *
+ * Jerasure - A C/C++ Library for a Variety of Reed-Solomon and RAID-6 Erasure
+ * Coding Techniques
+ *
+ * Revision 2.0: Galois Field backend now links to GF-Complete
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  - Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ *  - Neither the name of the University of Tennessee nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A codec holds everything needed to encode and decode with one technique and
+   one set of parameters: the coding matrix or bitmatrix, the encoding schedule
+   or the matrix's region multiplication tables, a cache of decoding plans or
+   schedules, and scratch space.  Making one does
+   all of the setup and allocation.  After that, encoding never allocates
+   memory, and decoding only allocates the first time it sees a set of
+   erasures, to make its plan or schedule.
+
+   - jerasure_codec_new returns NULL if the parameters don't work with the
+       technique, or if it can't allocate memory.  packetsize is only used by
+       the bitmatrix techniques (Cauchy, Liberation, Blaum-Roth, Liber8tion).
+       JERASURE_REED_SOL_VAN needs w = 4|8|16|32, and JERASURE_REED_SOL_R6
+       needs w = 8|16|32 and m = 2.
+
+   - jerasure_codec_encode and jerasure_codec_decode take the same arguments
+       as jerasure_matrix_encode and jerasure_matrix_decode.  For bitmatrix
+       techniques, size must be a multiple of packetsize*w.  Otherwise, it must
+       be a multiple of sizeof(long).  They return 0 on success and -1 on
+       failure.
+
+   - jerasure_codec_matrix and jerasure_codec_bitmatrix return the codec's
+       coding matrix and bitmatrix, or NULL if it doesn't use one.
+
+   - jerasure_codec_new_altmap makes a JERASURE_REED_SOL_VAN codec whose
+       chunks are kept and coded in the ALTMAP layout of galois.h, which
+       saves shuffling bytes in every region multiply when w = 16|32.
+       Convert chunks with galois_to_altmap when they come in, and with
+       galois_from_altmap when they go out; parity stays ALTMAP.  size must
+       be a multiple of 2*w.  It returns NULL for any other technique.
+
+   Since the scratch space is in the codec, a codec should only be used by one
+   thread at a time.  Use a codec per thread for concurrent coding.
+ */
+
+typedef enum {
+  JERASURE_REED_SOL_VAN,
+  JERASURE_REED_SOL_R6,
+  JERASURE_CAUCHY_ORIG,
+  JERASURE_CAUCHY_GOOD,
+  JERASURE_LIBERATION,
+  JERASURE_BLAUM_ROTH,
+  JERASURE_LIBER8TION
+} jerasure_technique;
+
+typedef struct jerasure_codec jerasure_codec;
+
+jerasure_codec *jerasure_codec_new(jerasure_technique technique, int k, int m, int w, int packetsize);
+jerasure_codec *jerasure_codec_new_altmap(jerasure_technique technique, int k, int m, int w,
+                                          int packetsize);
+void jerasure_codec_free(jerasure_codec *codec);
+
+int jerasure_codec_encode(jerasure_codec *codec, char **data_ptrs, char **coding_ptrs, int size);
+int jerasure_codec_decode(jerasure_codec *codec, int *erasures,
+                          char **data_ptrs, char **coding_ptrs, int size);
+
+int *jerasure_codec_matrix(jerasure_codec *codec);
+int *jerasure_codec_bitmatrix(jerasure_codec *codec);
+
+/* Generated kernels.  The program jerasure_codegen turns the schedules of a
+   bitmatrix code into straight-line C, with an encoding kernel and one
+   decoding kernel for each erasure pattern that it was asked for.  The
+   generated file defines jerasure_kernel_sets, a table of kernel sets that
+   ends with an entry whose encode is NULL.
+
+   When a codec is made, it looks for a kernel set with the same technique,
+   k, m, w and packetsize, and uses it to encode, and to decode the erasure
+   patterns that it has kernels for.  It looks in the tables given to
+   jerasure_codec_register_kernels, and then in the plugins named in the
+   JERASURE_PLUGINS environment variable: a colon-separated list of shared
+   libraries built from generated files.  The plugins are loaded the first
+   time a codec is made.
+
+   jerasure_codec_register_kernels returns 0, or -1 if it can't allocate
+   memory.  jerasure_codec_has_kernels returns whether a codec found a set.
+
+   A kernel takes the same data_ptrs, coding_ptrs and size as
+   jerasure_schedule_encode.  Kernels only work with k+m <= 64.
+ */
+
+typedef void (*jerasure_kernel)(char **data_ptrs, char **coding_ptrs, int size);
+
+typedef struct {
+  uint64_t erased;                  /* Bit i is set when device i is erased */
+  jerasure_kernel decode;
+} jerasure_decode_kernel;
+
+typedef struct {
+  jerasure_technique technique;
+  int k, m, w, packetsize;
+  jerasure_kernel encode;
+  int ndecoders;
+  const jerasure_decode_kernel *decoders;   /* Sorted by erased */
+} jerasure_kernel_set;
+
+int jerasure_codec_register_kernels(const jerasure_kernel_set *sets);
+int jerasure_codec_has_kernels(jerasure_codec *codec);
+
+#ifdef __cplusplus
+}
+#endif
@@ -237,6 +237,227 @@ int *cauchy_good_general_coding_matrix(int k, int m, int w)
   }
 }
 
+/* Multiply and divide with log tables if there are some, for w <= 16 */
+
+static int cmul(int a, int b, int w, const uint32_t *log, const uint16_t *antilog)
+{
+  if (log == NULL) return galois_single_multiply(a, b, w);
+  return antilog[log[a] + log[b]];
+}
+
+static int cdiv(int a, int b, int w, const uint32_t *log, const uint16_t *antilog)
+{
+  if (log == NULL) return galois_single_divide(a, b, w);
+  if (a == 0 || b == 0) return 0;
+  return antilog[log[a] + (1 << w) - 1 - log[b]];
+}
+
+/* Decoding Cauchy matrices in closed form.  The survivors' coding rows R,
+   restricted to the erased data devices E, are the Cauchy matrix
+   A[r][t] = 1/(X[r]+Y[t]), whose inverse is
+
+     A^-1[t][r] = P(t)*Q(r) / ((X[r]+Y[t]) * prod(X[r]+X[r']) * prod(Y[t]+Y[t']))
+
+   with P(t) = prod over R of (X[r]+Y[t]), Q(r) = prod over E of (X[r]+Y[t]),
+   and r' != r, t' != t.  Likewise, A^-1 times the column of a surviving data
+   device s is
+
+     z(t,s) = P(t)/P(s) * prod(Y[s]+Y[t']) / prod(Y[t]+Y[t'])
+
+   So the decoding rows come out of products, with no elimination at all.
+   The matrix may have its rows and columns scaled, as cauchy_improve_coding_matrix
+   does: if matrix[i][j] = rs[i]*cs[j]/(X[i]+Y[j]), then row t is scaled by
+   1/cs[t], coding column r by 1/rs[r], and data column s by cs[s].  Returns -1
+   if the matrix isn't like that, or if X and Y aren't distinct. */
+
+int cauchy_make_decoding_rows(int k, int m, int w, int *matrix, int *X, int *Y, int *erased,
+                              int nrows, int *row_ids, int *decoding_rows, int *dm_ids)
+{
+  int i, j, r, t, e, nr, x, s, ret;
+  int *epos, *rpos, *rdev, *dpos, *rs, *cs, *pt, *dt, *qr, *cr, *ps, *us, *cv, *pv;
+  int *space;
+  int a, b, n;
+  const uint32_t *log;
+  const uint16_t *antilog;
+
+  j = 0;
+  for (i = 0; j < k; i++) {
+    if (erased[i] == 0) {
+      dm_ids[j] = i;
+      j++;
+    }
+  }
+
+  if (galois_log_tables(w, &log, &antilog) < 0) log = NULL;
+
+  space = talloc(int, 9*k + 5*m);
+  if (space == NULL) return -1;
+  epos = space;           /* Erased data devices */
+  dpos = epos + k;        /* Data device -> index in dm_ids, or in epos if erased */
+  pt = dpos + k;
+  dt = pt + k;
+  ps = dt + k;
+  us = ps + k;
+  cs = us + k;
+  cv = cs + k;            /* Per survivor factor and point, as below */
+  pv = cv + k;
+  rpos = pv + k;          /* Surviving coding device -> index in dm_ids */
+  rdev = rpos + m;        /* ... and its row of the matrix */
+  qr = rdev + m;
+  cr = qr + m;
+  rs = cr + m;
+  ret = -1;
+
+  /* Scaling, from row 0 and column 0 */
+
+  for (j = 0; j < k; j++) {
+    cs[j] = 1;
+    if ((X[0] ^ Y[j]) == 0) goto done;
+  }
+  for (i = 0; i < m; i++) {
+    rs[i] = 1;
+    if ((X[i] ^ Y[0]) == 0) goto done;
+  }
+  if (matrix != NULL) {
+    for (j = 0; j < k; j++) cs[j] = cmul(matrix[j], X[0] ^ Y[j], w, log, antilog);
+    for (i = 0; i < m; i++) {
+      rs[i] = cdiv(cmul(matrix[i*k], X[i] ^ Y[0], w, log, antilog), cs[0], w, log, antilog);
+    }
+    for (i = 0; i < m; i++) {
+      for (j = 0; j < k; j++) {
+        if ((X[i] ^ Y[j]) == 0 || cs[j] == 0 || rs[i] == 0) goto done;
+        a = cmul(matrix[i*k+j], X[i] ^ Y[j], w, log, antilog);
+        if (a != cmul(rs[i], cs[j], w, log, antilog)) goto done;
+      }
+    }
+  }
+
+  e = 0;
+  nr = 0;
+  for (i = 0; i < k; i++) {
+    if (erased[i]) {
+      dpos[i] = e;
+      epos[e++] = i;
+    }
+  }
+  for (i = 0; i < k; i++) {
+    if (dm_ids[i] < k) {
+      dpos[dm_ids[i]] = i;
+    } else {
+      rpos[nr] = i;
+      rdev[nr++] = dm_ids[i]-k;
+    }
+  }
+
+  for (t = 0; t < e; t++) {
+    pt[t] = 1;
+    dt[t] = 1;
+    for (r = 0; r < nr; r++) pt[t] = cmul(pt[t], X[rdev[r]] ^ Y[epos[t]], w, log, antilog);
+    for (x = 0; x < e; x++) {
+      if (x != t) dt[t] = cmul(dt[t], Y[epos[t]] ^ Y[epos[x]], w, log, antilog);
+    }
+    if (dt[t] == 0) goto done;
+  }
+  for (r = 0; r < nr; r++) {
+    qr[r] = 1;
+    cr[r] = 1;
+    for (t = 0; t < e; t++) qr[r] = cmul(qr[r], X[rdev[r]] ^ Y[epos[t]], w, log, antilog);
+    for (x = 0; x < nr; x++) {
+      if (x != r) cr[r] = cmul(cr[r], X[rdev[r]] ^ X[rdev[x]], w, log, antilog);
+    }
+    if (cr[r] == 0 || qr[r] == 0) goto done;
+  }
+  for (s = 0; s < k; s++) {
+    if (erased[s]) continue;
+    ps[s] = 1;
+    us[s] = 1;
+    for (r = 0; r < nr; r++) ps[s] = cmul(ps[s], X[rdev[r]] ^ Y[s], w, log, antilog);
+    for (t = 0; t < e; t++) us[s] = cmul(us[s], Y[s] ^ Y[epos[t]], w, log, antilog);
+    if (ps[s] == 0 || us[s] == 0) goto done;
+  }
+
+  /* So column j of row t is f(t) * c(j) / (p(j) + Y[t]), where p(j) is X or Y of
+     survivor j and c(j) doesn't depend on t.  With log tables, that's two
+     lookups and an antilog per element. */
+
+  for (s = 0; s < k; s++) {
+    if (erased[s]) continue;
+    cv[dpos[s]] = cdiv(cmul(us[s], cs[s], w, log, antilog), ps[s], w, log, antilog);
+    pv[dpos[s]] = Y[s];
+  }
+  for (r = 0; r < nr; r++) {
+    cv[rpos[r]] = cdiv(qr[r], cmul(cr[r], rs[rdev[r]], w, log, antilog), w, log, antilog);
+    pv[rpos[r]] = X[rdev[r]];
+  }
+  if (log != NULL) {
+    for (j = 0; j < k; j++) cv[j] = log[cv[j]];
+  }
+
+  for (x = 0; x < nrows; x++) {
+    i = row_ids[x];
+    for (j = 0; j < k; j++) decoding_rows[x*k+j] = 0;
+    if (!erased[i]) {
+      decoding_rows[x*k+dpos[i]] = 1;
+      continue;
+    }
+    t = dpos[i];
+    a = cdiv(pt[t], cmul(dt[t], cs[i], w, log, antilog), w, log, antilog);
+    if (log != NULL) {
+      a = log[a];
+      n = (1 << w) - 1;
+      for (j = 0; j < k; j++) {
+        b = a + cv[j] - (int) log[pv[j] ^ Y[i]];
+        if (b < 0) b += n;
+        decoding_rows[x*k+j] = antilog[b];
+      }
+    } else {
+      for (j = 0; j < k; j++) {
+        b = cdiv(cv[j], pv[j] ^ Y[i], w, log, antilog);
+        decoding_rows[x*k+j] = cmul(a, b, w, log, antilog);
+      }
+    }
+  }
+  ret = 0;
+
+done:
+  free(space);
+  return ret;
+}
+
+int cauchy_make_decoding_matrix(int k, int m, int w, int *matrix, int *X, int *Y, int *erased,
+                                int *decoding_matrix, int *dm_ids)
+{
+  int i, *ids;
+
+  ids = talloc(int, k);
+  if (ids == NULL) return -1;
+  for (i = 0; i < k; i++) ids[i] = i;
+  i = cauchy_make_decoding_rows(k, m, w, matrix, X, Y, erased, k, ids, decoding_matrix, dm_ids);
+  free(ids);
+  return i;
+}
+
+/* The bitmatrix of the inverse is the inverse of the bitmatrix */
+
+int cauchy_make_decoding_bitmatrix(int k, int m, int w, int *matrix, int *X, int *Y, int *erased,
+                                   int *decoding_matrix, int *dm_ids)
+{
+  int *dm, *bitmatrix;
+
+  dm = talloc(int, k*k);
+  if (dm == NULL) return -1;
+  if (cauchy_make_decoding_matrix(k, m, w, matrix, X, Y, erased, dm, dm_ids) < 0) {
+    free(dm);
+    return -1;
+  }
+  bitmatrix = jerasure_matrix_to_bitmatrix(k, k, w, dm);
+  free(dm);
+  if (bitmatrix == NULL) return -1;
+  memcpy(decoding_matrix, bitmatrix, sizeof(int)*k*k*w*w);
+  free(bitmatrix);
+  return 0;
+}
+
 static int cbest_2[3] = { 1, 2, 3 };
 static int cbest_3[7] = { 1, 2, 5, 4, 7, 3, 6 };
 
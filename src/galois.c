@@ -44,25 +44,92 @@
    Revision 1.0 - 2007: James S. Plank
  */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include "galois.h"
+#include "galois_simd.h"
 
 #define MAX_GF_INSTANCES 64
 gf_t *gfp_array[MAX_GF_INSTANCES] = { 0 };
 int  gfp_is_composite[MAX_GF_INSTANCES] = { 0 };
 
-gf_t *galois_get_field_ptr(int w)
+/* gfp_array[w] is published with a release store once the field is completely
+   set up, and read with an acquire load, so the fast path of every routine
+   below is a single load.  Setting up, changing and freeing fields is done
+   with galois_lock held.
+
+   Since a thread may still be using a field after galois_change_technique
+   replaces it, the old field is not freed then.  It goes on the retired list,
+   and is freed by galois_uninit_field(w), which must only be called when no
+   thread is using field w.  A replaced gf_t that the caller made goes back
+   to the caller, who may free it at once, as before fields were retired, so
+   the list keeps a copy of it to gf_free.  The field in use is always
+   gf_free'd and freed. */
+
+typedef struct retired_field {
+  gf_t copy;                        /* What gf_free is called on */
+  gf_t *owned;                      /* Allocated by galois_init_default_field, or NULL */
+  int w;
+  int composite;
+  struct retired_field *next;
+} retired_field;
+
+/* Log tables are made from the field that is set up when they are first
+   asked for, and remember it.  If galois_change_technique replaces the field,
+   new tables are made the next time they're asked for, and the old ones are
+   chained behind them until galois_uninit_field(w), like retired fields. */
+
+typedef struct log_table {
+  gf_t *gf;
+  uint32_t *log;
+  uint16_t *antilog;
+  struct log_table *next;
+} log_table;
+
+static pthread_mutex_t galois_lock = PTHREAD_MUTEX_INITIALIZER;
+static int gfp_is_owned[MAX_GF_INSTANCES] = { 0 };
+static retired_field *retired_fields = NULL;
+static log_table *log_tables[GALOIS_LOG_MAX_W+1] = { 0 };
+
+/* Region tables only hold if the field lays out regions as plain words, which
+   isn't so for ALTMAP.  That is checked once per field, against a region
+   multiply by the field itself, and the field is remembered here. */
+
+static gf_t *standard_region_field[33] = { 0 };
+
+/* The GFNI matrices for every multby of w=4 and w=8, made from the field
+   once, and chained behind newer ones like log tables. */
+
+typedef struct affine_table {
+  gf_t *gf;
+  uint64_t matrix[256];
+  struct affine_table *next;
+} affine_table;
+
+static affine_table *affine_tables[9] = { 0 };
+
+static inline gf_t *galois_load_field(int w)
 {
-  if (gfp_array[w] != NULL) {
-    return gfp_array[w];
-  }
+  return __atomic_load_n(&gfp_array[w], __ATOMIC_ACQUIRE);
+}
 
-  return NULL;
+static inline void galois_publish_field(int w, gf_t *gf)
+{
+  __atomic_store_n(&gfp_array[w], gf, __ATOMIC_RELEASE);
+}
+
+gf_t *galois_get_field_ptr(int w)
+{
+  return galois_load_field(w);
 }
 
 gf_t* galois_init_field(int w,
@@ -172,29 +239,80 @@ gf_t* galois_init_composite_field(int w,
 
 int galois_init_default_field(int w)
 {
+  gf_t *gf;
+  int ret;
+
+  if (galois_load_field(w) != NULL) return 0;
+
+  ret = 0;
+  pthread_mutex_lock(&galois_lock);
   if (gfp_array[w] == NULL) {
-    gfp_array[w] = (gf_t*)malloc(sizeof(gf_t));
-    if(gfp_array[w] == NULL)
-      return ENOMEM;
-    if (!gf_init_easy(gfp_array[w], w))
-      return EINVAL;
+    gf = (gf_t*)malloc(sizeof(gf_t));
+    if (gf == NULL) {
+      ret = ENOMEM;
+    } else if (!gf_init_easy(gf, w)) {
+      free(gf);
+      ret = EINVAL;
+    } else {
+      gfp_is_owned[w] = 1;
+      galois_publish_field(w, gf);
+    }
   }
-  return 0;
+  pthread_mutex_unlock(&galois_lock);
+  return ret;
 }
 
 int galois_uninit_field(int w)
 {
   int ret = 0;
-  if (gfp_array[w] != NULL) {
+  gf_t *gf;
+  retired_field **rp, *r;
+  log_table *lt;
+  affine_table *at;
+
+  pthread_mutex_lock(&galois_lock);
+  gf = gfp_array[w];
+  if (gf != NULL) {
     int recursive = 1;
-    ret = gf_free(gfp_array[w], recursive);
-    free(gfp_array[w]);
-    gfp_array[w] = NULL;
+    galois_publish_field(w, NULL);
+    ret = gf_free(gf, recursive);
+    free(gf);
+    gfp_is_owned[w] = 0;
   }
+  __atomic_store_n(&standard_region_field[w], NULL, __ATOMIC_RELEASE);
+  if (w <= GALOIS_LOG_MAX_W) {
+    while (log_tables[w] != NULL) {
+      lt = log_tables[w];
+      __atomic_store_n(&log_tables[w], lt->next, __ATOMIC_RELEASE);
+      free(lt->log);
+      free(lt->antilog);
+      free(lt);
+    }
+  }
+  if (w == 4 || w == 8) {
+    while (affine_tables[w] != NULL) {
+      at = affine_tables[w];
+      __atomic_store_n(&affine_tables[w], at->next, __ATOMIC_RELEASE);
+      free(at);
+    }
+  }
+  rp = &retired_fields;
+  while (*rp != NULL) {
+    r = *rp;
+    if (r->w == w) {
+      *rp = r->next;
+      gf_free(&r->copy, r->composite);
+      free(r->owned);
+      free(r);
+    } else {
+      rp = &(r->next);
+    }
+  }
+  pthread_mutex_unlock(&galois_lock);
   return ret;
 }
 
-static void galois_init(int w)
+static gf_t *galois_init(int w)
 {
   if (w <= 0 || w > 32) {
     fprintf(stderr, "ERROR -- cannot init default Galois field for w=%d\n", w);
@@ -211,6 +329,18 @@ static void galois_init(int w)
     assert(0);
     break;
   }
+  return galois_load_field(w);
+}
+
+/* Returns the field for w, setting up the default one the first time. */
+
+static inline gf_t *galois_field(int w)
+{
+  gf_t *gf;
+
+  gf = galois_load_field(w);
+  if (gf == NULL) gf = galois_init(w);
+  return gf;
 }
 
 
@@ -245,6 +375,8 @@ static int is_valid_gf(gf_t *gf, int w)
 
 void galois_change_technique(gf_t *gf, int w)
 {
+  retired_field *retired;
+
   if (w <= 0 || w > 32) {
     fprintf(stderr, "ERROR -- cannot support Galois field for w=%d\n", w);
     assert(0);
@@ -255,23 +387,34 @@ void galois_change_technique(gf_t *gf, int w)
     assert(0);
   }
 
-  if (gfp_array[w] != NULL) {
-    gf_free(gfp_array[w], gfp_is_composite[w]);
+  pthread_mutex_lock(&galois_lock);
+  if (gfp_array[w] != NULL && gfp_array[w] != gf) {
+    retired = (retired_field *) malloc(sizeof(retired_field));
+    if (retired == NULL) {
+      fprintf(stderr, "ERROR -- cannot allocate memory to retire Galois field w=%d\n", w);
+      assert(0);
+    }
+    retired->copy = *gfp_array[w];
+    retired->owned = (gfp_is_owned[w]) ? gfp_array[w] : NULL;
+    retired->w = w;
+    retired->composite = gfp_is_composite[w];
+    retired->next = retired_fields;
+    retired_fields = retired;
   }
-
-  gfp_array[w] = gf;
+  gfp_is_owned[w] = 0;
+  galois_publish_field(w, gf);
+  pthread_mutex_unlock(&galois_lock);
 }
 
 int galois_single_multiply(int x, int y, int w)
 {
+  gf_t *gf;
+
   if (x == 0 || y == 0) return 0;
   
-  if (gfp_array[w] == NULL) {
-    galois_init(w);
-  }
-
   if (w <= 32) {
-    return gfp_array[w]->multiply.w32(gfp_array[w], x, y);
+    gf = galois_field(w);
+    return gf->multiply.w32(gf, x, y);
   } else {
     fprintf(stderr, "ERROR -- Galois field not implemented for w=%d\n", w);
     return 0;
@@ -280,31 +423,55 @@ int galois_single_multiply(int x, int y, int w)
 
 int galois_single_divide(int x, int y, int w)
 {
+  gf_t *gf;
+
   if (x == 0) return 0;
   if (y == 0) return -1;
 
-  if (gfp_array[w] == NULL) {
-    galois_init(w);
-  }
-
   if (w <= 32) {
-    return gfp_array[w]->divide.w32(gfp_array[w], x, y);
+    gf = galois_field(w);
+    return gf->divide.w32(gf, x, y);
   } else {
     fprintf(stderr, "ERROR -- Galois field not implemented for w=%d\n", w);
     return 0;
   }
 }
 
+static int affine_region_multiply(int w, char *region, int multby, int nbytes, char *r2,
+                                  int add);
+
+void galois_w04_region_multiply(char *region,      /* Region to multiply */
+                                  int multby,       /* Number to multiply by */
+                                  int nbytes,        /* Number of bytes in region */
+                                  char *r2,          /* If r2 != NULL, products go here */
+                                  int add)
+{
+  gf_t *gf;
+
+  if (r2 == NULL) {
+    r2 = region;
+    add = 0;
+  }
+  if (affine_region_multiply(4, region, multby, nbytes, r2, add)) return;
+  gf = galois_field(4);
+  gf->multiply_region.w32(gf, region, r2, multby, nbytes, add);
+}
+
 void galois_w08_region_multiply(char *region,      /* Region to multiply */
                                   int multby,       /* Number to multiply by */
                                   int nbytes,        /* Number of bytes in region */
                                   char *r2,          /* If r2 != NULL, products go here */
                                   int add)
 {
-  if (gfp_array[8] == NULL) {
-    galois_init(8);
+  gf_t *gf;
+
+  if (r2 == NULL) {
+    r2 = region;
+    add = 0;
   }
-  gfp_array[8]->multiply_region.w32(gfp_array[8], region, r2, multby, nbytes, add);
+  if (affine_region_multiply(8, region, multby, nbytes, r2, add)) return;
+  gf = galois_field(8);
+  gf->multiply_region.w32(gf, region, r2, multby, nbytes, add);
 }
 
 void galois_w16_region_multiply(char *region,      /* Region to multiply */
@@ -313,10 +480,13 @@ void galois_w16_region_multiply(char *region,      /* Region to multiply */
                                   char *r2,          /* If r2 != NULL, products go here */
                                   int add)
 {
-  if (gfp_array[16] == NULL) {
-    galois_init(16);
+  gf_t *gf = galois_field(16);
+
+  if (r2 == NULL) {
+    r2 = region;
+    add = 0;
   }
-  gfp_array[16]->multiply_region.w32(gfp_array[16], region, r2, multby, nbytes, add);
+  gf->multiply_region.w32(gf, region, r2, multby, nbytes, add);
 }
 
 
@@ -326,34 +496,34 @@ void galois_w32_region_multiply(char *region,      /* Region to multiply */
                                   char *r2,          /* If r2 != NULL, products go here */
                                   int add)
 {
-  if (gfp_array[32] == NULL) {
-    galois_init(32);
+  gf_t *gf = galois_field(32);
+
+  if (r2 == NULL) {
+    r2 = region;
+    add = 0;
   }
-  gfp_array[32]->multiply_region.w32(gfp_array[32], region, r2, multby, nbytes, add);
+  gf->multiply_region.w32(gf, region, r2, multby, nbytes, add);
 }
 
 void galois_w8_region_xor(void *src, void *dest, int nbytes)
 {
-  if (gfp_array[8] == NULL) {
-    galois_init(8);
-  }
-  gfp_array[8]->multiply_region.w32(gfp_array[32], src, dest, 1, nbytes, 1);
+  gf_t *gf = galois_field(8);
+
+  gf->multiply_region.w32(gf, src, dest, 1, nbytes, 1);
 }
 
 void galois_w16_region_xor(void *src, void *dest, int nbytes)
 {
-  if (gfp_array[16] == NULL) {
-    galois_init(16);
-  }
-  gfp_array[16]->multiply_region.w32(gfp_array[16], src, dest, 1, nbytes, 1);
+  gf_t *gf = galois_field(16);
+
+  gf->multiply_region.w32(gf, src, dest, 1, nbytes, 1);
 }
 
 void galois_w32_region_xor(void *src, void *dest, int nbytes)
 {
-  if (gfp_array[32] == NULL) {
-    galois_init(32);
-  }
-  gfp_array[32]->multiply_region.w32(gfp_array[32], src, dest, 1, nbytes, 1);
+  gf_t *gf = galois_field(32);
+
+  gf->multiply_region.w32(gf, src, dest, 1, nbytes, 1);
 }
 
 void galois_region_xor(char *src, char *dest, int nbytes)
@@ -370,6 +540,1194 @@ void galois_region_xor(char *src, char *dest, int nbytes)
   }
 }
 
+/* Instruction sets.  The region kernels come in a variant for each, built
+   with the target attribute rather than with the flags the library is
+   compiled with, and the best that the CPU supports is picked the first
+   time one is needed.  JERASURE_ISA caps the choice, for benchmarking. */
+
+typedef struct {
+  int (*xor_multi)(char **src, int nsrc, char *dest, int i, int nbytes, int add);
+  int (*table_multiply[3])(const galois_region_table *t, char *src, int nbytes,
+                           char *dest, int add);          /* w = 4|8, 16, 32 */
+  int (*altmap_convert)(int w, char *src, char *dest, int nbytes, int to);
+  int (*affine_multiply)(uint64_t affine, char *src, int nbytes, char *dest,
+                         int add);                        /* w = 4|8, all of it */
+} region_kernels;
+
+static const char *isa_names[] = { "generic", "sse2", "ssse3", "avx2", "avx512", "gfni" };
+
+static galois_isa isa_supported = GALOIS_ISA_GENERIC;
+static galois_isa isa_level = GALOIS_ISA_GENERIC;
+static region_kernels kernels;
+static pthread_once_t isa_once = PTHREAD_ONCE_INIT;
+
+static void set_kernels(galois_isa isa);
+
+static void init_isa(void)
+{
+  char *s;
+  int i;
+
+#ifdef GALOIS_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse2")) {
+    isa_supported = GALOIS_ISA_SSE2;
+    if (__builtin_cpu_supports("ssse3")) {
+      isa_supported = GALOIS_ISA_SSSE3;
+      if (__builtin_cpu_supports("avx2")) {
+        isa_supported = GALOIS_ISA_AVX2;
+        if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) {
+          isa_supported = GALOIS_ISA_AVX512;
+          if (__builtin_cpu_supports("gfni")) isa_supported = GALOIS_ISA_GFNI;
+        }
+      }
+    }
+  }
+#endif
+  isa_level = isa_supported;
+  s = getenv("JERASURE_ISA");
+  if (s != NULL) {
+    for (i = 0; i <= GALOIS_ISA_GFNI; i++) {
+      if (strcmp(s, isa_names[i]) == 0 && i < (int) isa_level) isa_level = (galois_isa) i;
+    }
+  }
+  set_kernels(isa_level);
+}
+
+static inline const region_kernels *get_kernels(void)
+{
+  pthread_once(&isa_once, init_isa);
+  return &kernels;
+}
+
+galois_isa galois_get_isa(void)
+{
+  pthread_once(&isa_once, init_isa);
+  return isa_level;
+}
+
+int galois_set_isa(galois_isa isa)
+{
+  pthread_once(&isa_once, init_isa);
+  if (isa < GALOIS_ISA_GENERIC || isa > isa_supported) return -1;
+  isa_level = isa;
+  set_kernels(isa);
+  return 0;
+}
+
+const char *galois_isa_name(galois_isa isa)
+{
+  if (isa < GALOIS_ISA_GENERIC || isa > GALOIS_ISA_GFNI) return NULL;
+  return isa_names[isa];
+}
+
+#ifdef GALOIS_X86
+/* Each does what it can from byte i on, 2*16 to 2*64 bytes at a time, and
+   returns where it stopped */
+
+static TARGET("sse2") int sse2_region_xor_multi(char **src, int nsrc, char *dest, int i,
+                                                int nbytes, int add)
+{
+  __m128i a0, a1;
+  char *s;
+  int j, first;
+
+  first = (add) ? 0 : 1;
+  for ( ; i + 32 <= nbytes; i += 32) {
+    s = (add) ? dest : src[0];
+    a0 = _mm_loadu_si128((__m128i *) (s+i));
+    a1 = _mm_loadu_si128((__m128i *) (s+i+16));
+    for (j = first; j < nsrc; j++) {
+      a0 = _mm_xor_si128(a0, _mm_loadu_si128((__m128i *) (src[j]+i)));
+      a1 = _mm_xor_si128(a1, _mm_loadu_si128((__m128i *) (src[j]+i+16)));
+    }
+    _mm_storeu_si128((__m128i *) (dest+i), a0);
+    _mm_storeu_si128((__m128i *) (dest+i+16), a1);
+  }
+  return i;
+}
+
+static TARGET("avx2") int avx2_region_xor_multi(char **src, int nsrc, char *dest, int i,
+                                                int nbytes, int add)
+{
+  __m256i a0, a1;
+  char *s;
+  int j, first;
+
+  first = (add) ? 0 : 1;
+  for ( ; i + 64 <= nbytes; i += 64) {
+    s = (add) ? dest : src[0];
+    a0 = _mm256_loadu_si256((__m256i *) (s+i));
+    a1 = _mm256_loadu_si256((__m256i *) (s+i+32));
+    for (j = first; j < nsrc; j++) {
+      a0 = _mm256_xor_si256(a0, _mm256_loadu_si256((__m256i *) (src[j]+i)));
+      a1 = _mm256_xor_si256(a1, _mm256_loadu_si256((__m256i *) (src[j]+i+32)));
+    }
+    _mm256_storeu_si256((__m256i *) (dest+i), a0);
+    _mm256_storeu_si256((__m256i *) (dest+i+32), a1);
+  }
+  return sse2_region_xor_multi(src, nsrc, dest, i, nbytes, add);
+}
+
+static TARGET("avx512f") int avx512_region_xor_multi(char **src, int nsrc, char *dest, int i,
+                                                     int nbytes, int add)
+{
+  __m512i a0, a1;
+  char *s;
+  int j, first;
+
+  first = (add) ? 0 : 1;
+  for ( ; i + 128 <= nbytes; i += 128) {
+    s = (add) ? dest : src[0];
+    a0 = _mm512_loadu_si512((void *) (s+i));
+    a1 = _mm512_loadu_si512((void *) (s+i+64));
+    for (j = first; j < nsrc; j++) {
+      a0 = _mm512_xor_si512(a0, _mm512_loadu_si512((void *) (src[j]+i)));
+      a1 = _mm512_xor_si512(a1, _mm512_loadu_si512((void *) (src[j]+i+64)));
+    }
+    _mm512_storeu_si512((void *) (dest+i), a0);
+    _mm512_storeu_si512((void *) (dest+i+64), a1);
+  }
+  return avx2_region_xor_multi(src, nsrc, dest, i, nbytes, add);
+}
+#endif
+
+/* Every source is read once and dest is written once, rather than dest being
+   read and written once per source as with repeated galois_region_xor calls.
+   Regions need no particular alignment. */
+
+void galois_region_xor_multi(char **src, int nsrc, char *dest, int nbytes, int add)
+{
+  const region_kernels *k;
+  int i, j, first;
+
+  if (nsrc <= 0) {
+    if (!add) memset(dest, 0, nbytes);
+    return;
+  }
+  first = (add) ? 0 : 1;
+  i = 0;
+
+  k = get_kernels();
+  if (k->xor_multi != NULL) i = k->xor_multi(src, nsrc, dest, 0, nbytes, add);
+  for ( ; i + (int) sizeof(long) <= nbytes; i += sizeof(long)) {
+    long a, b;
+
+    memcpy(&a, (add) ? dest+i : src[0]+i, sizeof(long));
+    for (j = first; j < nsrc; j++) {
+      memcpy(&b, src[j]+i, sizeof(long));
+      a ^= b;
+    }
+    memcpy(dest+i, &a, sizeof(long));
+  }
+  for ( ; i < nbytes; i++) {
+    char c = (add) ? dest[i] : src[0][i];
+
+    for (j = first; j < nsrc; j++) c ^= src[j][i];
+    dest[i] = c;
+  }
+}
+
+/* Region tables.  The product of a word and multby is the XOR of the products
+   of its bytes, each of which is a lookup in bytes[] -- the split tables that
+   GF-Complete builds in every region call.  The SSSE3 code splits the words
+   into nibbles instead, and looks up each byte of their products 16 at a
+   time with pshufb: nibbles[n*(w/8)+b][v] is byte b of the product of v in
+   nibble n.  Only as much of bytes[] as w needs is filled in.  For w=4, a
+   byte holds two words, low one first, so bytes[0] multiplies both at once,
+   and nibbles[1] is nibbles[0] shifted up -- the w=8 code works unchanged.
+   For w=4 and w=8, affine is the product as a matrix over GF(2), for GFNI.
+   ALTMAP tables work on regions kept in the layout of GF-Complete's ALTMAP,
+   whatever the field's own region layout. */
+
+struct galois_region_table {
+  int w;
+  int multby;
+  int altmap;
+  gf_t *gf;                         /* The field that the tables were made from */
+  uint64_t affine;
+  uint8_t nibbles[32][16];
+  union {
+    uint8_t w8[1][256];
+    uint16_t w16[2][256];
+    uint32_t w32[4][256];
+  } bytes;
+};
+
+static uint32_t region_table_bytes(galois_region_table *t, int b, int i)
+{
+  switch (t->w) {
+    case 4:
+    case 8:  return t->bytes.w8[b][i];
+    case 16: return t->bytes.w16[b][i];
+    default: return t->bytes.w32[b][i];
+  }
+}
+
+/* Multiplying a byte by multby is multiplying its bits by a matrix over GF(2):
+   bit j of byte 7-i of the matrix is bit i of the product of bit j, as
+   GF2P8AFFINEQB has it.  For w=4, it multiplies both nibbles. */
+
+static uint64_t affine_matrix(gf_t *gf, int w, int multby)
+{
+  uint64_t m;
+  uint32_t p;
+  int i, j;
+
+  m = 0;
+  for (j = 0; j < 8; j++) {
+    if (w == 4) {
+      p = gf->multiply.w32(gf, multby, 1 << (j%4)) << (4*(j/4));
+    } else {
+      p = gf->multiply.w32(gf, multby, 1 << j);
+    }
+    for (i = 0; i < 8; i++) {
+      if (p & (1 << i)) m |= (uint64_t) 1 << (8*(7-i) + j);
+    }
+  }
+  return m;
+}
+
+static galois_region_table *make_region_table(gf_t *gf, int w, int multby, int altmap)
+{
+  galois_region_table *t;
+  int nb, b, i, n, v;
+  uint32_t p;
+
+  nb = (w == 4) ? 1 : w/8;
+  t = (galois_region_table *) malloc(sizeof(galois_region_table));
+  if (t == NULL) return NULL;
+  t->w = w;
+  t->multby = multby;
+  t->altmap = altmap;
+  t->gf = gf;
+  t->affine = (w <= 8) ? affine_matrix(gf, w, multby) : 0;
+
+  if (w == 4) {
+    for (v = 0; v < 16; v++) {
+      p = gf->multiply.w32(gf, multby, v);
+      t->nibbles[0][v] = p;
+      t->nibbles[1][v] = p << 4;
+    }
+    for (i = 0; i < 256; i++) t->bytes.w8[0][i] = t->nibbles[0][i & 0xf] | t->nibbles[1][i >> 4];
+    return t;
+  }
+
+  /* Each byte table is linear, so only the powers of two need multiplying */
+
+  for (b = 0; b < nb; b++) {
+    for (i = 0; i < 256; i++) {
+      if (i == 0) {
+        p = 0;
+      } else if ((i & (i-1)) == 0) {
+        p = gf->multiply.w32(gf, multby, (uint32_t) i << (8*b));
+      } else {
+        p = region_table_bytes(t, b, i & (i-1)) ^ region_table_bytes(t, b, i & -i);
+      }
+      switch (w) {
+        case 8:  t->bytes.w8[b][i] = p; break;
+        case 16: t->bytes.w16[b][i] = p; break;
+        default: t->bytes.w32[b][i] = p; break;
+      }
+    }
+  }
+  for (n = 0; n < 2*nb; n++) {
+    for (v = 0; v < 16; v++) {
+      p = region_table_bytes(t, n/2, v << (4*(n%2)));
+      for (b = 0; b < nb; b++) t->nibbles[n*nb+b][v] = (p >> (8*b)) & 0xff;
+    }
+  }
+  return t;
+}
+
+static int is_standard_region_field(gf_t *gf, int w)
+{
+  galois_region_table *t;
+  uint8_t *region;
+  int i, ok;
+
+  if (__atomic_load_n(&standard_region_field[w], __ATOMIC_ACQUIRE) == gf) return 1;
+
+  t = make_region_table(gf, w, 3, 0);
+  region = (uint8_t *) malloc(192);
+  ok = (t != NULL && region != NULL);
+  if (ok) {
+    for (i = 0; i < 64; i++) region[i] = i*37+11;
+    gf->multiply_region.w32(gf, region, region+64, t->multby, 64, 0);
+    galois_table_region_multiply(t, (char *) region, 64, (char *) region+128, 0);
+    ok = (memcmp(region+64, region+128, 64) == 0);
+  }
+  free(t);
+  free(region);
+  if (ok) __atomic_store_n(&standard_region_field[w], gf, __ATOMIC_RELEASE);
+  return ok;
+}
+
+galois_region_table *galois_make_region_table(int w, int multby)
+{
+  gf_t *gf;
+
+  if (w != 4 && w != 8 && w != 16 && w != 32) return NULL;
+  gf = galois_field(w);
+  if (!is_standard_region_field(gf, w)) return NULL;
+  return make_region_table(gf, w, multby, 0);
+}
+
+static affine_table *galois_make_affine_table(gf_t *gf, int w)
+{
+  affine_table *at;
+  int i;
+
+  at = (affine_table *) malloc(sizeof(affine_table));
+  if (at == NULL) return NULL;
+  at->gf = gf;
+  for (i = 0; i < (1 << w); i++) at->matrix[i] = affine_matrix(gf, w, i);
+  return at;
+}
+
+/* galois_w04_region_multiply and galois_w08_region_multiply need no tables
+   with GFNI, only the matrix for multby.  r2 may not be NULL.  Returns 0 if
+   the region is left to the field. */
+
+static int affine_region_multiply(int w, char *region, int multby, int nbytes, char *r2,
+                                  int add)
+{
+  const region_kernels *k;
+  affine_table *at;
+  gf_t *gf;
+
+  k = get_kernels();
+  if (k->affine_multiply == NULL) return 0;
+  gf = galois_field(w);
+  at = __atomic_load_n(&affine_tables[w], __ATOMIC_ACQUIRE);
+  if (at == NULL || at->gf != gf) {
+    if (!is_standard_region_field(gf, w)) return 0;
+    pthread_mutex_lock(&galois_lock);
+    at = affine_tables[w];
+    if (gfp_array[w] == gf && (at == NULL || at->gf != gf)) {
+      at = galois_make_affine_table(gf, w);
+      if (at != NULL) {
+        at->next = affine_tables[w];
+        __atomic_store_n(&affine_tables[w], at, __ATOMIC_RELEASE);
+      }
+    }
+    pthread_mutex_unlock(&galois_lock);
+    if (at == NULL || at->gf != gf) return 0;
+  }
+  k->affine_multiply(at->matrix[multby & ((1 << w) - 1)], region, nbytes, r2, add);
+  return 1;
+}
+
+galois_region_table *galois_make_altmap_region_table(int w, int multby)
+{
+  if (w != 8 && w != 16 && w != 32) return NULL;
+  return make_region_table(galois_field(w), w, multby, 1);
+}
+
+void galois_free_region_table(galois_region_table *t)
+{
+  free(t);
+}
+
+#ifdef GALOIS_X86
+/* The SSSE3 code works on 16 words at a time.  For w=16 and w=32, their bytes
+   are first gathered into one register per byte position, so that each
+   nibble's products are one pshufb per byte, and scattered back after.  The
+   gathered registers are exactly what ALTMAP keeps in memory, highest byte
+   first, so ALTMAP regions skip both steps. */
+
+#define NIBBLE_TABLE(t, i) _mm_loadu_si128((const __m128i *) (t)->nibbles[i])
+#define LOW_NIBBLES(x) _mm_and_si128((x), m0f)
+#define HIGH_NIBBLES(x) _mm_and_si128(_mm_srli_epi64((x), 4), m0f)
+
+static inline TARGET("ssse3") void w16_gather(const char *src, __m128i *lo, __m128i *hi)
+{
+  const __m128i split = _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15);
+  __m128i a0, a1;
+
+  a0 = _mm_shuffle_epi8(_mm_loadu_si128((__m128i *) src), split);
+  a1 = _mm_shuffle_epi8(_mm_loadu_si128((__m128i *) (src+16)), split);
+  *lo = _mm_unpacklo_epi64(a0, a1);
+  *hi = _mm_unpackhi_epi64(a0, a1);
+}
+
+static inline TARGET("ssse3") void w16_scatter(__m128i lo, __m128i hi, __m128i *p0, __m128i *p1)
+{
+  *p0 = _mm_unpacklo_epi8(lo, hi);
+  *p1 = _mm_unpackhi_epi8(lo, hi);
+}
+
+/* b[j] gets byte j of each of the words */
+
+static inline TARGET("ssse3") void w32_gather(const char *src, __m128i *b)
+{
+  const __m128i split = _mm_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+  __m128i a0, a1, a2, a3, p0, p1, p2, p3;
+
+  a0 = _mm_shuffle_epi8(_mm_loadu_si128((__m128i *) src), split);
+  a1 = _mm_shuffle_epi8(_mm_loadu_si128((__m128i *) (src+16)), split);
+  a2 = _mm_shuffle_epi8(_mm_loadu_si128((__m128i *) (src+32)), split);
+  a3 = _mm_shuffle_epi8(_mm_loadu_si128((__m128i *) (src+48)), split);
+  p0 = _mm_unpacklo_epi32(a0, a1);
+  p1 = _mm_unpacklo_epi32(a2, a3);
+  p2 = _mm_unpackhi_epi32(a0, a1);
+  p3 = _mm_unpackhi_epi32(a2, a3);
+  b[0] = _mm_unpacklo_epi64(p0, p1);
+  b[1] = _mm_unpackhi_epi64(p0, p1);
+  b[2] = _mm_unpacklo_epi64(p2, p3);
+  b[3] = _mm_unpackhi_epi64(p2, p3);
+}
+
+static inline TARGET("ssse3") void w32_scatter(const __m128i *b, __m128i *p)
+{
+  __m128i a0, a1, a2, a3;
+
+  a0 = _mm_unpacklo_epi8(b[0], b[1]);
+  a1 = _mm_unpackhi_epi8(b[0], b[1]);
+  a2 = _mm_unpacklo_epi8(b[2], b[3]);
+  a3 = _mm_unpackhi_epi8(b[2], b[3]);
+  p[0] = _mm_unpacklo_epi16(a0, a2);
+  p[1] = _mm_unpackhi_epi16(a0, a2);
+  p[2] = _mm_unpacklo_epi16(a1, a3);
+  p[3] = _mm_unpackhi_epi16(a1, a3);
+}
+
+/* Each returns the number of bytes done */
+
+static TARGET("ssse3") int ssse3_w08_table_multiply(const galois_region_table *t, char *src,
+                                                   int nbytes, char *dest, int add)
+{
+  const __m128i m0f = _mm_set1_epi8(0x0f);
+  __m128i t0, t1, a, p;
+  int i;
+
+  t0 = NIBBLE_TABLE(t, 0);
+  t1 = NIBBLE_TABLE(t, 1);
+  for (i = 0; i + 16 <= nbytes; i += 16) {
+    a = _mm_loadu_si128((__m128i *) (src+i));
+    p = _mm_xor_si128(_mm_shuffle_epi8(t0, LOW_NIBBLES(a)), _mm_shuffle_epi8(t1, HIGH_NIBBLES(a)));
+    if (add) p = _mm_xor_si128(p, _mm_loadu_si128((__m128i *) (dest+i)));
+    _mm_storeu_si128((__m128i *) (dest+i), p);
+  }
+  return i;
+}
+
+static TARGET("ssse3") int ssse3_w16_table_multiply(const galois_region_table *t, char *src,
+                                                   int nbytes, char *dest, int add)
+{
+  const __m128i m0f = _mm_set1_epi8(0x0f);
+  __m128i tb[8], lo, hi, x0, x1, x2, x3, rl, rh, p0, p1;
+  int i, j;
+
+  for (j = 0; j < 8; j++) tb[j] = NIBBLE_TABLE(t, j);
+  for (i = 0; i + 32 <= nbytes; i += 32) {
+    if (t->altmap) {
+      hi = _mm_loadu_si128((__m128i *) (src+i));
+      lo = _mm_loadu_si128((__m128i *) (src+i+16));
+    } else {
+      w16_gather(src+i, &lo, &hi);
+    }
+    x0 = LOW_NIBBLES(lo);
+    x1 = HIGH_NIBBLES(lo);
+    x2 = LOW_NIBBLES(hi);
+    x3 = HIGH_NIBBLES(hi);
+    rl = _mm_xor_si128(_mm_xor_si128(_mm_shuffle_epi8(tb[0], x0), _mm_shuffle_epi8(tb[2], x1)),
+                       _mm_xor_si128(_mm_shuffle_epi8(tb[4], x2), _mm_shuffle_epi8(tb[6], x3)));
+    rh = _mm_xor_si128(_mm_xor_si128(_mm_shuffle_epi8(tb[1], x0), _mm_shuffle_epi8(tb[3], x1)),
+                       _mm_xor_si128(_mm_shuffle_epi8(tb[5], x2), _mm_shuffle_epi8(tb[7], x3)));
+    if (t->altmap) {
+      p0 = rh;
+      p1 = rl;
+    } else {
+      w16_scatter(rl, rh, &p0, &p1);
+    }
+    if (add) {
+      p0 = _mm_xor_si128(p0, _mm_loadu_si128((__m128i *) (dest+i)));
+      p1 = _mm_xor_si128(p1, _mm_loadu_si128((__m128i *) (dest+i+16)));
+    }
+    _mm_storeu_si128((__m128i *) (dest+i), p0);
+    _mm_storeu_si128((__m128i *) (dest+i+16), p1);
+  }
+  return i;
+}
+
+/* Byte b of the product of the eight nibbles */
+
+#define W32_PRODUCT_BYTE(t, b) \
+  _mm_xor_si128( \
+    _mm_xor_si128(_mm_xor_si128(_mm_shuffle_epi8(NIBBLE_TABLE(t, b), x0), \
+                                _mm_shuffle_epi8(NIBBLE_TABLE(t, 4+b), x1)), \
+                  _mm_xor_si128(_mm_shuffle_epi8(NIBBLE_TABLE(t, 8+b), x2), \
+                                _mm_shuffle_epi8(NIBBLE_TABLE(t, 12+b), x3))), \
+    _mm_xor_si128(_mm_xor_si128(_mm_shuffle_epi8(NIBBLE_TABLE(t, 16+b), x4), \
+                                _mm_shuffle_epi8(NIBBLE_TABLE(t, 20+b), x5)), \
+                  _mm_xor_si128(_mm_shuffle_epi8(NIBBLE_TABLE(t, 24+b), x6), \
+                                _mm_shuffle_epi8(NIBBLE_TABLE(t, 28+b), x7))))
+
+static TARGET("ssse3") int ssse3_w32_table_multiply(const galois_region_table *t, char *src,
+                                                   int nbytes, char *dest, int add)
+{
+  const __m128i m0f = _mm_set1_epi8(0x0f);
+  __m128i b[4], r[4], p[4];
+  __m128i x0, x1, x2, x3, x4, x5, x6, x7;
+  int i;
+
+  for (i = 0; i + 64 <= nbytes; i += 64) {
+    if (t->altmap) {
+      b[3] = _mm_loadu_si128((__m128i *) (src+i));
+      b[2] = _mm_loadu_si128((__m128i *) (src+i+16));
+      b[1] = _mm_loadu_si128((__m128i *) (src+i+32));
+      b[0] = _mm_loadu_si128((__m128i *) (src+i+48));
+    } else {
+      w32_gather(src+i, b);
+    }
+    x0 = LOW_NIBBLES(b[0]);
+    x1 = HIGH_NIBBLES(b[0]);
+    x2 = LOW_NIBBLES(b[1]);
+    x3 = HIGH_NIBBLES(b[1]);
+    x4 = LOW_NIBBLES(b[2]);
+    x5 = HIGH_NIBBLES(b[2]);
+    x6 = LOW_NIBBLES(b[3]);
+    x7 = HIGH_NIBBLES(b[3]);
+    r[0] = W32_PRODUCT_BYTE(t, 0);
+    r[1] = W32_PRODUCT_BYTE(t, 1);
+    r[2] = W32_PRODUCT_BYTE(t, 2);
+    r[3] = W32_PRODUCT_BYTE(t, 3);
+    if (t->altmap) {
+      p[0] = r[3];
+      p[1] = r[2];
+      p[2] = r[1];
+      p[3] = r[0];
+    } else {
+      w32_scatter(r, p);
+    }
+    if (add) {
+      p[0] = _mm_xor_si128(p[0], _mm_loadu_si128((__m128i *) (dest+i)));
+      p[1] = _mm_xor_si128(p[1], _mm_loadu_si128((__m128i *) (dest+i+16)));
+      p[2] = _mm_xor_si128(p[2], _mm_loadu_si128((__m128i *) (dest+i+32)));
+      p[3] = _mm_xor_si128(p[3], _mm_loadu_si128((__m128i *) (dest+i+48)));
+    }
+    _mm_storeu_si128((__m128i *) (dest+i), p[0]);
+    _mm_storeu_si128((__m128i *) (dest+i+16), p[1]);
+    _mm_storeu_si128((__m128i *) (dest+i+32), p[2]);
+    _mm_storeu_si128((__m128i *) (dest+i+48), p[3]);
+  }
+  return i;
+}
+
+/* One block of 16 words at a time, in place or not */
+
+static TARGET("ssse3") int ssse3_altmap_convert(int w, char *src, char *dest, int nbytes, int to)
+{
+  int i, j;
+
+  i = 0;
+  if (w == 16) {
+    __m128i lo, hi, p0, p1;
+
+    for ( ; i + 32 <= nbytes; i += 32) {
+      if (to) {
+        w16_gather(src+i, &lo, &hi);
+        _mm_storeu_si128((__m128i *) (dest+i), hi);
+        _mm_storeu_si128((__m128i *) (dest+i+16), lo);
+      } else {
+        hi = _mm_loadu_si128((__m128i *) (src+i));
+        lo = _mm_loadu_si128((__m128i *) (src+i+16));
+        w16_scatter(lo, hi, &p0, &p1);
+        _mm_storeu_si128((__m128i *) (dest+i), p0);
+        _mm_storeu_si128((__m128i *) (dest+i+16), p1);
+      }
+    }
+  } else {
+    __m128i r[4], p[4];
+
+    for ( ; i + 64 <= nbytes; i += 64) {
+      if (to) {
+        w32_gather(src+i, r);
+        for (j = 0; j < 4; j++) _mm_storeu_si128((__m128i *) (dest+i+16*j), r[3-j]);
+      } else {
+        for (j = 0; j < 4; j++) r[3-j] = _mm_loadu_si128((__m128i *) (src+i+16*j));
+        w32_scatter(r, p);
+        for (j = 0; j < 4; j++) _mm_storeu_si128((__m128i *) (dest+i+16*j), p[j]);
+      }
+    }
+  }
+  return i;
+}
+
+/* AVX2 and AVX-512 do what SSSE3 does in each 128-bit lane, on two or four
+   blocks of 16 words at once, and hand what is left to the narrower code.
+   Only the ALTMAP planes of the blocks have to be paired up across lanes. */
+
+#define NIBBLE_TABLE256(t, i) _mm256_broadcastsi128_si256(NIBBLE_TABLE(t, i))
+#define LOW_NIBBLES256(x) _mm256_and_si256((x), m0f)
+#define HIGH_NIBBLES256(x) _mm256_and_si256(_mm256_srli_epi64((x), 4), m0f)
+
+static TARGET("avx2") int avx2_w08_table_multiply(const galois_region_table *t, char *src,
+                                                  int nbytes, char *dest, int add)
+{
+  const __m256i m0f = _mm256_set1_epi8(0x0f);
+  __m256i t0, t1, a, p;
+  int i;
+
+  t0 = NIBBLE_TABLE256(t, 0);
+  t1 = NIBBLE_TABLE256(t, 1);
+  for (i = 0; i + 32 <= nbytes; i += 32) {
+    a = _mm256_loadu_si256((__m256i *) (src+i));
+    p = _mm256_xor_si256(_mm256_shuffle_epi8(t0, LOW_NIBBLES256(a)),
+                         _mm256_shuffle_epi8(t1, HIGH_NIBBLES256(a)));
+    if (add) p = _mm256_xor_si256(p, _mm256_loadu_si256((__m256i *) (dest+i)));
+    _mm256_storeu_si256((__m256i *) (dest+i), p);
+  }
+  return i + ssse3_w08_table_multiply(t, src+i, nbytes-i, dest+i, add);
+}
+
+static TARGET("avx2") int avx2_w16_table_multiply(const galois_region_table *t, char *src,
+                                                  int nbytes, char *dest, int add)
+{
+  const __m256i m0f = _mm256_set1_epi8(0x0f);
+  const __m256i split = _mm256_broadcastsi128_si256(
+      _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15));
+  __m256i tb[8], a0, a1, lo, hi, x0, x1, x2, x3, rl, rh, p0, p1;
+  int i, j;
+
+  for (j = 0; j < 8; j++) tb[j] = NIBBLE_TABLE256(t, j);
+  for (i = 0; i + 64 <= nbytes; i += 64) {
+    a0 = _mm256_loadu_si256((__m256i *) (src+i));
+    a1 = _mm256_loadu_si256((__m256i *) (src+i+32));
+    if (t->altmap) {
+      hi = _mm256_permute2x128_si256(a0, a1, 0x20);
+      lo = _mm256_permute2x128_si256(a0, a1, 0x31);
+    } else {
+      a0 = _mm256_shuffle_epi8(a0, split);
+      a1 = _mm256_shuffle_epi8(a1, split);
+      lo = _mm256_unpacklo_epi64(a0, a1);
+      hi = _mm256_unpackhi_epi64(a0, a1);
+    }
+    x0 = LOW_NIBBLES256(lo);
+    x1 = HIGH_NIBBLES256(lo);
+    x2 = LOW_NIBBLES256(hi);
+    x3 = HIGH_NIBBLES256(hi);
+    rl = _mm256_xor_si256(_mm256_xor_si256(_mm256_shuffle_epi8(tb[0], x0), _mm256_shuffle_epi8(tb[2], x1)),
+                          _mm256_xor_si256(_mm256_shuffle_epi8(tb[4], x2), _mm256_shuffle_epi8(tb[6], x3)));
+    rh = _mm256_xor_si256(_mm256_xor_si256(_mm256_shuffle_epi8(tb[1], x0), _mm256_shuffle_epi8(tb[3], x1)),
+                          _mm256_xor_si256(_mm256_shuffle_epi8(tb[5], x2), _mm256_shuffle_epi8(tb[7], x3)));
+    if (t->altmap) {
+      p0 = _mm256_permute2x128_si256(rh, rl, 0x20);
+      p1 = _mm256_permute2x128_si256(rh, rl, 0x31);
+    } else {
+      p0 = _mm256_unpacklo_epi8(rl, rh);
+      p1 = _mm256_unpackhi_epi8(rl, rh);
+    }
+    if (add) {
+      p0 = _mm256_xor_si256(p0, _mm256_loadu_si256((__m256i *) (dest+i)));
+      p1 = _mm256_xor_si256(p1, _mm256_loadu_si256((__m256i *) (dest+i+32)));
+    }
+    _mm256_storeu_si256((__m256i *) (dest+i), p0);
+    _mm256_storeu_si256((__m256i *) (dest+i+32), p1);
+  }
+  return i + ssse3_w16_table_multiply(t, src+i, nbytes-i, dest+i, add);
+}
+
+/* Sixteen ymm registers cannot hold the eight nibbles and the tables, so
+   the four product bytes are gathered one nibble at a time */
+
+#define W32_NIBBLE_PRODUCT256(n, x) \
+  do { \
+    r[0] = _mm256_xor_si256(r[0], _mm256_shuffle_epi8(NIBBLE_TABLE256(t, 4*(n)), (x))); \
+    r[1] = _mm256_xor_si256(r[1], _mm256_shuffle_epi8(NIBBLE_TABLE256(t, 4*(n)+1), (x))); \
+    r[2] = _mm256_xor_si256(r[2], _mm256_shuffle_epi8(NIBBLE_TABLE256(t, 4*(n)+2), (x))); \
+    r[3] = _mm256_xor_si256(r[3], _mm256_shuffle_epi8(NIBBLE_TABLE256(t, 4*(n)+3), (x))); \
+  } while (0)
+
+static TARGET("avx2") int avx2_w32_table_multiply(const galois_region_table *t, char *src,
+                                                  int nbytes, char *dest, int add)
+{
+  const __m256i m0f = _mm256_set1_epi8(0x0f);
+  const __m256i split = _mm256_broadcastsi128_si256(
+      _mm_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15));
+  __m256i a0, a1, a2, a3, b0, b1, b2, b3, p0, p1, p2, p3;
+  __m256i r[4];
+  int i;
+
+  for (i = 0; i + 128 <= nbytes; i += 128) {
+    a0 = _mm256_loadu_si256((__m256i *) (src+i));
+    a1 = _mm256_loadu_si256((__m256i *) (src+i+32));
+    a2 = _mm256_loadu_si256((__m256i *) (src+i+64));
+    a3 = _mm256_loadu_si256((__m256i *) (src+i+96));
+    if (t->altmap) {
+      b3 = _mm256_permute2x128_si256(a0, a2, 0x20);
+      b2 = _mm256_permute2x128_si256(a0, a2, 0x31);
+      b1 = _mm256_permute2x128_si256(a1, a3, 0x20);
+      b0 = _mm256_permute2x128_si256(a1, a3, 0x31);
+    } else {
+      a0 = _mm256_shuffle_epi8(a0, split);
+      a1 = _mm256_shuffle_epi8(a1, split);
+      a2 = _mm256_shuffle_epi8(a2, split);
+      a3 = _mm256_shuffle_epi8(a3, split);
+      p0 = _mm256_unpacklo_epi32(a0, a1);
+      p1 = _mm256_unpacklo_epi32(a2, a3);
+      p2 = _mm256_unpackhi_epi32(a0, a1);
+      p3 = _mm256_unpackhi_epi32(a2, a3);
+      b0 = _mm256_unpacklo_epi64(p0, p1);
+      b1 = _mm256_unpackhi_epi64(p0, p1);
+      b2 = _mm256_unpacklo_epi64(p2, p3);
+      b3 = _mm256_unpackhi_epi64(p2, p3);
+    }
+    r[0] = r[1] = r[2] = r[3] = _mm256_setzero_si256();
+    W32_NIBBLE_PRODUCT256(0, LOW_NIBBLES256(b0));
+    W32_NIBBLE_PRODUCT256(1, HIGH_NIBBLES256(b0));
+    W32_NIBBLE_PRODUCT256(2, LOW_NIBBLES256(b1));
+    W32_NIBBLE_PRODUCT256(3, HIGH_NIBBLES256(b1));
+    W32_NIBBLE_PRODUCT256(4, LOW_NIBBLES256(b2));
+    W32_NIBBLE_PRODUCT256(5, HIGH_NIBBLES256(b2));
+    W32_NIBBLE_PRODUCT256(6, LOW_NIBBLES256(b3));
+    W32_NIBBLE_PRODUCT256(7, HIGH_NIBBLES256(b3));
+    if (t->altmap) {
+      p0 = _mm256_permute2x128_si256(r[3], r[2], 0x20);
+      p1 = _mm256_permute2x128_si256(r[1], r[0], 0x20);
+      p2 = _mm256_permute2x128_si256(r[3], r[2], 0x31);
+      p3 = _mm256_permute2x128_si256(r[1], r[0], 0x31);
+    } else {
+      a0 = _mm256_unpacklo_epi8(r[0], r[1]);
+      a1 = _mm256_unpackhi_epi8(r[0], r[1]);
+      a2 = _mm256_unpacklo_epi8(r[2], r[3]);
+      a3 = _mm256_unpackhi_epi8(r[2], r[3]);
+      p0 = _mm256_unpacklo_epi16(a0, a2);
+      p1 = _mm256_unpackhi_epi16(a0, a2);
+      p2 = _mm256_unpacklo_epi16(a1, a3);
+      p3 = _mm256_unpackhi_epi16(a1, a3);
+    }
+    if (add) {
+      p0 = _mm256_xor_si256(p0, _mm256_loadu_si256((__m256i *) (dest+i)));
+      p1 = _mm256_xor_si256(p1, _mm256_loadu_si256((__m256i *) (dest+i+32)));
+      p2 = _mm256_xor_si256(p2, _mm256_loadu_si256((__m256i *) (dest+i+64)));
+      p3 = _mm256_xor_si256(p3, _mm256_loadu_si256((__m256i *) (dest+i+96)));
+    }
+    _mm256_storeu_si256((__m256i *) (dest+i), p0);
+    _mm256_storeu_si256((__m256i *) (dest+i+32), p1);
+    _mm256_storeu_si256((__m256i *) (dest+i+64), p2);
+    _mm256_storeu_si256((__m256i *) (dest+i+96), p3);
+  }
+  return i + ssse3_w32_table_multiply(t, src+i, nbytes-i, dest+i, add);
+}
+
+#define NIBBLE_TABLE512(t, i) _mm512_broadcast_i32x4(NIBBLE_TABLE(t, i))
+#define LOW_NIBBLES512(x) _mm512_and_si512((x), m0f)
+#define HIGH_NIBBLES512(x) _mm512_and_si512(_mm512_srli_epi64((x), 4), m0f)
+
+/* v[j] gets lane j of each of v[0..3] -- its own inverse */
+
+static inline TARGET(AVX512) void avx512_transpose_lanes(__m512i *v)
+{
+  __m512i t0, t1, t2, t3;
+
+  t0 = _mm512_shuffle_i64x2(v[0], v[1], _MM_SHUFFLE(1, 0, 1, 0));
+  t1 = _mm512_shuffle_i64x2(v[0], v[1], _MM_SHUFFLE(3, 2, 3, 2));
+  t2 = _mm512_shuffle_i64x2(v[2], v[3], _MM_SHUFFLE(1, 0, 1, 0));
+  t3 = _mm512_shuffle_i64x2(v[2], v[3], _MM_SHUFFLE(3, 2, 3, 2));
+  v[0] = _mm512_shuffle_i64x2(t0, t2, _MM_SHUFFLE(2, 0, 2, 0));
+  v[1] = _mm512_shuffle_i64x2(t0, t2, _MM_SHUFFLE(3, 1, 3, 1));
+  v[2] = _mm512_shuffle_i64x2(t1, t3, _MM_SHUFFLE(2, 0, 2, 0));
+  v[3] = _mm512_shuffle_i64x2(t1, t3, _MM_SHUFFLE(3, 1, 3, 1));
+}
+
+static TARGET(AVX512) int avx512_w08_table_multiply(const galois_region_table *t, char *src,
+                                                    int nbytes, char *dest, int add)
+{
+  const __m512i m0f = _mm512_set1_epi8(0x0f);
+  __m512i t0, t1, a, p;
+  int i;
+
+  t0 = NIBBLE_TABLE512(t, 0);
+  t1 = NIBBLE_TABLE512(t, 1);
+  for (i = 0; i + 64 <= nbytes; i += 64) {
+    a = _mm512_loadu_si512((void *) (src+i));
+    p = _mm512_xor_si512(_mm512_shuffle_epi8(t0, LOW_NIBBLES512(a)),
+                         _mm512_shuffle_epi8(t1, HIGH_NIBBLES512(a)));
+    if (add) p = _mm512_xor_si512(p, _mm512_loadu_si512((void *) (dest+i)));
+    _mm512_storeu_si512((void *) (dest+i), p);
+  }
+  return i + avx2_w08_table_multiply(t, src+i, nbytes-i, dest+i, add);
+}
+
+static TARGET(AVX512) int avx512_w16_table_multiply(const galois_region_table *t, char *src,
+                                                    int nbytes, char *dest, int add)
+{
+  const __m512i m0f = _mm512_set1_epi8(0x0f);
+  const __m512i split = _mm512_broadcast_i32x4(
+      _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15));
+  __m512i tb[8], a0, a1, lo, hi, x0, x1, x2, x3, rl, rh, p0, p1;
+  int i, j;
+
+  for (j = 0; j < 8; j++) tb[j] = NIBBLE_TABLE512(t, j);
+  for (i = 0; i + 128 <= nbytes; i += 128) {
+    a0 = _mm512_loadu_si512((void *) (src+i));
+    a1 = _mm512_loadu_si512((void *) (src+i+64));
+    if (t->altmap) {
+      hi = _mm512_shuffle_i64x2(a0, a1, _MM_SHUFFLE(2, 0, 2, 0));
+      lo = _mm512_shuffle_i64x2(a0, a1, _MM_SHUFFLE(3, 1, 3, 1));
+    } else {
+      a0 = _mm512_shuffle_epi8(a0, split);
+      a1 = _mm512_shuffle_epi8(a1, split);
+      lo = _mm512_unpacklo_epi64(a0, a1);
+      hi = _mm512_unpackhi_epi64(a0, a1);
+    }
+    x0 = LOW_NIBBLES512(lo);
+    x1 = HIGH_NIBBLES512(lo);
+    x2 = LOW_NIBBLES512(hi);
+    x3 = HIGH_NIBBLES512(hi);
+    rl = _mm512_xor_si512(_mm512_xor_si512(_mm512_shuffle_epi8(tb[0], x0), _mm512_shuffle_epi8(tb[2], x1)),
+                          _mm512_xor_si512(_mm512_shuffle_epi8(tb[4], x2), _mm512_shuffle_epi8(tb[6], x3)));
+    rh = _mm512_xor_si512(_mm512_xor_si512(_mm512_shuffle_epi8(tb[1], x0), _mm512_shuffle_epi8(tb[3], x1)),
+                          _mm512_xor_si512(_mm512_shuffle_epi8(tb[5], x2), _mm512_shuffle_epi8(tb[7], x3)));
+    if (t->altmap) {
+      p0 = _mm512_shuffle_i64x2(rh, rl, _MM_SHUFFLE(1, 0, 1, 0));
+      p1 = _mm512_shuffle_i64x2(rh, rl, _MM_SHUFFLE(3, 2, 3, 2));
+      p0 = _mm512_shuffle_i64x2(p0, p0, _MM_SHUFFLE(3, 1, 2, 0));
+      p1 = _mm512_shuffle_i64x2(p1, p1, _MM_SHUFFLE(3, 1, 2, 0));
+    } else {
+      p0 = _mm512_unpacklo_epi8(rl, rh);
+      p1 = _mm512_unpackhi_epi8(rl, rh);
+    }
+    if (add) {
+      p0 = _mm512_xor_si512(p0, _mm512_loadu_si512((void *) (dest+i)));
+      p1 = _mm512_xor_si512(p1, _mm512_loadu_si512((void *) (dest+i+64)));
+    }
+    _mm512_storeu_si512((void *) (dest+i), p0);
+    _mm512_storeu_si512((void *) (dest+i+64), p1);
+  }
+  return i + avx2_w16_table_multiply(t, src+i, nbytes-i, dest+i, add);
+}
+
+#define W32_PRODUCT_BYTE512(t, b) \
+  _mm512_xor_si512( \
+    _mm512_xor_si512(_mm512_xor_si512(_mm512_shuffle_epi8(NIBBLE_TABLE512(t, b), x0), \
+                                      _mm512_shuffle_epi8(NIBBLE_TABLE512(t, 4+b), x1)), \
+                     _mm512_xor_si512(_mm512_shuffle_epi8(NIBBLE_TABLE512(t, 8+b), x2), \
+                                      _mm512_shuffle_epi8(NIBBLE_TABLE512(t, 12+b), x3))), \
+    _mm512_xor_si512(_mm512_xor_si512(_mm512_shuffle_epi8(NIBBLE_TABLE512(t, 16+b), x4), \
+                                      _mm512_shuffle_epi8(NIBBLE_TABLE512(t, 20+b), x5)), \
+                     _mm512_xor_si512(_mm512_shuffle_epi8(NIBBLE_TABLE512(t, 24+b), x6), \
+                                      _mm512_shuffle_epi8(NIBBLE_TABLE512(t, 28+b), x7))))
+
+static TARGET(AVX512) int avx512_w32_table_multiply(const galois_region_table *t, char *src,
+                                                    int nbytes, char *dest, int add)
+{
+  const __m512i m0f = _mm512_set1_epi8(0x0f);
+  const __m512i split = _mm512_broadcast_i32x4(
+      _mm_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15));
+  __m512i a[4], b[4], r[4], p[4];
+  __m512i x0, x1, x2, x3, x4, x5, x6, x7;
+  int i, j;
+
+  for (i = 0; i + 256 <= nbytes; i += 256) {
+    for (j = 0; j < 4; j++) a[j] = _mm512_loadu_si512((void *) (src+i+64*j));
+    if (t->altmap) {
+      avx512_transpose_lanes(a);
+      for (j = 0; j < 4; j++) b[3-j] = a[j];
+    } else {
+      for (j = 0; j < 4; j++) a[j] = _mm512_shuffle_epi8(a[j], split);
+      p[0] = _mm512_unpacklo_epi32(a[0], a[1]);
+      p[1] = _mm512_unpacklo_epi32(a[2], a[3]);
+      p[2] = _mm512_unpackhi_epi32(a[0], a[1]);
+      p[3] = _mm512_unpackhi_epi32(a[2], a[3]);
+      b[0] = _mm512_unpacklo_epi64(p[0], p[1]);
+      b[1] = _mm512_unpackhi_epi64(p[0], p[1]);
+      b[2] = _mm512_unpacklo_epi64(p[2], p[3]);
+      b[3] = _mm512_unpackhi_epi64(p[2], p[3]);
+    }
+    x0 = LOW_NIBBLES512(b[0]);
+    x1 = HIGH_NIBBLES512(b[0]);
+    x2 = LOW_NIBBLES512(b[1]);
+    x3 = HIGH_NIBBLES512(b[1]);
+    x4 = LOW_NIBBLES512(b[2]);
+    x5 = HIGH_NIBBLES512(b[2]);
+    x6 = LOW_NIBBLES512(b[3]);
+    x7 = HIGH_NIBBLES512(b[3]);
+    r[0] = W32_PRODUCT_BYTE512(t, 0);
+    r[1] = W32_PRODUCT_BYTE512(t, 1);
+    r[2] = W32_PRODUCT_BYTE512(t, 2);
+    r[3] = W32_PRODUCT_BYTE512(t, 3);
+    if (t->altmap) {
+      for (j = 0; j < 4; j++) p[j] = r[3-j];
+      avx512_transpose_lanes(p);
+    } else {
+      a[0] = _mm512_unpacklo_epi8(r[0], r[1]);
+      a[1] = _mm512_unpackhi_epi8(r[0], r[1]);
+      a[2] = _mm512_unpacklo_epi8(r[2], r[3]);
+      a[3] = _mm512_unpackhi_epi8(r[2], r[3]);
+      p[0] = _mm512_unpacklo_epi16(a[0], a[2]);
+      p[1] = _mm512_unpackhi_epi16(a[0], a[2]);
+      p[2] = _mm512_unpacklo_epi16(a[1], a[3]);
+      p[3] = _mm512_unpackhi_epi16(a[1], a[3]);
+    }
+    for (j = 0; j < 4; j++) {
+      if (add) p[j] = _mm512_xor_si512(p[j], _mm512_loadu_si512((void *) (dest+i+64*j)));
+      _mm512_storeu_si512((void *) (dest+i+64*j), p[j]);
+    }
+  }
+  return i + avx2_w32_table_multiply(t, src+i, nbytes-i, dest+i, add);
+}
+
+/* GF2P8AFFINEQB multiplies 64 bytes by the matrix at once, with no tables.
+   The last partial 64 bytes are loaded and stored under a mask. */
+
+#define GFNI AVX512 ",gfni"
+
+static TARGET(GFNI) int gfni_affine_multiply(uint64_t affine, char *src, int nbytes, char *dest,
+                                             int add)
+{
+  const __m512i m = _mm512_set1_epi64((long long) affine);
+  __m512i p0, p1;
+  __mmask64 mask;
+  int i;
+
+  for (i = 0; i + 128 <= nbytes; i += 128) {
+    p0 = _mm512_gf2p8affine_epi64_epi8(_mm512_loadu_si512((void *) (src+i)), m, 0);
+    p1 = _mm512_gf2p8affine_epi64_epi8(_mm512_loadu_si512((void *) (src+i+64)), m, 0);
+    if (add) {
+      p0 = _mm512_xor_si512(p0, _mm512_loadu_si512((void *) (dest+i)));
+      p1 = _mm512_xor_si512(p1, _mm512_loadu_si512((void *) (dest+i+64)));
+    }
+    _mm512_storeu_si512((void *) (dest+i), p0);
+    _mm512_storeu_si512((void *) (dest+i+64), p1);
+  }
+  for ( ; i < nbytes; i += 64) {
+    mask = (nbytes-i >= 64) ? ~(__mmask64) 0 : ((__mmask64) 1 << (nbytes-i)) - 1;
+    p0 = _mm512_gf2p8affine_epi64_epi8(_mm512_maskz_loadu_epi8(mask, src+i), m, 0);
+    if (add) p0 = _mm512_xor_si512(p0, _mm512_maskz_loadu_epi8(mask, dest+i));
+    _mm512_mask_storeu_epi8(dest+i, mask, p0);
+  }
+  return nbytes;
+}
+
+static TARGET(GFNI) int gfni_w08_table_multiply(const galois_region_table *t, char *src,
+                                                int nbytes, char *dest, int add)
+{
+  return gfni_affine_multiply(t->affine, src, nbytes, dest, add);
+}
+#endif
+
+static void set_kernels(galois_isa isa)
+{
+  memset(&kernels, 0, sizeof(region_kernels));
+#ifdef GALOIS_X86
+  switch (isa) {
+    case GALOIS_ISA_GFNI:
+      kernels.xor_multi = avx512_region_xor_multi;
+      kernels.table_multiply[0] = gfni_w08_table_multiply;
+      kernels.table_multiply[1] = avx512_w16_table_multiply;
+      kernels.table_multiply[2] = avx512_w32_table_multiply;
+      kernels.affine_multiply = gfni_affine_multiply;
+      break;
+    case GALOIS_ISA_AVX512:
+      kernels.xor_multi = avx512_region_xor_multi;
+      kernels.table_multiply[0] = avx512_w08_table_multiply;
+      kernels.table_multiply[1] = avx512_w16_table_multiply;
+      kernels.table_multiply[2] = avx512_w32_table_multiply;
+      break;
+    case GALOIS_ISA_AVX2:
+      kernels.xor_multi = avx2_region_xor_multi;
+      kernels.table_multiply[0] = avx2_w08_table_multiply;
+      kernels.table_multiply[1] = avx2_w16_table_multiply;
+      kernels.table_multiply[2] = avx2_w32_table_multiply;
+      break;
+    case GALOIS_ISA_SSSE3:
+      kernels.xor_multi = sse2_region_xor_multi;
+      kernels.table_multiply[0] = ssse3_w08_table_multiply;
+      kernels.table_multiply[1] = ssse3_w16_table_multiply;
+      kernels.table_multiply[2] = ssse3_w32_table_multiply;
+      break;
+    case GALOIS_ISA_SSE2:
+      kernels.xor_multi = sse2_region_xor_multi;
+      break;
+    default:
+      break;
+  }
+  if (isa >= GALOIS_ISA_SSSE3) kernels.altmap_convert = ssse3_altmap_convert;
+#endif
+}
+
+/* The product of word x, from the byte tables */
+
+static inline uint32_t table_word_multiply(const galois_region_table *t, uint32_t x)
+{
+  switch (t->w) {
+    case 4:
+    case 8:  return t->bytes.w8[0][x];
+    case 16: return t->bytes.w16[0][x & 0xff] ^ t->bytes.w16[1][x >> 8];
+    default: return t->bytes.w32[0][x & 0xff] ^ t->bytes.w32[1][(x >> 8) & 0xff] ^
+                    t->bytes.w32[2][(x >> 16) & 0xff] ^ t->bytes.w32[3][x >> 24];
+  }
+}
+
+void galois_table_region_multiply(const galois_region_table *t, char *region, int nbytes,
+                                  char *r2, int add)
+{
+  const region_kernels *k;
+  gf_t *gf;
+  uint32_t x, y;
+  int i, j, b, nb;
+
+  /* If the field has been changed since, the tables no longer apply */
+
+  gf = galois_load_field(t->w);
+  if (gf != t->gf && !t->altmap) {
+    gf = galois_field(t->w);
+    gf->multiply_region.w32(gf, region, r2, t->multby, nbytes, add);
+    return;
+  }
+
+  i = 0;
+  k = get_kernels();
+  j = (t->w <= 8) ? 0 : (t->w == 16) ? 1 : 2;
+  if (k->table_multiply[j] != NULL) i = k->table_multiply[j](t, region, nbytes, r2, add);
+  nb = (t->w == 4) ? 1 : t->w/8;
+  if (t->altmap && nb > 1) {
+
+    /* Whole blocks of 16 words, with byte b of word j at j+16*(nb-1-b) */
+
+    for ( ; i + 16*nb <= nbytes; i += 16*nb) {
+      for (j = 0; j < 16; j++) {
+        x = 0;
+        for (b = 0; b < nb; b++) x |= (uint32_t) (uint8_t) region[i+j+16*(nb-1-b)] << (8*b);
+        x = table_word_multiply(t, x);
+        for (b = 0; b < nb; b++) {
+          y = (x >> (8*b)) & 0xff;
+          if (add) y ^= (uint8_t) r2[i+j+16*(nb-1-b)];
+          r2[i+j+16*(nb-1-b)] = y;
+        }
+      }
+    }
+    return;
+  }
+  for ( ; i + nb <= nbytes; i += nb) {
+    x = 0;
+    memcpy(&x, region+i, nb);
+    x = table_word_multiply(t, x);
+    if (add) {
+      y = 0;
+      memcpy(&y, r2+i, nb);
+      x ^= y;
+    }
+    memcpy(r2+i, &x, nb);
+  }
+}
+
+/* One block of 16 words at a time, through a copy, so that src may be dest */
+
+static void altmap_convert(int w, char *src, char *dest, int nbytes, int to)
+{
+  const region_kernels *k;
+  uint8_t block[64];
+  int i, j, b, nb;
+
+  nb = w/8;
+  i = 0;
+  k = get_kernels();
+  if (k->altmap_convert != NULL) i = k->altmap_convert(w, src, dest, nbytes, to);
+  for ( ; i + 16*nb <= nbytes; i += 16*nb) {
+    memcpy(block, src+i, 16*nb);
+    for (j = 0; j < 16; j++) {
+      for (b = 0; b < nb; b++) {
+        if (to) {
+          dest[i+j+16*(nb-1-b)] = block[j*nb+b];
+        } else {
+          dest[i+j*nb+b] = block[j+16*(nb-1-b)];
+        }
+      }
+    }
+  }
+}
+
+void galois_to_altmap(int w, char *src, char *dest, int nbytes)
+{
+  if (w == 8) {
+    if (src != dest) memmove(dest, src, nbytes);
+    return;
+  }
+  altmap_convert(w, src, dest, nbytes, 1);
+}
+
+void galois_from_altmap(int w, char *src, char *dest, int nbytes)
+{
+  if (w == 8) {
+    if (src != dest) memmove(dest, src, nbytes);
+    return;
+  }
+  altmap_convert(w, src, dest, nbytes, 0);
+}
+
+/* The tables are built from the powers of the smallest generator of the
+   field, which is 2 for the default fields. */
+
+static log_table *galois_make_log_table(gf_t *gf, int w)
+{
+  log_table *lt;
+  uint32_t n, i, g, p;
+
+  n = (1 << w) - 1;
+  lt = (log_table *) malloc(sizeof(log_table));
+  if (lt == NULL) return NULL;
+  lt->gf = gf;
+  lt->log = (uint32_t *) malloc(sizeof(uint32_t)*(n+1));
+  lt->antilog = (uint16_t *) calloc(4*n+1, sizeof(uint16_t));
+  if (lt->log == NULL || lt->antilog == NULL) {
+    free(lt->log);
+    free(lt->antilog);
+    free(lt);
+    return NULL;
+  }
+
+  for (g = (w == 1) ? 1 : 2; g <= n; g++) {
+    p = 1;
+    for (i = 0; i < n; i++) {
+      if (i > 0 && p == 1) break;
+      lt->antilog[i] = p;
+      lt->log[p] = i;
+      p = gf->multiply.w32(gf, p, g);
+    }
+    if (i == n) break;
+  }
+  if (g > n) {
+    free(lt->log);
+    free(lt->antilog);
+    free(lt);
+    return NULL;
+  }
+  for (i = 0; i < n; i++) lt->antilog[i+n] = lt->antilog[i];
+  lt->log[0] = 2*n;
+  return lt;
+}
+
+int galois_log_tables(int w, const uint32_t **log, const uint16_t **antilog)
+{
+  gf_t *gf;
+  log_table *lt;
+
+  if (w <= 0 || w > GALOIS_LOG_MAX_W) return -1;
+  gf = galois_field(w);
+  lt = __atomic_load_n(&log_tables[w], __ATOMIC_ACQUIRE);
+  if (lt == NULL || lt->gf != gf) {
+    pthread_mutex_lock(&galois_lock);
+    gf = gfp_array[w];
+    lt = log_tables[w];
+    if (lt == NULL || lt->gf != gf) {
+      lt = galois_make_log_table(gf, w);
+      if (lt != NULL) {
+        lt->next = log_tables[w];
+        __atomic_store_n(&log_tables[w], lt, __ATOMIC_RELEASE);
+      }
+    }
+    pthread_mutex_unlock(&galois_lock);
+    if (lt == NULL) return -1;
+  }
+  *log = lt->log;
+  *antilog = lt->antilog;
+  return 0;
+}
+
 int galois_inverse(int y, int w)
 {
   if (y == 0) return -1;
@@ -0,0 +1,16 @@
+/* Private to the library: what galois.c and reed_sol.c need to build their
+   SIMD kernels.  Both pick kernels with the same test, so it lives here. */
+
+#ifndef JERASURE_INCLUDED__GALOIS_SIMD_H
+#define JERASURE_INCLUDED__GALOIS_SIMD_H
+
+/* The SIMD kernels need GCC or clang on x86, for the target attribute */
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && !defined(JERASURE_NO_SIMD)
+#define GALOIS_X86
+#include <immintrin.h>
+#define TARGET(isa) __attribute__((target(isa)))
+#define AVX512 "avx512f,avx512bw"
+#endif
+
+#endif
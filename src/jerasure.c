@@ -44,19 +44,145 @@
    Revision 1.0 - 2007: James S. Plank
  */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include "galois.h"
 #include "jerasure.h"
+#include "jerasure_private.h"
 
 #define talloc(type, num) (type *) malloc(sizeof(type)*(num))
 
-static double jerasure_total_xor_bytes = 0;
-static double jerasure_total_gf_bytes = 0;
-static double jerasure_total_memcpy_bytes = 0;
+static int **cse_bitmatrix_to_schedule(int k, int rows, int w, const uint64_t *bits, int words,
+                                       int tdev, int *ntemps);
+static int **smart_bitmatrix_to_schedule(int k, int m, int w, const uint64_t *bits, int words);
+static int **dumb_bitmatrix_to_schedule(int k, int m, int w, const uint64_t *bits, int words);
+
+static void pb_xor_row(uint64_t *dst, const uint64_t *src, int words);
+static galois_region_table **make_region_tables(int rows, int cols, int w, int *matrix,
+                                                int altmap);
+
+#define PB_ROW(pb, r) ((pb)->bits + (size_t) (r)*(pb)->words)
+#define PB_GET(pb, r, c) ((PB_ROW(pb, r)[(c)/64] >> ((c)%64)) & 1)
+#define PB_SET(pb, r, c) (PB_ROW(pb, r)[(c)/64] |= (1ULL << ((c)%64)))
+
+/* The byte counts for jerasure_get_stats.  Each thread counts into its own
+   block, so coding threads never write to a shared cache line.  The blocks are
+   on a list, and jerasure_get_stats adds them up.  When a thread exits, its
+   counts are added to stats_exited, and its block is freed.  Only the owning
+   thread writes a block, so the relaxed atomics here are plain loads and
+   stores -- they just keep the readers well defined.
+
+   Configuring with --disable-stats defines JERASURE_NO_STATS, which turns
+   STATS_ADD into nothing. */
+
+#define STATS_XOR    0
+#define STATS_GF     1
+#define STATS_MEMCPY 2
+
+#ifdef JERASURE_NO_STATS
+
+#define STATS_ADD(which, nbytes) ((void) (nbytes))
+
+#else
+
+typedef struct stats_block {
+  uint64_t bytes[3];
+  struct stats_block *prev, *next;
+} stats_block;
+
+static __thread stats_block *stats_mine = NULL;
+static stats_block *stats_blocks = NULL;
+static uint64_t stats_exited[3];      /* Counts from threads that have exited */
+static uint64_t stats_reported[3];    /* Totals when jerasure_get_stats was last called */
+static stats_block stats_fallback;    /* For threads that couldn't get a block */
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t stats_key;
+static pthread_once_t stats_once = PTHREAD_ONCE_INIT;
+
+static void stats_thread_exit(void *arg)
+{
+  stats_block *b;
+  int i;
+
+  b = (stats_block *) arg;
+  stats_mine = NULL;
+  pthread_mutex_lock(&stats_lock);
+  for (i = 0; i < 3; i++) stats_exited[i] += b->bytes[i];
+  if (b->prev != NULL) b->prev->next = b->next; else stats_blocks = b->next;
+  if (b->next != NULL) b->next->prev = b->prev;
+  pthread_mutex_unlock(&stats_lock);
+  free(b);
+}
+
+static void stats_make_key(void)
+{
+  pthread_key_create(&stats_key, stats_thread_exit);
+}
+
+static stats_block *stats_new_block(void)
+{
+  stats_block *b;
+
+  pthread_once(&stats_once, stats_make_key);
+  b = (stats_block *) calloc(1, sizeof(stats_block));
+  if (b == NULL) return &stats_fallback;
+
+  pthread_mutex_lock(&stats_lock);
+  b->next = stats_blocks;
+  if (stats_blocks != NULL) stats_blocks->prev = b;
+  stats_blocks = b;
+  pthread_mutex_unlock(&stats_lock);
+
+  pthread_setspecific(stats_key, b);
+  stats_mine = b;
+  return b;
+}
+
+static inline void stats_add(int which, uint64_t nbytes)
+{
+  stats_block *b;
+
+  b = stats_mine;
+  if (b == NULL) b = stats_new_block();
+  if (b == &stats_fallback) {
+    __atomic_fetch_add(&b->bytes[which], nbytes, __ATOMIC_RELAXED);
+  } else {
+    __atomic_store_n(&b->bytes[which],
+                     __atomic_load_n(&b->bytes[which], __ATOMIC_RELAXED) + nbytes, __ATOMIC_RELAXED);
+  }
+}
+
+#define STATS_ADD(which, nbytes) stats_add(which, nbytes)
+
+#endif
+
+/* Sources are gathered into batches of this many for galois_region_xor_multi() */
+
+#define XOR_BATCH 32
+
+static void xor_batch(char **srcs, int nsrc, char *dest, int nbytes, int add)
+{
+  if (nsrc == 1 && !add) {
+    memcpy(dest, srcs[0], nbytes);
+    STATS_ADD(STATS_MEMCPY, nbytes);
+    return;
+  }
+  galois_region_xor_multi(srcs, nsrc, dest, nbytes, add);
+  if (!add) {
+    STATS_ADD(STATS_MEMCPY, nbytes);
+    nsrc--;
+  }
+  STATS_ADD(STATS_XOR, (uint64_t) nsrc*nbytes);
+}
 
 void jerasure_print_matrix(int *m, int rows, int cols, int w)
 {
@@ -96,9 +222,20 @@ void jerasure_print_bitmatrix(int *m, int rows, int cols, int w)
   }
 }
 
-int jerasure_make_decoding_matrix(int k, int m, int w, int *matrix, int *erased, int *decoding_matrix, int *dm_ids)
+/* The survivors are the surviving data devices S, which decode to themselves,
+   and e coding devices, where e is the number of erased data devices E.  If A
+   and B are the columns of E and S in the survivors' coding rows, then
+
+     coding = A*data[E] + B*data[S],  so  data[E] = A^-1*coding + A^-1*B*data[S]
+
+   That's the decoding matrix's rows for E, without inverting the k*k matrix:
+   A is only e*e, and each row is then e*k multiplications. */
+
+int jerasure_make_decoding_rows(int k, int m, int w, int *matrix, int *erased, int nrows,
+                                int *row_ids, int *decoding_rows, int *dm_ids)
 {
-  int i, j, *tmpmat;
+  int i, j, r, e, x, t, sum;
+  int *a, *ainv, *epos, *cpos, *dpos;
 
   j = 0;
   for (i = 0; j < k; i++) {
@@ -108,29 +245,80 @@ int jerasure_make_decoding_matrix(int k, int m, int w, int *matrix, int *erased,
     }
   }
 
-  tmpmat = talloc(int, k*k);
-  if (tmpmat == NULL) { return -1; }
+  /* epos[t] is erased data device t's id, cpos[r] is coding survivor r's index
+     in dm_ids, and dpos[i] is data device i's index in dm_ids, or its index in
+     epos if it is erased. */
+
+  a = talloc(int, 2*k*k + 3*k);
+  if (a == NULL) return -1;
+  ainv = a + k*k;
+  epos = ainv + k*k;
+  cpos = epos + k;
+  dpos = cpos + k;
+
+  e = 0;
+  for (i = 0; i < k; i++) {
+    if (erased[i]) {
+      dpos[i] = e;
+      epos[e++] = i;
+    }
+  }
+  r = 0;
   for (i = 0; i < k; i++) {
     if (dm_ids[i] < k) {
-      for (j = 0; j < k; j++) tmpmat[i*k+j] = 0;
-      tmpmat[i*k+dm_ids[i]] = 1;
+      dpos[dm_ids[i]] = i;
     } else {
-      for (j = 0; j < k; j++) {
-        tmpmat[i*k+j] = matrix[(dm_ids[i]-k)*k+j];
+      cpos[r++] = i;
+    }
+  }
+
+  for (r = 0; r < e; r++) {
+    for (t = 0; t < e; t++) a[r*e+t] = matrix[(dm_ids[cpos[r]]-k)*k+epos[t]];
+  }
+  if (e > 0 && jerasure_invert_matrix(a, ainv, e, w) < 0) {
+    free(a);
+    return -1;
+  }
+
+  for (x = 0; x < nrows; x++) {
+    i = row_ids[x];
+    for (j = 0; j < k; j++) decoding_rows[x*k+j] = 0;
+    if (!erased[i]) {
+      decoding_rows[x*k+dpos[i]] = 1;
+      continue;
+    }
+    t = dpos[i];
+    for (r = 0; r < e; r++) decoding_rows[x*k+cpos[r]] = ainv[t*e+r];
+    for (j = 0; j < k; j++) {
+      if (erased[j]) continue;
+      sum = 0;
+      for (r = 0; r < e; r++) {
+        sum ^= galois_single_multiply(ainv[t*e+r], matrix[(dm_ids[cpos[r]]-k)*k+j], w);
       }
+      decoding_rows[x*k+dpos[j]] = sum;
     }
   }
+  free(a);
+  return 0;
+}
+
+int jerasure_make_decoding_matrix(int k, int m, int w, int *matrix, int *erased, int *decoding_matrix, int *dm_ids)
+{
+  int i, *ids;
 
-  i = jerasure_invert_matrix(tmpmat, decoding_matrix, k, w);
-  free(tmpmat);
+  ids = talloc(int, k);
+  if (ids == NULL) return -1;
+  for (i = 0; i < k; i++) ids[i] = i;
+  i = jerasure_make_decoding_rows(k, m, w, matrix, erased, k, ids, decoding_matrix, dm_ids);
+  free(ids);
   return i;
 }
 
 /* Internal Routine */
 int jerasure_make_decoding_bitmatrix(int k, int m, int w, int *matrix, int *erased, int *decoding_matrix, int *dm_ids)
 {
-  int i, j, *tmpmat;
-  int index, mindex;
+  jerasure_packed_bitmatrix *tmpmat, *inverse;
+  int i, j, x, ret;
 
   j = 0;
   for (i = 0; j < k; i++) {
@@ -140,42 +328,69 @@ int jerasure_make_decoding_bitmatrix(int k, int m, int w, int *matrix, int *eras
     }
   }
 
-  tmpmat = talloc(int, k*k*w*w);
-  if (tmpmat == NULL) { return -1; }
-  for (i = 0; i < k; i++) {
-    if (dm_ids[i] < k) {
-      index = i*k*w*w;
-      for (j = 0; j < k*w*w; j++) tmpmat[index+j] = 0;
-      index = i*k*w*w+dm_ids[i]*w;
-      for (j = 0; j < w; j++) {
-        tmpmat[index] = 1;
-        index += (k*w+1);
-      }
-    } else {
-      index = i*k*w*w;
-      mindex = (dm_ids[i]-k)*k*w*w;
-      for (j = 0; j < k*w*w; j++) {
-        tmpmat[index+j] = matrix[mindex+j];
+  /* The rows are packed as they are copied, and the inverse is unpacked */
+
+  tmpmat = jerasure_new_packed_bitmatrix(k*w, k*w);
+  inverse = jerasure_new_packed_bitmatrix(k*w, k*w);
+  ret = -1;
+  if (tmpmat != NULL && inverse != NULL) {
+    for (i = 0; i < k; i++) {
+      for (x = 0; x < w; x++) {
+        if (dm_ids[i] < k) {
+          PB_SET(tmpmat, i*w+x, dm_ids[i]*w+x);
+        } else {
+          for (j = 0; j < k*w; j++) {
+            if (matrix[((dm_ids[i]-k)*w+x)*k*w+j]) PB_SET(tmpmat, i*w+x, j);
+          }
+        }
       }
     }
+    ret = jerasure_invert_packed_bitmatrix(tmpmat, inverse);
   }
-
-  i = jerasure_invert_bitmatrix(tmpmat, decoding_matrix, k*w);
-  free(tmpmat);
-  return i;
+  if (ret == 0) {
+    for (i = 0; i < k*w; i++) {
+      for (j = 0; j < k*w; j++) decoding_matrix[i*k*w+j] = PB_GET(inverse, i, j);
+    }
+  }
+  jerasure_free_packed_bitmatrix(tmpmat);
+  jerasure_free_packed_bitmatrix(inverse);
+  return ret;
 }
 
-int jerasure_matrix_decode(int k, int m, int w, int *matrix, int row_k_ones, int *erasures,
-                          char **data_ptrs, char **coding_ptrs, int size)
+/* A decoding plan holds everything that jerasure_matrix_decode works out from the
+   erasures: the rows of the decoding matrix for the erased data devices, the ids of
+   the surviving devices that they use, and the rows of the distribution matrix for
+   the erased coding devices.  All of the arrays live in the same block of memory as
+   the plan, so executing it never allocates. */
+
+struct jerasure_decoding_plan {
+  int k, m, w;
+  int ndata;            /* Erased data devices decoded with the decoding matrix */
+  int *data_ids;        /* ... their ids */
+  int *data_rows;       /* ... and their ndata rows of the decoding matrix */
+  int *dm_ids;          /* The k surviving devices that the decoding matrix uses */
+  int lastdrive;        /* Data device decoded with the all-ones row, or -1 */
+  int *last_row;
+  int *last_ids;
+  int ncoding;          /* Erased coding devices, re-encoded at the end */
+  int *coding_ids;
+  int *coding_rows;
+  galois_region_table **data_tables;    /* Region tables for data_rows and */
+  galois_region_table **coding_tables;  /* coding_rows, or NULL */
+};
+
+static jerasure_decoding_plan *make_decoding_plan(int k, int m, int w, int *matrix,
+                                                  int row_k_ones, int *erasures, int tables,
+                                                  int altmap)
 {
-  int i, edd, lastdrive;
-  int *tmpids;
-  int *erased, *decoding_matrix, *dm_ids;
+  int i, j, edd, ecd, lastdrive, ndata;
+  int *erased, *ptr;
+  jerasure_decoding_plan *plan;
 
-  if (w != 8 && w != 16 && w != 32) return -1;
+  if (w != 4 && w != 8 && w != 16 && w != 32) return NULL;
 
   erased = jerasure_erasures_to_erased(k, m, erasures);
-  if (erased == NULL) return -1;
+  if (erased == NULL) return NULL;
 
   /* Find the number of data drives failed */
 
@@ -188,6 +403,8 @@ int jerasure_matrix_decode(int k, int m, int w, int *matrix, int row_k_ones, int
       lastdrive = i;
     }
   }
+  ecd = 0;
+  for (i = 0; i < m; i++) ecd += erased[k+i];
     
   /* You only need to create the decoding matrix in the following cases:
 
@@ -203,77 +420,333 @@ int jerasure_matrix_decode(int k, int m, int w, int *matrix, int row_k_ones, int
    */
 
   if (!row_k_ones || erased[k]) lastdrive = k;
+  ndata = (lastdrive == k) ? edd : edd-1;
 
-  dm_ids = NULL;
-  decoding_matrix = NULL;
-
-  if (edd > 1 || (edd > 0 && (!row_k_ones || erased[k]))) {
-    dm_ids = talloc(int, k);
-    if (dm_ids == NULL) {
-      free(erased);
-      return -1;
-    }
-
-    decoding_matrix = talloc(int, k*k);
-    if (decoding_matrix == NULL) {
-      free(erased);
-      free(dm_ids);
-      return -1;
-    }
-
-    if (jerasure_make_decoding_matrix(k, m, w, matrix, erased, decoding_matrix, dm_ids) < 0) {
-      free(erased);
-      free(dm_ids);
-      free(decoding_matrix);
-      return -1;
-    }
+  plan = (jerasure_decoding_plan *) malloc(sizeof(jerasure_decoding_plan) +
+                                           sizeof(int)*(ndata*(k+1) + 3*k + ecd*(k+1)));
+  if (plan == NULL) {
+    free(erased);
+    return NULL;
   }
+  ptr = (int *) (plan+1);
+  plan->k = k;
+  plan->m = m;
+  plan->w = w;
+  plan->ndata = ndata;
+  plan->data_ids = ptr;        ptr += ndata;
+  plan->data_rows = ptr;       ptr += ndata*k;
+  plan->dm_ids = ptr;          ptr += k;
+  plan->last_row = ptr;        ptr += k;
+  plan->last_ids = ptr;        ptr += k;
+  plan->ncoding = ecd;
+  plan->coding_ids = ptr;      ptr += ecd;
+  plan->coding_rows = ptr;
 
   /* Decode the data drives.  
      If row_k_ones is true and coding device 0 is intact, then only decode edd-1 drives.
      This is done by stopping at lastdrive.
-     We test whether edd > 0 so that we can exit the loop early if we're done.
    */
 
-  for (i = 0; edd > 0 && i < lastdrive; i++) {
-    if (erased[i]) {
-      jerasure_matrix_dotprod(k, w, decoding_matrix+(i*k), dm_ids, i, data_ptrs, coding_ptrs, size);
-      edd--;
+  if (ndata > 0) {
+    j = 0;
+    for (i = 0; i < lastdrive; i++) {
+      if (erased[i]) plan->data_ids[j++] = i;
+    }
+    if (jerasure_make_decoding_rows(k, m, w, matrix, erased, ndata, plan->data_ids,
+                                    plan->data_rows, plan->dm_ids) < 0) {
+      free(erased);
+      free(plan);
+      return NULL;
     }
   }
 
   /* Then if necessary, decode drive lastdrive */
 
-  if (edd > 0) {
-    tmpids = talloc(int, k);
-    if (!tmpids) {
-      free(erased);
-      free(dm_ids);
-      free(decoding_matrix);
-      return -1;
-    }
+  if (lastdrive < k) {
+    plan->lastdrive = lastdrive;
+    memcpy(plan->last_row, matrix, sizeof(int)*k);
     for (i = 0; i < k; i++) {
-      tmpids[i] = (i < lastdrive) ? i : i+1;
+      plan->last_ids[i] = (i < lastdrive) ? i : i+1;
     }
-    jerasure_matrix_dotprod(k, w, matrix, tmpids, lastdrive, data_ptrs, coding_ptrs, size);
-    free(tmpids);
+  } else {
+    plan->lastdrive = -1;
   }
   
   /* Finally, re-encode any erased coding devices */
 
+  j = 0;
   for (i = 0; i < m; i++) {
     if (erased[k+i]) {
-      jerasure_matrix_dotprod(k, w, matrix+(i*k), NULL, i+k, data_ptrs, coding_ptrs, size);
+      plan->coding_ids[j] = k+i;
+      memcpy(plan->coding_rows+j*k, matrix+i*k, sizeof(int)*k);
+      j++;
     }
   }
 
+  /* Plans that are kept are executed many times, so their rows' region
+     tables are made now.  Plans for one decode skip them, since building the
+     tables costs more than they save on one pass.  Without them, a plan still
+     works, unless the regions are ALTMAP, which only the tables can multiply. */
+
+  plan->data_tables = NULL;
+  plan->coding_tables = NULL;
+  if (tables) {
+    plan->data_tables = make_region_tables(ndata, k, w, plan->data_rows, altmap);
+    plan->coding_tables = make_region_tables(ecd, k, w, plan->coding_rows, altmap);
+  }
   free(erased);
-  if (dm_ids != NULL) free(dm_ids);
-  if (decoding_matrix != NULL) free(decoding_matrix);
+  if (altmap && ((ndata > 0 && plan->data_tables == NULL) ||
+                 (ecd > 0 && plan->coding_tables == NULL))) {
+    jerasure_free_decoding_plan(plan);
+    return NULL;
+  }
+  return plan;
+}
+
+jerasure_decoding_plan *jerasure_make_decoding_plan(int k, int m, int w, int *matrix,
+                                                    int row_k_ones, int *erasures)
+{
+  return make_decoding_plan(k, m, w, matrix, row_k_ones, erasures, 1, 0);
+}
+
+jerasure_decoding_plan *jerasure_make_altmap_decoding_plan(int k, int m, int w, int *matrix,
+                                                           int row_k_ones, int *erasures)
+{
+  return make_decoding_plan(k, m, w, matrix, row_k_ones, erasures, 1, 1);
+}
+
+jerasure_decoding_plan *jerasure_make_oneshot_decoding_plan(int k, int m, int w, int *matrix,
+                                                            int row_k_ones, int *erasures)
+{
+  return make_decoding_plan(k, m, w, matrix, row_k_ones, erasures, 0, 0);
+}
+
+int jerasure_plan_decode(jerasure_decoding_plan *plan, char **data_ptrs, char **coding_ptrs, int size)
+{
+  int k, w;
+
+  k = plan->k;
+  w = plan->w;
+
+  /* All of the data drives that use the decoding matrix are decoded together, so
+     that each surviving device is only read once.  Then lastdrive, which needs
+     them, and then the coding drives, which need all of the data. */
+
+  if (plan->ndata > 0) {
+    jerasure_matrix_multi_dotprod_tables(k, w, plan->data_rows, plan->data_tables, NULL,
+                                         plan->ndata, plan->dm_ids, plan->data_ids,
+                                         data_ptrs, coding_ptrs, size);
+  }
+  if (plan->lastdrive >= 0) {
+    jerasure_matrix_dotprod(k, w, plan->last_row, plan->last_ids, plan->lastdrive,
+                            data_ptrs, coding_ptrs, size);
+  }
+  if (plan->ncoding > 0) {
+    jerasure_matrix_multi_dotprod_tables(k, w, plan->coding_rows, plan->coding_tables, NULL,
+                                         plan->ncoding, NULL, plan->coding_ids,
+                                         data_ptrs, coding_ptrs, size);
+  }
+  return 0;
+}
+
+void jerasure_free_decoding_plan(jerasure_decoding_plan *plan)
+{
+  jerasure_free_region_tables(plan->data_tables, plan->ndata*plan->k);
+  jerasure_free_region_tables(plan->coding_tables, plan->ncoding*plan->k);
+  free(plan);
+}
+
+int jerasure_matrix_decode(int k, int m, int w, int *matrix, int row_k_ones, int *erasures,
+                          char **data_ptrs, char **coding_ptrs, int size)
+{
+  jerasure_decoding_plan *plan;
+
+  plan = jerasure_make_oneshot_decoding_plan(k, m, w, matrix, row_k_ones, erasures);
+  if (plan == NULL) return -1;
+  jerasure_plan_decode(plan, data_ptrs, coding_ptrs, size);
+  jerasure_free_decoding_plan(plan);
+  return 0;
+}
 
+/* The plan cache is a small array of plans, keyed by a bitmask of the erased
+   devices, with least-recently-used replacement.  A plan that is being executed
+   holds a reference, so that another thread can't evict it out from under it. */
+
+typedef struct {
+  jerasure_decoding_plan *plan;
+  uint64_t *key;
+  int refs;
+  unsigned long last_used;
+} plan_cache_entry;
+
+struct jerasure_plan_cache {
+  int k, m, w;
+  int *matrix;
+  int row_k_ones;
+  int altmap;
+  int capacity;
+  int nkeywords;
+  uint64_t *key;          /* Scratch key, used with the lock held */
+  plan_cache_entry *entries;
+  unsigned long clock;
+  pthread_mutex_t lock;
+};
+
+jerasure_plan_cache *jerasure_generate_plan_cache(int k, int m, int w, int *matrix,
+                                                  int row_k_ones, int capacity)
+{
+  jerasure_plan_cache *cache;
+  int i;
+
+  if (w != 4 && w != 8 && w != 16 && w != 32) return NULL;
+  if (capacity <= 0) capacity = 1;
+
+  cache = talloc(jerasure_plan_cache, 1);
+  if (cache == NULL) return NULL;
+  cache->k = k;
+  cache->m = m;
+  cache->w = w;
+  cache->row_k_ones = row_k_ones;
+  cache->altmap = 0;
+  cache->capacity = capacity;
+  cache->nkeywords = (k+m+63)/64;
+  cache->clock = 0;
+  cache->matrix = talloc(int, k*m);
+  cache->key = talloc(uint64_t, cache->nkeywords*(capacity+1));
+  cache->entries = talloc(plan_cache_entry, capacity);
+  if (cache->matrix == NULL || cache->key == NULL || cache->entries == NULL) {
+    free(cache->matrix);
+    free(cache->key);
+    free(cache->entries);
+    free(cache);
+    return NULL;
+  }
+  memcpy(cache->matrix, matrix, sizeof(int)*k*m);
+  for (i = 0; i < capacity; i++) {
+    cache->entries[i].plan = NULL;
+    cache->entries[i].key = cache->key + (i+1)*cache->nkeywords;
+    cache->entries[i].refs = 0;
+    cache->entries[i].last_used = 0;
+  }
+  pthread_mutex_init(&cache->lock, NULL);
+  return cache;
+}
+
+void jerasure_free_plan_cache(jerasure_plan_cache *cache)
+{
+  int i;
+
+  for (i = 0; i < cache->capacity; i++) {
+    if (cache->entries[i].plan != NULL) jerasure_free_decoding_plan(cache->entries[i].plan);
+  }
+  pthread_mutex_destroy(&cache->lock);
+  free(cache->matrix);
+  free(cache->key);
+  free(cache->entries);
+  free(cache);
+}
+
+void jerasure_set_plan_cache_altmap(jerasure_plan_cache *cache, int altmap)
+{
+  cache->altmap = altmap;
+}
+
+/* Sets cache->key from the erasures.  Returns -1 if an id is out of range. */
+
+static int plan_cache_set_key(jerasure_plan_cache *cache, int *erasures)
+{
+  int i;
+
+  for (i = 0; i < cache->nkeywords; i++) cache->key[i] = 0;
+  for (i = 0; erasures[i] != -1; i++) {
+    if (erasures[i] < 0 || erasures[i] >= cache->k+cache->m) return -1;
+    cache->key[erasures[i]/64] |= ((uint64_t) 1 << (erasures[i]%64));
+  }
   return 0;
 }
 
+static plan_cache_entry *plan_cache_find(jerasure_plan_cache *cache)
+{
+  int i;
+
+  for (i = 0; i < cache->capacity; i++) {
+    if (cache->entries[i].plan != NULL &&
+        memcmp(cache->entries[i].key, cache->key, sizeof(uint64_t)*cache->nkeywords) == 0) {
+      return cache->entries+i;
+    }
+  }
+  return NULL;
+}
+
+int jerasure_plan_decode_cache(jerasure_plan_cache *cache, int *erasures,
+                               char **data_ptrs, char **coding_ptrs, int size)
+{
+  plan_cache_entry *entry, *victim;
+  jerasure_decoding_plan *plan;
+  int i;
+
+  pthread_mutex_lock(&cache->lock);
+  if (plan_cache_set_key(cache, erasures) < 0) {
+    pthread_mutex_unlock(&cache->lock);
+    return -1;
+  }
+  entry = plan_cache_find(cache);
+  if (entry != NULL) {
+    entry->refs++;
+    entry->last_used = ++cache->clock;
+    pthread_mutex_unlock(&cache->lock);
+
+    jerasure_plan_decode(entry->plan, data_ptrs, coding_ptrs, size);
+
+    pthread_mutex_lock(&cache->lock);
+    entry->refs--;
+    pthread_mutex_unlock(&cache->lock);
+    return 0;
+  }
+  pthread_mutex_unlock(&cache->lock);
+
+  /* Miss -- make the plan without holding the lock, then try to add it.  If another
+     thread added the same plan in the meantime, or every entry is in use, this
+     plan is simply freed when we're done with it. */
+
+  plan = make_decoding_plan(cache->k, cache->m, cache->w, cache->matrix,
+                            cache->row_k_ones, erasures, 1, cache->altmap);
+  if (plan == NULL) return -1;
+
+  pthread_mutex_lock(&cache->lock);
+  plan_cache_set_key(cache, erasures);
+  victim = NULL;
+  if (plan_cache_find(cache) == NULL) {
+    for (i = 0; i < cache->capacity; i++) {
+      entry = cache->entries+i;
+      if (entry->refs > 0) continue;
+      if (victim == NULL || entry->plan == NULL ||
+          (victim->plan != NULL && entry->last_used < victim->last_used)) {
+        victim = entry;
+      }
+      if (entry->plan == NULL) break;
+    }
+  }
+  if (victim != NULL) {
+    if (victim->plan != NULL) jerasure_free_decoding_plan(victim->plan);
+    victim->plan = plan;
+    memcpy(victim->key, cache->key, sizeof(uint64_t)*cache->nkeywords);
+    victim->refs = 1;
+    victim->last_used = ++cache->clock;
+  }
+  pthread_mutex_unlock(&cache->lock);
+
+  jerasure_plan_decode(plan, data_ptrs, coding_ptrs, size);
+
+  if (victim != NULL) {
+    pthread_mutex_lock(&cache->lock);
+    victim->refs--;
+    pthread_mutex_unlock(&cache->lock);
+  } else {
+    jerasure_free_decoding_plan(plan);
+  }
+  return 0;
+}
 
 int *jerasure_matrix_to_bitmatrix(int k, int m, int w, int *matrix) 
 {
@@ -305,27 +778,106 @@ int *jerasure_matrix_to_bitmatrix(int k, int m, int w, int *matrix)
   return bitmatrix;
 }
 
+jerasure_packed_bitmatrix *jerasure_new_packed_bitmatrix(int rows, int cols)
+{
+  jerasure_packed_bitmatrix *pb;
+
+  pb = talloc(jerasure_packed_bitmatrix, 1);
+  if (pb == NULL) return NULL;
+  pb->rows = rows;
+  pb->cols = cols;
+  pb->words = (cols+63)/64;
+  pb->bits = (uint64_t *) calloc((size_t) rows*pb->words + 1, sizeof(uint64_t));
+  if (pb->bits == NULL) {
+    free(pb);
+    return NULL;
+  }
+  return pb;
+}
+
+void jerasure_free_packed_bitmatrix(jerasure_packed_bitmatrix *pb)
+{
+  if (pb == NULL) return;
+  free(pb->bits);
+  free(pb);
+}
+
+jerasure_packed_bitmatrix *jerasure_pack_bitmatrix(int *bitmatrix, int rows, int cols)
+{
+  jerasure_packed_bitmatrix *pb;
+  uint64_t *row;
+  int i, j;
+
+  pb = jerasure_new_packed_bitmatrix(rows, cols);
+  if (pb == NULL) return NULL;
+  for (i = 0; i < rows; i++) {
+    row = PB_ROW(pb, i);
+    for (j = 0; j < cols; j++) row[j/64] |= ((uint64_t) (bitmatrix[i*cols+j] != 0) << (j%64));
+  }
+  return pb;
+}
+
+int *jerasure_unpack_bitmatrix(jerasure_packed_bitmatrix *pb)
+{
+  int *bitmatrix;
+  int i, j;
+
+  bitmatrix = talloc(int, pb->rows*pb->cols);
+  if (bitmatrix == NULL) return NULL;
+  for (i = 0; i < pb->rows; i++) {
+    for (j = 0; j < pb->cols; j++) bitmatrix[i*pb->cols+j] = PB_GET(pb, i, j);
+  }
+  return bitmatrix;
+}
+
+/* Sets the w*w block at rows r*w and columns c*w of a zeroed packed bitmatrix
+   to the bitmatrix of elt: its column x is elt * 2^x */
+
+static void pb_set_element(jerasure_packed_bitmatrix *pb, int r, int c, int elt, int w)
+{
+  int l, x;
+
+  for (x = 0; x < w; x++) {
+    for (l = 0; l < w; l++) {
+      if (elt & (1 << l)) PB_SET(pb, r*w+l, c*w+x);
+    }
+    elt = galois_single_multiply(elt, 2, w);
+  }
+}
+
+jerasure_packed_bitmatrix *jerasure_matrix_to_packed_bitmatrix(int k, int m, int w, int *matrix)
+{
+  jerasure_packed_bitmatrix *pb;
+  int i, j;
+
+  if (matrix == NULL) return NULL;
+  pb = jerasure_new_packed_bitmatrix(m*w, k*w);
+  if (pb == NULL) return NULL;
+
+  for (i = 0; i < m; i++) {
+    for (j = 0; j < k; j++) pb_set_element(pb, i, j, matrix[i*k+j], w);
+  }
+  return pb;
+}
+
 void jerasure_matrix_encode(int k, int m, int w, int *matrix,
                           char **data_ptrs, char **coding_ptrs, int size)
 {
-  int i;
-  
-  if (w != 8 && w != 16 && w != 32) {
-    fprintf(stderr, "ERROR: jerasure_matrix_encode() and w is not 8, 16 or 32\n");
+  if (w != 4 && w != 8 && w != 16 && w != 32) {
+    fprintf(stderr, "ERROR: jerasure_matrix_encode() and w is not 4, 8, 16 or 32\n");
     assert(0);
   }
 
-  for (i = 0; i < m; i++) {
-    jerasure_matrix_dotprod(k, w, matrix+(i*k), NULL, k+i, data_ptrs, coding_ptrs, size);
-  }
+  jerasure_matrix_multi_dotprod(k, w, matrix, NULL, m, NULL, NULL, data_ptrs, coding_ptrs, size);
 }
 
 void jerasure_bitmatrix_dotprod(int k, int w, int *bitmatrix_row,
                              int *src_ids, int dest_id,
                              char **data_ptrs, char **coding_ptrs, int size, int packetsize)
 {
-  int j, sindex, pstarted, index, x, y;
-  char *dptr, *pptr, *bdptr, *bpptr;
+  int j, sindex, pstarted, index, x, y, nsrc;
+  char *pptr, *bdptr, *bpptr;
+  char *srcs[XOR_BATCH];
 
   if (size%(w*packetsize) != 0) {
     fprintf(stderr, "jerasure_bitmatrix_dotprod - size%c(w*packetsize)) must = 0\n", '%');
@@ -338,6 +890,7 @@ void jerasure_bitmatrix_dotprod(int k, int w, int *bitmatrix_row,
     index = 0;
     for (j = 0; j < w; j++) {
       pstarted = 0;
+      nsrc = 0;
       pptr = bpptr + sindex + j*packetsize;
       for (x = 0; x < k; x++) {
         if (src_ids == NULL) {
@@ -349,41 +902,168 @@ void jerasure_bitmatrix_dotprod(int k, int w, int *bitmatrix_row,
         }
         for (y = 0; y < w; y++) {
           if (bitmatrix_row[index]) {
-            dptr = bdptr + sindex + y*packetsize;
-            if (!pstarted) {
-              memcpy(pptr, dptr, packetsize);
-              jerasure_total_memcpy_bytes += packetsize;
+            if (nsrc == XOR_BATCH) {
+              xor_batch(srcs, nsrc, pptr, packetsize, pstarted);
               pstarted = 1;
-            } else {
-              galois_region_xor(dptr, pptr, packetsize);
-              jerasure_total_xor_bytes += packetsize;
+              nsrc = 0;
             }
+            srcs[nsrc++] = bdptr + sindex + y*packetsize;
           }
           index++;
         }
       }
+      if (nsrc > 0) xor_batch(srcs, nsrc, pptr, packetsize, pstarted);
     }
   }
 }
 
-void jerasure_do_parity(int k, char **data_ptrs, char *parity_ptr, int size) 
+void jerasure_packed_bitmatrix_dotprod(int k, int w, jerasure_packed_bitmatrix *pb, int row,
+                                       int *src_ids, int dest_id,
+                                       char **data_ptrs, char **coding_ptrs, int size, int packetsize)
 {
-  int i;
+  int i, j, b, x, sindex, pstarted, nsrc;
+  char *pptr, *bpptr, *bdptr;
+  char *sptrs[XOR_BATCH];
+  const uint64_t *rb;
+  uint64_t bits;
 
-  memcpy(parity_ptr, data_ptrs[0], size);
-  jerasure_total_memcpy_bytes += size;
-  
-  for (i = 1; i < k; i++) {
-    galois_region_xor(data_ptrs[i], parity_ptr, size);
-    jerasure_total_xor_bytes += size;
+  if (size%(w*packetsize) != 0) {
+    fprintf(stderr, "jerasure_packed_bitmatrix_dotprod - size%c(w*packetsize)) must = 0\n", '%');
+    assert(0);
   }
-}
 
-int jerasure_invert_matrix(int *mat, int *inv, int rows, int w)
+  bpptr = (dest_id < k) ? data_ptrs[dest_id] : coding_ptrs[dest_id-k];
+
+  for (sindex = 0; sindex < size; sindex += (packetsize*w)) {
+    for (j = 0; j < w; j++) {
+      pstarted = 0;
+      nsrc = 0;
+      pptr = bpptr + sindex + j*packetsize;
+      rb = PB_ROW(pb, row+j);
+      for (i = 0; i < pb->words; i++) {
+        for (bits = rb[i]; bits != 0; bits &= bits-1) {
+          b = i*64 + __builtin_ctzll(bits);
+          if (nsrc == XOR_BATCH) {
+            xor_batch(sptrs, nsrc, pptr, packetsize, pstarted);
+            pstarted = 1;
+            nsrc = 0;
+          }
+          x = b/w;
+          if (src_ids == NULL) {
+            bdptr = data_ptrs[x];
+          } else if (src_ids[x] < k) {
+            bdptr = data_ptrs[src_ids[x]];
+          } else {
+            bdptr = coding_ptrs[src_ids[x]-k];
+          }
+          sptrs[nsrc++] = bdptr + sindex + (b%w)*packetsize;
+        }
+      }
+      if (nsrc > 0) xor_batch(sptrs, nsrc, pptr, packetsize, pstarted);
+    }
+  }
+}
+
+void jerasure_do_parity(int k, char **data_ptrs, char *parity_ptr, int size) 
+{
+  galois_region_xor_multi(data_ptrs, k, parity_ptr, size, 0);
+  STATS_ADD(STATS_MEMCPY, size);
+  STATS_ADD(STATS_XOR, (uint64_t) (k-1)*size);
+}
+
+/* For w <= 16, matrices are inverted with the field's log tables, and not
+   galois_single_multiply.  The logs of the pivot row are taken once, so each
+   element of a row operation is two loads and an XOR, and since log[0] indexes
+   zeros in antilog, there's no test for zero.  This is Gauss-Jordan: the pivot
+   column is cleared from every other row, or from the rows below it when inv is
+   NULL, which is all that jerasure_invertible_matrix needs.  Lrow holds 2*rows
+   ints.  Returns -1 if the matrix isn't invertible. */
+
+static int log_invert_matrix(int *mat, int *inv, int rows, int w, int *lrow)
+{
+  const uint32_t *lg;
+  const uint16_t *alg;
+  int i, j, x, n, lp, lc, tmp;
+  int *mi, *mj, *ii, *ij, *linv;
+
+  galois_log_tables(w, &lg, &alg);
+  n = (1 << w) - 1;
+  linv = lrow + rows;
+
+  if (inv != NULL) {
+    for (i = 0; i < rows*rows; i++) inv[i] = (i/rows == i%rows);
+  }
+
+  for (i = 0; i < rows; i++) {
+    mi = mat + i*rows;
+    ii = (inv == NULL) ? NULL : inv + i*rows;
+
+    if (mi[i] == 0) {
+      for (j = i+1; j < rows && mat[j*rows+i] == 0; j++) ;
+      if (j == rows) return -1;
+      mj = mat + j*rows;
+      for (x = 0; x < rows; x++) {
+        tmp = mi[x]; mi[x] = mj[x]; mj[x] = tmp;
+      }
+      if (inv != NULL) {
+        ij = inv + j*rows;
+        for (x = 0; x < rows; x++) {
+          tmp = ii[x]; ii[x] = ij[x]; ij[x] = tmp;
+        }
+      }
+    }
+
+    /* Divide the row by element i,i, and take its logs.  The columns left of
+       i are zero in the pivot row. */
+
+    lp = n - lg[mi[i]];
+    for (x = i; x < rows; x++) {
+      mi[x] = alg[lg[mi[x]]+lp];
+      lrow[x] = lg[mi[x]];
+    }
+    if (inv != NULL) {
+      for (x = 0; x < rows; x++) {
+        ii[x] = alg[lg[ii[x]]+lp];
+        linv[x] = lg[ii[x]];
+      }
+    }
+
+    for (j = (inv == NULL) ? i+1 : 0; j < rows; j++) {
+      mj = mat + j*rows;
+      if (j == i || mj[i] == 0) continue;
+      lc = lg[mj[i]];
+      for (x = i; x < rows; x++) mj[x] ^= alg[lc+lrow[x]];
+      if (inv != NULL) {
+        ij = inv + j*rows;
+        for (x = 0; x < rows; x++) ij[x] ^= alg[lc+linv[x]];
+      }
+    }
+  }
+  return 0;
+}
+
+static int *log_invert_scratch(int rows, int w)
+{
+  const uint32_t *lg;
+  const uint16_t *alg;
+
+  if (w > GALOIS_LOG_MAX_W || galois_log_tables(w, &lg, &alg) < 0) return NULL;
+  return talloc(int, 2*rows);
+}
+
+int jerasure_invert_matrix(int *mat, int *inv, int rows, int w)
 {
   int cols, i, j, k, x, rs2;
   int row_start, tmp, inverse;
+  int *lrow;
  
+  lrow = log_invert_scratch(rows, w);
+  if (lrow != NULL) {
+    i = log_invert_matrix(mat, inv, rows, w, lrow);
+    free(lrow);
+    return i;
+  }
+
   cols = rows;
 
   k = 0;
@@ -470,7 +1150,15 @@ int jerasure_invertible_matrix(int *mat, int rows, int w)
 {
   int cols, i, j, k, x, rs2;
   int row_start, tmp, inverse;
+  int *lrow;
  
+  lrow = log_invert_scratch(rows, w);
+  if (lrow != NULL) {
+    i = log_invert_matrix(mat, NULL, rows, w, lrow);
+    free(lrow);
+    return (i == 0);
+  }
+
   cols = rows;
 
   /* First -- convert into upper triangular  */
@@ -584,45 +1272,117 @@ void jerasure_matrix_dotprod(int k, int w, int *matrix_row,
                           int *src_ids, int dest_id,
                           char **data_ptrs, char **coding_ptrs, int size)
 {
-  int init;
-  char *dptr, *sptr;
-  int i;
-
-  if (w != 1 && w != 8 && w != 16 && w != 32) {
-    fprintf(stderr, "ERROR: jerasure_matrix_dotprod() called and w is not 1, 8, 16 or 32\n");
+  if (w != 1 && w != 4 && w != 8 && w != 16 && w != 32) {
+    fprintf(stderr, "ERROR: jerasure_matrix_dotprod() called and w is not 1, 4, 8, 16 or 32\n");
     assert(0);
   }
 
-  init = 0;
+  jerasure_matrix_multi_dotprod(k, w, matrix_row, NULL, 1, src_ids, &dest_id,
+                                data_ptrs, coding_ptrs, size);
+}
 
-  dptr = (dest_id < k) ? data_ptrs[dest_id] : coding_ptrs[dest_id-k];
+/* The dot products work through the regions one tile at a time: every source is
+   folded into a tile of each destination before moving on to the next tile.  That
+   way a destination tile is read and written in cache rather than making a round
+   trip to memory for every source.  A tile size of zero means the whole region. */
 
-  /* First copy or xor any data that does not need to be multiplied by a factor */
+#define JERASURE_DEFAULT_TILE_SIZE (16*1024)
 
-  for (i = 0; i < k; i++) {
-    if (matrix_row[i] == 1) {
-      if (src_ids == NULL) {
-        sptr = data_ptrs[i];
-      } else if (src_ids[i] < k) {
-        sptr = data_ptrs[src_ids[i]];
-      } else {
-        sptr = coding_ptrs[src_ids[i]-k];
-      }
-      if (init == 0) {
-        memcpy(dptr, sptr, size);
-        jerasure_total_memcpy_bytes += size;
-        init = 1;
-      } else {
-        galois_region_xor(sptr, dptr, size);
-        jerasure_total_xor_bytes += size;
-      }
+static int jerasure_tile_size = JERASURE_DEFAULT_TILE_SIZE;
+
+void jerasure_set_tile_size(int tile_size)
+{
+  if (tile_size <= 0) {
+    jerasure_tile_size = 0;
+  } else {
+    jerasure_tile_size = (tile_size + 63) & ~63;
+  }
+}
+
+int jerasure_get_tile_size()
+{
+  return jerasure_tile_size;
+}
+
+static void region_multiply_add(int w, char *sptr, int multby, char *dptr, int nbytes, int add)
+{
+  switch (w) {
+    case 4:  galois_w04_region_multiply(sptr, multby, nbytes, dptr, add); break;
+    case 8:  galois_w08_region_multiply(sptr, multby, nbytes, dptr, add); break;
+    case 16: galois_w16_region_multiply(sptr, multby, nbytes, dptr, add); break;
+    case 32: galois_w32_region_multiply(sptr, multby, nbytes, dptr, add); break;
+  }
+}
+
+static galois_region_table **make_region_tables(int rows, int cols, int w, int *matrix,
+                                                int altmap)
+{
+  galois_region_table **tables;
+  int i;
+
+  if (w != 4 && w != 8 && w != 16 && w != 32) return NULL;
+  tables = (galois_region_table **) calloc(rows*cols, sizeof(galois_region_table *));
+  if (tables == NULL) return NULL;
+  for (i = 0; i < rows*cols; i++) {
+    if (matrix[i] == 0 || matrix[i] == 1) continue;
+    tables[i] = (altmap) ? galois_make_altmap_region_table(w, matrix[i]) :
+                           galois_make_region_table(w, matrix[i]);
+    if (tables[i] == NULL) {
+      jerasure_free_region_tables(tables, rows*cols);
+      return NULL;
     }
   }
+  return tables;
+}
 
-  /* Now do the data that needs to be multiplied by a factor */
+galois_region_table **jerasure_matrix_to_region_tables(int rows, int cols, int w, int *matrix)
+{
+  return make_region_tables(rows, cols, w, matrix, 0);
+}
 
-  for (i = 0; i < k; i++) {
-    if (matrix_row[i] != 0 && matrix_row[i] != 1) {
+galois_region_table **jerasure_matrix_to_altmap_region_tables(int rows, int cols, int w,
+                                                              int *matrix)
+{
+  return make_region_tables(rows, cols, w, matrix, 1);
+}
+
+void jerasure_free_region_tables(galois_region_table **tables, int n)
+{
+  int i;
+
+  if (tables == NULL) return;
+  for (i = 0; i < n; i++) galois_free_region_table(tables[i]);
+  free(tables);
+}
+
+void jerasure_matrix_multi_dotprod(int k, int w, int *matrix, int *row_ids, int nrows,
+                                int *src_ids, int *dest_ids,
+                                char **data_ptrs, char **coding_ptrs, int size)
+{
+  jerasure_matrix_multi_dotprod_tables(k, w, matrix, NULL, row_ids, nrows, src_ids, dest_ids,
+                                       data_ptrs, coding_ptrs, size);
+}
+
+void jerasure_matrix_multi_dotprod_tables(int k, int w, int *matrix, galois_region_table **tables,
+                                          int *row_ids, int nrows, int *src_ids, int *dest_ids,
+                                          char **data_ptrs, char **coding_ptrs, int size)
+{
+  int i, j, r, row, dest_id, init, tile, slice, offset;
+  int *matrix_row;
+  char *sptr, *dptr;
+
+  if (w != 1 && w != 4 && w != 8 && w != 16 && w != 32) {
+    fprintf(stderr, "ERROR: jerasure_matrix_multi_dotprod() called and w is not 1, 4, 8, 16 or 32\n");
+    assert(0);
+  }
+
+  tile = (jerasure_tile_size > 0) ? jerasure_tile_size : size;
+
+  for (offset = 0; offset < size; offset += slice) {
+    slice = size - offset;
+    if (slice > tile) slice = tile;
+
+    for (i = 0; i < k; i++) {
       if (src_ids == NULL) {
         sptr = data_ptrs[i];
       } else if (src_ids[i] < k) {
@@ -630,13 +1390,38 @@ void jerasure_matrix_dotprod(int k, int w, int *matrix_row,
       } else {
         sptr = coding_ptrs[src_ids[i]-k];
       }
-      switch (w) {
-        case 8:  galois_w08_region_multiply(sptr, matrix_row[i], size, dptr, init); break;
-        case 16: galois_w16_region_multiply(sptr, matrix_row[i], size, dptr, init); break;
-        case 32: galois_w32_region_multiply(sptr, matrix_row[i], size, dptr, init); break;
+      sptr += offset;
+
+      for (r = 0; r < nrows; r++) {
+        row = (row_ids == NULL) ? r : row_ids[r];
+        matrix_row = matrix + row*k;
+        if (matrix_row[i] == 0) continue;
+
+        dest_id = (dest_ids == NULL) ? k+row : dest_ids[r];
+        dptr = (dest_id < k) ? data_ptrs[dest_id] : coding_ptrs[dest_id-k];
+        dptr += offset;
+
+        /* The first source with a non-zero coefficient initializes the destination */
+
+        init = 0;
+        for (j = 0; j < i && !init; j++) init = (matrix_row[j] != 0);
+
+        if (matrix_row[i] == 1) {
+          if (!init) {
+            memcpy(dptr, sptr, slice);
+            STATS_ADD(STATS_MEMCPY, slice);
+          } else {
+            galois_region_xor(sptr, dptr, slice);
+            STATS_ADD(STATS_XOR, slice);
+          }
+        } else if (tables != NULL && tables[row*k+i] != NULL) {
+          galois_table_region_multiply(tables[row*k+i], sptr, slice, dptr, init);
+          STATS_ADD(STATS_GF, slice);
+        } else {
+          region_multiply_add(w, sptr, matrix_row[i], dptr, slice, init);
+          STATS_ADD(STATS_GF, slice);
+        }
       }
-      jerasure_total_gf_bytes += size;
-      init = 1;
     }
   }
 }
@@ -730,21 +1515,35 @@ int jerasure_bitmatrix_decode(int k, int m, int w, int *bitmatrix, int row_k_one
   return 0;
 }
 
-static char **set_up_ptrs_for_scheduled_decoding(int k, int m, int *erasures, char **data_ptrs, char **coding_ptrs)
+static int is_erased(int id, int *erasures)
 {
-  int ddf, cdf;
-  int *erased;
-  char **ptrs;
-  int i, j, x;
+  int i;
 
-  ddf = 0;
-  cdf = 0;
+  for (i = 0; erasures[i] != -1; i++) if (erasures[i] == id) return 1;
+  return 0;
+}
+
+/* Returns the number of different devices in erasures */
+
+static int n_erased(int *erasures)
+{
+  int i, j, n;
+
+  n = 0;
   for (i = 0; erasures[i] != -1; i++) {
-    if (erasures[i] < k) ddf++; else cdf++;
+    for (j = 0; j < i && erasures[j] != erasures[i]; j++) ;
+    if (j == i) n++;
   }
-  
-  erased = jerasure_erasures_to_erased(k, m, erasures);
-  if (erased == NULL) return NULL;
+  return n;
+}
+
+/* Fills in the k+m pointers of ptrs for decoding with a schedule.  It doesn't
+   allocate anything -- erased devices are found by scanning erasures. */
+
+static void fill_ptrs_for_scheduled_decoding(int k, int m, int *erasures, char **data_ptrs,
+                                             char **coding_ptrs, char **ptrs)
+{
+  int i, j, x;
 
   /* Set up ptrs.  It will be as follows:
 
@@ -760,19 +1559,13 @@ static char **set_up_ptrs_for_scheduled_decoding(int k, int m, int *erasures, ch
        However, we're going to set row_ids and ind_to_row in a different procedure.
    */
          
-  ptrs = talloc(char *, k+m);
-  if (!ptrs) {
-    free(erased);
-    return NULL;
-  }
-
   j = k;
   x = k;
   for (i = 0; i < k; i++) {
-    if (erased[i] == 0) {
+    if (!is_erased(i, erasures)) {
       ptrs[i] = data_ptrs[i];
     } else {
-      while (erased[j]) j++;
+      while (is_erased(j, erasures)) j++;
       ptrs[i] = coding_ptrs[j-k];
       j++;
       ptrs[x] = data_ptrs[i];
@@ -780,15 +1573,75 @@ static char **set_up_ptrs_for_scheduled_decoding(int k, int m, int *erasures, ch
     }
   }
   for (i = k; i < k+m; i++) {
-    if (erased[i]) {
+    if (is_erased(i, erasures)) {
       ptrs[x] = coding_ptrs[i-k];
       x++;
     }
   }
-  free(erased);
+}
+
+static char **set_up_ptrs_for_scheduled_decoding(int k, int m, int *erasures, char **data_ptrs, char **coding_ptrs)
+{
+  char **ptrs;
+
+  if (n_erased(erasures) > m) return NULL;
+
+  /* ptrs[k+m] is for the temporaries of CSE schedules */
+
+  ptrs = talloc(char *, k+m+1);
+  if (!ptrs) return NULL;
+  fill_ptrs_for_scheduled_decoding(k, m, erasures, data_ptrs, coding_ptrs, ptrs);
   return ptrs;
 }
 
+/* Schedules from the CSE scheduler keep their temporaries on device k+m, in
+   packets 0 to ntemps-1.  They are the same packets for each stripe, so that
+   device is not advanced along with the others.  The number of temporaries
+   is stored when the schedule is made, in its last operation: that is
+   -1-ntemps, so schedules without temporaries still end with -1. */
+
+int jerasure_schedule_ntemps(int **schedule)
+{
+  int i;
+
+  for (i = 0; schedule[i][0] >= 0; i++) ;
+  return -1 - schedule[i][0];
+}
+
+/* ptrs must have room for k+m+1 pointers, and temps for the schedule's
+   temporaries */
+
+static void run_scheduled_stripes(int k, int m, int w, int **schedule, char **ptrs, char *temps,
+                                  int size, int packetsize)
+{
+  int i, tdone;
+
+  ptrs[k+m] = temps;
+  for (tdone = 0; tdone < size; tdone += packetsize*w) {
+    jerasure_do_scheduled_operations(ptrs, schedule, packetsize);
+    for (i = 0; i < k+m; i++) ptrs[i] += (packetsize*w);
+  }
+}
+
+/* The same, allocating the temporaries if there are any */
+
+static int do_scheduled_stripes(int k, int m, int w, int **schedule, char **ptrs,
+                                int size, int packetsize)
+{
+  char *temps;
+  int ntemps;
+
+  ntemps = jerasure_schedule_ntemps(schedule);
+  temps = NULL;
+  if (ntemps > 0) {
+    temps = talloc(char, ntemps*packetsize);
+    if (temps == NULL) return -1;
+  }
+  run_scheduled_stripes(k, m, w, schedule, ptrs, temps, size, packetsize);
+  free(temps);
+  return 0;
+}
+
 static int set_up_ids_for_scheduled_decoding(int k, int m, int *erasures, int *row_ids, int *ind_to_row)
 {
   int ddf, cdf;
@@ -833,17 +1686,79 @@ static int set_up_ids_for_scheduled_decoding(int k, int m, int *erasures, int *r
   return 0;
 }
 
-static int **jerasure_generate_decoding_schedule(int k, int m, int w, int *bitmatrix, int *erasures, int smart)
+int jerasure_scheduled_decoding_ids(int k, int m, int *erasures, int *ids)
+{
+  int *ind_to_row;
+  int ret;
+
+  ind_to_row = talloc(int, k+m);
+  if (ind_to_row == NULL) return -1;
+  ret = set_up_ids_for_scheduled_decoding(k, m, erasures, ids, ind_to_row);
+  free(ind_to_row);
+  return ret;
+}
+
+int **jerasure_generate_decoding_schedule(int k, int m, int w, int *bitmatrix, int *erasures, int smart)
+{
+  jerasure_packed_bitmatrix *pb;
+  int **schedule;
+
+  pb = jerasure_pack_bitmatrix(bitmatrix, m*w, k*w);
+  if (pb == NULL) return NULL;
+  schedule = jerasure_generate_packed_decoding_schedule(k, m, w, pb, erasures, smart);
+  jerasure_free_packed_bitmatrix(pb);
+  return schedule;
+}
+
+/* Fills in the first ddf*w rows of the decoding bitmatrix, which decode the
+   erased data devices row_ids[k..k+ddf-1], from the GF rows that rows()
+   makes.  Its dm_ids are the same survivors as row_ids[0..k-1], so survivor
+   dm_ids[j] goes in column block ind_to_row[dm_ids[j]]. */
+
+static int decoding_rows_to_packed(int k, int m, int w, int ddf, int *erasures, int *row_ids,
+                                   int *ind_to_row, jerasure_decoding_rows_func rows, void *arg,
+                                   jerasure_packed_bitmatrix *real_decoding_matrix)
+{
+  int *erased, *gfrows, *dm_ids;
+  int i, j, ret;
+
+  erased = (int *) calloc(k+m, sizeof(int));
+  gfrows = talloc(int, ddf*k);
+  dm_ids = talloc(int, k);
+  ret = -1;
+  if (erased != NULL && gfrows != NULL && dm_ids != NULL) {
+    for (i = 0; erasures[i] != -1; i++) erased[erasures[i]] = 1;
+    ret = rows(arg, erased, ddf, row_ids+k, gfrows, dm_ids);
+  }
+  if (ret == 0) {
+    for (i = 0; i < ddf; i++) {
+      for (j = 0; j < k; j++) {
+        pb_set_element(real_decoding_matrix, i, ind_to_row[dm_ids[j]], gfrows[i*k+j], w);
+      }
+    }
+  }
+  free(erased);
+  free(gfrows);
+  free(dm_ids);
+  return ret;
+}
+
+static int **generate_packed_decoding_schedule(int k, int m, int w, jerasure_packed_bitmatrix *pb,
+                                               int *erasures, int smart,
+                                               jerasure_decoding_rows_func rows, void *arg)
 {
-  int i, j, x, drive, y, index, z;
-  int *decoding_matrix, *inverse, *real_decoding_matrix;
-  int *ptr;
+  int i, j, x, y, drive, words, ok;
+  jerasure_packed_bitmatrix *decoding_matrix, *inverse, *real_decoding_matrix;
+  uint64_t *dst;
+  const uint64_t *src;
   int *row_ids;
   int *ind_to_row;
   int ddf, cdf;
   int **schedule;
-  int *b1, *b2;
  
+  if (pb->rows != m*w || pb->cols != k*w) return NULL;
+  words = pb->words;
+
  /* First, figure out the number of data drives that have failed, and the
     number of coding drives that have failed: ddf and cdf */
 
@@ -872,7 +1787,7 @@ static int **jerasure_generate_decoding_schedule(int k, int m, int w, int *bitma
      will do a good job.    This matrix has w*e rows, where e is the
      number of erasures (ddf+cdf) */
 
-  real_decoding_matrix = talloc(int, k*w*(cdf+ddf)*w);
+  real_decoding_matrix = jerasure_new_packed_bitmatrix((cdf+ddf)*w, k*w);
   if (!real_decoding_matrix) {
     free(row_ids);
     free(ind_to_row);
@@ -881,51 +1796,39 @@ static int **jerasure_generate_decoding_schedule(int k, int m, int w, int *bitma
 
   /* First, if any data drives have failed, then initialize the first
      ddf*w rows of the decoding matrix from the standard decoding
-     matrix inversion */
-
-  if (ddf > 0) {
-    
-    decoding_matrix = talloc(int, k*k*w*w);
-    if (!decoding_matrix) {
-      free(row_ids);
-      free(ind_to_row);
-      return NULL;
+     matrix inversion, unless there is a closed form for them */
+
+  if (ddf > 0 && (rows == NULL ||
+                  decoding_rows_to_packed(k, m, w, ddf, erasures, row_ids, ind_to_row,
+                                          rows, arg, real_decoding_matrix) < 0)) {
+    decoding_matrix = jerasure_new_packed_bitmatrix(k*w, k*w);
+    inverse = jerasure_new_packed_bitmatrix(k*w, k*w);
+    ok = (decoding_matrix != NULL && inverse != NULL);
+    if (ok) {
+      for (i = 0; i < k; i++) {
+        if (row_ids[i] == i) {
+          for (x = 0; x < w; x++) PB_SET(decoding_matrix, i*w+x, i*w+x);
+        } else {
+          memcpy(PB_ROW(decoding_matrix, i*w), PB_ROW(pb, (row_ids[i]-k)*w),
+                 sizeof(uint64_t)*w*words);
+        }
+      }
+      ok = (jerasure_invert_packed_bitmatrix(decoding_matrix, inverse) == 0);
     }
-    ptr = decoding_matrix;
-    for (i = 0; i < k; i++) {
-      if (row_ids[i] == i) {
-        bzero(ptr, k*w*w*sizeof(int));
-        for (x = 0; x < w; x++) {
-          ptr[x+i*w+x*k*w] = 1;
-        } 
-      } else {
-        memcpy(ptr, bitmatrix+k*w*w*(row_ids[i]-k), k*w*w*sizeof(int));
+    if (ok) {
+      for (i = 0; i < ddf; i++) {
+        memcpy(PB_ROW(real_decoding_matrix, i*w), PB_ROW(inverse, row_ids[k+i]*w),
+               sizeof(uint64_t)*w*words);
       }
-      ptr += (k*w*w);
     }
-    inverse = talloc(int, k*k*w*w);
-    if (!inverse) {
+    jerasure_free_packed_bitmatrix(decoding_matrix);
+    jerasure_free_packed_bitmatrix(inverse);
+    if (!ok) {
       free(row_ids);
       free(ind_to_row);
-      free(decoding_matrix);
+      jerasure_free_packed_bitmatrix(real_decoding_matrix);
       return NULL;
     }
-    jerasure_invert_bitmatrix(decoding_matrix, inverse, k*w);
-
-/*    printf("\nMatrix to invert\n");
-    jerasure_print_bitmatrix(decoding_matrix, k*w, k*w, w);
-    printf("\n");
-    printf("\nInverse\n");
-    jerasure_print_bitmatrix(inverse, k*w, k*w, w);
-    printf("\n"); */
-
-    free(decoding_matrix);
-    ptr = real_decoding_matrix;
-    for (i = 0; i < ddf; i++) {
-      memcpy(ptr, inverse+k*w*w*row_ids[k+i], sizeof(int)*k*w*w);
-      ptr += (k*w*w);
-    }
-    free(inverse);
   } 
 
   /* Next, here comes the hard part.  For each coding node that needs
@@ -937,35 +1840,32 @@ static int **jerasure_generate_decoding_schedule(int k, int m, int w, int *bitma
      whereever there is a one in the distribution matrix, you XOR
      in the corresponding row from the failed data node's entry in
      the decoding matrix.  The whole process kind of makes my head
-     spin, but it works.
+     spin, but it works.  With packed rows, each XOR is a row of words.
    */
 
   for (x = 0; x < cdf; x++) {
     drive = row_ids[x+ddf+k]-k;
-    ptr = real_decoding_matrix + k*w*w*(ddf+x);
-    memcpy(ptr, bitmatrix+drive*k*w*w, sizeof(int)*k*w*w);
+    memcpy(PB_ROW(real_decoding_matrix, (ddf+x)*w), PB_ROW(pb, drive*w), sizeof(uint64_t)*w*words);
 
-    for (i = 0; i < k; i++) {
-      if (row_ids[i] != i) {
-        for (j = 0; j < w; j++) {
-          bzero(ptr+j*k*w+i*w, sizeof(int)*w);
+    for (j = 0; j < w; j++) {
+      dst = PB_ROW(real_decoding_matrix, (ddf+x)*w+j);
+      for (i = 0; i < k; i++) {
+        if (row_ids[i] != i) {
+          for (y = 0; y < w; y++) dst[(i*w+y)/64] &= ~(1ULL << ((i*w+y)%64));
         }
-      }  
+      }
     }
 
     /* There's the yucky part */
 
-    index = drive*k*w*w;
     for (i = 0; i < k; i++) {
       if (row_ids[i] != i) {
-        b1 = real_decoding_matrix+(ind_to_row[i]-k)*k*w*w;
         for (j = 0; j < w; j++) {
-          b2 = ptr + j*k*w;
+          dst = PB_ROW(real_decoding_matrix, (ddf+x)*w+j);
           for (y = 0; y < w; y++) {
-            if (bitmatrix[index+j*k*w+i*w+y]) {
-              for (z = 0; z < k*w; z++) {
-                b2[z] = b2[z] ^ b1[z+y*k*w];
-              }
+            if (PB_GET(pb, drive*w+j, i*w+y)) {
+              src = PB_ROW(real_decoding_matrix, (ind_to_row[i]-k)*w+y);
+              pb_xor_row(dst, src, words);
             }
           }
         }
@@ -973,26 +1873,31 @@ static int **jerasure_generate_decoding_schedule(int k, int m, int w, int *bitma
     }
   }
 
-/*
-  printf("\n\nReal Decoding Matrix\n\n");
-  jerasure_print_bitmatrix(real_decoding_matrix, (ddf+cdf)*w, k*w, w);
-  printf("\n"); */
-  if (smart) {
-    schedule = jerasure_smart_bitmatrix_to_schedule(k, ddf+cdf, w, real_decoding_matrix);
+  if (smart == JERASURE_SCHEDULE_CSE) {
+    schedule = cse_bitmatrix_to_schedule(k, (ddf+cdf)*w, w, real_decoding_matrix->bits, words,
+                                         k+m, NULL);
+  } else if (smart) {
+    schedule = smart_bitmatrix_to_schedule(k, ddf+cdf, w, real_decoding_matrix->bits, words);
   } else {
-    schedule = jerasure_dumb_bitmatrix_to_schedule(k, ddf+cdf, w, real_decoding_matrix);
+    schedule = dumb_bitmatrix_to_schedule(k, ddf+cdf, w, real_decoding_matrix->bits, words);
   }
   free(row_ids);
   free(ind_to_row);
-  free(real_decoding_matrix);
+  jerasure_free_packed_bitmatrix(real_decoding_matrix);
   return schedule;
 }
 
+int **jerasure_generate_packed_decoding_schedule(int k, int m, int w, jerasure_packed_bitmatrix *pb,
+                                                 int *erasures, int smart)
+{
+  return generate_packed_decoding_schedule(k, m, w, pb, erasures, smart, NULL, NULL);
+}
+
 int jerasure_schedule_decode_lazy(int k, int m, int w, int *bitmatrix, int *erasures,
                             char **data_ptrs, char **coding_ptrs, int size, int packetsize, 
                             int smart)
 {
-  int i, tdone;
+  int ret;
   char **ptrs;
   int **schedule;
  
@@ -1005,46 +1910,60 @@ int jerasure_schedule_decode_lazy(int k, int m, int w, int *bitmatrix, int *eras
     return -1;
   }
 
-  for (tdone = 0; tdone < size; tdone += packetsize*w) {
-  jerasure_do_scheduled_operations(ptrs, schedule, packetsize);
-    for (i = 0; i < k+m; i++) ptrs[i] += (packetsize*w);
-  }
+  ret = do_scheduled_stripes(k, m, w, schedule, ptrs, size, packetsize);
 
   jerasure_free_schedule(schedule);
   free(ptrs);
 
-  return 0;
+  return ret;
 }
 
-int jerasure_schedule_decode_cache(int k, int m, int w, int ***scache, int *erasures,
-                            char **data_ptrs, char **coding_ptrs, int size, int packetsize)
+static int **schedule_cache_lookup(int k, int m, int ***scache, int *erasures)
 {
-  int i, tdone;
-  char **ptrs;
-  int **schedule;
   int index;
- 
+
+  if (erasures[0] == -1) return NULL;
   if (erasures[1] == -1) {
     index = erasures[0]*(k+m) + erasures[0];
   } else if (erasures[2] == -1) {
     index = erasures[0]*(k+m) + erasures[1];
   } else {
-    return -1;
+    return NULL;
   }
+  return scache[index];
+}
 
-  schedule = scache[index];
+int jerasure_schedule_decode_cache(int k, int m, int w, int ***scache, int *erasures,
+                            char **data_ptrs, char **coding_ptrs, int size, int packetsize)
+{
+  char **ptrs;
+  int **schedule;
+  int ret;
+ 
+  schedule = schedule_cache_lookup(k, m, scache, erasures);
+  if (schedule == NULL) return -1;
 
   ptrs = set_up_ptrs_for_scheduled_decoding(k, m, erasures, data_ptrs, coding_ptrs);
   if (ptrs == NULL) return -1;
 
-
-  for (tdone = 0; tdone < size; tdone += packetsize*w) {
-  jerasure_do_scheduled_operations(ptrs, schedule, packetsize);
-    for (i = 0; i < k+m; i++) ptrs[i] += (packetsize*w);
-  }
+  ret = do_scheduled_stripes(k, m, w, schedule, ptrs, size, packetsize);
 
   free(ptrs);
 
+  return ret;
+}
+
+int jerasure_schedule_decode_cache_scratch(int k, int m, int w, int ***scache, int *erasures,
+                                           char **data_ptrs, char **coding_ptrs, int size,
+                                           int packetsize, char **ptrs, char *temps)
+{
+  int **schedule;
+
+  schedule = schedule_cache_lookup(k, m, scache, erasures);
+  if (schedule == NULL) return -1;
+
+  fill_ptrs_for_scheduled_decoding(k, m, erasures, data_ptrs, coding_ptrs, ptrs);
+  run_scheduled_stripes(k, m, w, schedule, ptrs, temps, size, packetsize);
   return 0;
 }
 
@@ -1084,98 +2003,477 @@ int ***jerasure_generate_schedule_cache(int k, int m, int w, int *bitmatrix, int
 
 }
 
-int jerasure_invert_bitmatrix(int *mat, int *inv, int rows)
+/* The lazy schedule cache works for any m.  Schedules are generated the first
+   time an erasure pattern is decoded, and kept in a hash table keyed by the
+   bitmask of erased devices.  The entries are also on a list in order of use,
+   and when the schedules take up more than max_bytes, the least recently used
+   ones are freed.  An entry that a thread is decoding with has refs > 0, and
+   is never freed out from under it. */
+
+typedef struct lsc_entry {
+  struct lsc_entry *hnext;          /* Hash chain */
+  struct lsc_entry *prev, *next;    /* Use list, most recent first */
+  int **schedule;
+  size_t bytes;
+  int refs;
+  uint64_t *key;
+} lsc_entry;
+
+struct jerasure_lazy_schedule_cache {
+  int k, m, w, smart;
+  jerasure_packed_bitmatrix *bitmatrix;
+  jerasure_decoding_rows_func rows; /* Closed-form decoding rows, or NULL */
+  void *rows_arg;
+  int nkeywords;
+  uint64_t *key;                    /* Scratch key, used with the lock held */
+  lsc_entry **buckets;
+  int nbuckets;
+  int nentries;
+  lsc_entry *head, *tail;
+  size_t bytes, max_bytes;
+  long hits, misses, evictions;
+  pthread_mutex_t lock;
+};
+
+jerasure_lazy_schedule_cache *jerasure_make_lazy_schedule_cache(int k, int m, int w, int *bitmatrix,
+                                                                int smart, size_t max_bytes)
 {
-  int cols, i, j, k;
-  int tmp;
- 
-  cols = rows;
+  jerasure_lazy_schedule_cache *cache;
+
+  cache = talloc(jerasure_lazy_schedule_cache, 1);
+  if (cache == NULL) return NULL;
+  memset(cache, 0, sizeof(jerasure_lazy_schedule_cache));
+  cache->k = k;
+  cache->m = m;
+  cache->w = w;
+  cache->smart = (smart != 0);     /* CSE schedules would need temporaries */
+  cache->max_bytes = max_bytes;
+  cache->nkeywords = (k+m+63)/64;
+  cache->nbuckets = 64;
+  cache->bitmatrix = jerasure_pack_bitmatrix(bitmatrix, m*w, k*w);
+  cache->key = talloc(uint64_t, cache->nkeywords);
+  cache->buckets = (lsc_entry **) calloc(cache->nbuckets, sizeof(lsc_entry *));
+  if (cache->bitmatrix == NULL || cache->key == NULL || cache->buckets == NULL) {
+    jerasure_free_packed_bitmatrix(cache->bitmatrix);
+    free(cache->key);
+    free(cache->buckets);
+    free(cache);
+    return NULL;
+  }
+  pthread_mutex_init(&cache->lock, NULL);
+  return cache;
+}
 
-  k = 0;
-  for (i = 0; i < rows; i++) {
-    for (j = 0; j < cols; j++) {
-      inv[k] = (i == j) ? 1 : 0;
-      k++;
-    }
+void jerasure_set_lazy_schedule_cache_decoder(jerasure_lazy_schedule_cache *cache,
+                                              jerasure_decoding_rows_func rows, void *arg)
+{
+  cache->rows = rows;
+  cache->rows_arg = arg;
+}
+
+void jerasure_free_lazy_schedule_cache(jerasure_lazy_schedule_cache *cache)
+{
+  lsc_entry *e, *next;
+
+  for (e = cache->head; e != NULL; e = next) {
+    next = e->next;
+    jerasure_free_schedule(e->schedule);
+    free(e);
   }
+  pthread_mutex_destroy(&cache->lock);
+  jerasure_free_packed_bitmatrix(cache->bitmatrix);
+  free(cache->key);
+  free(cache->buckets);
+  free(cache);
+}
 
-  /* First -- convert into upper triangular */
+void jerasure_get_lazy_schedule_cache_stats(jerasure_lazy_schedule_cache *cache, long *fill_in)
+{
+  pthread_mutex_lock(&cache->lock);
+  fill_in[0] = cache->hits;
+  fill_in[1] = cache->misses;
+  fill_in[2] = cache->evictions;
+  fill_in[3] = cache->nentries;
+  fill_in[4] = (long) cache->bytes;
+  pthread_mutex_unlock(&cache->lock);
+}
 
-  for (i = 0; i < cols; i++) {
+static unsigned int lsc_hash(uint64_t *key, int nkeywords)
+{
+  uint64_t h;
+  int i;
 
-    /* Swap rows if we have a zero i,i element.  If we can't swap, then the 
-       matrix was not invertible */
+  h = 0;
+  for (i = 0; i < nkeywords; i++) {
+    h ^= key[i];
+    h *= 0x9e3779b97f4a7c15ULL;
+    h ^= (h >> 29);
+  }
+  return (unsigned int) h;
+}
 
-    if ((mat[i*cols+i]) == 0) { 
-      for (j = i+1; j < rows && (mat[j*cols+i]) == 0; j++) ;
-      if (j == rows) return -1;
-      for (k = 0; k < cols; k++) {
-        tmp = mat[i*cols+k]; mat[i*cols+k] = mat[j*cols+k]; mat[j*cols+k] = tmp;
-        tmp = inv[i*cols+k]; inv[i*cols+k] = inv[j*cols+k]; inv[j*cols+k] = tmp;
-      }
-    }
- 
-    /* Now for each j>i, add A_ji*Ai to Aj */
-    for (j = i+1; j != rows; j++) {
-      if (mat[j*cols+i] != 0) {
-        for (k = 0; k < cols; k++) {
-          mat[j*cols+k] ^= mat[i*cols+k]; 
-          inv[j*cols+k] ^= inv[i*cols+k];
+/* Sets cache->key from the erasures, and returns the number of erasures, or
+   -1 if they are out of range or there are more than m of them. */
+
+static int lsc_set_key(jerasure_lazy_schedule_cache *cache, int *erasures)
+{
+  int i, n;
+
+  for (i = 0; i < cache->nkeywords; i++) cache->key[i] = 0;
+  n = 0;
+  for (i = 0; erasures[i] != -1; i++) {
+    if (erasures[i] < 0 || erasures[i] >= cache->k+cache->m) return -1;
+    if (cache->key[erasures[i]/64] & ((uint64_t) 1 << (erasures[i]%64))) continue;
+    cache->key[erasures[i]/64] |= ((uint64_t) 1 << (erasures[i]%64));
+    n++;
+  }
+  return (n > cache->m) ? -1 : n;
+}
+
+static lsc_entry *lsc_find(jerasure_lazy_schedule_cache *cache)
+{
+  lsc_entry *e;
+
+  e = cache->buckets[lsc_hash(cache->key, cache->nkeywords) & (cache->nbuckets-1)];
+  for ( ; e != NULL; e = e->hnext) {
+    if (memcmp(e->key, cache->key, sizeof(uint64_t)*cache->nkeywords) == 0) return e;
+  }
+  return NULL;
+}
+
+static void lsc_unlink(jerasure_lazy_schedule_cache *cache, lsc_entry *e)
+{
+  if (e->prev != NULL) e->prev->next = e->next; else cache->head = e->next;
+  if (e->next != NULL) e->next->prev = e->prev; else cache->tail = e->prev;
+}
+
+static void lsc_push_front(jerasure_lazy_schedule_cache *cache, lsc_entry *e)
+{
+  e->prev = NULL;
+  e->next = cache->head;
+  if (cache->head != NULL) cache->head->prev = e; else cache->tail = e;
+  cache->head = e;
+}
+
+static void lsc_remove(jerasure_lazy_schedule_cache *cache, lsc_entry *e)
+{
+  lsc_entry **ep;
+
+  ep = cache->buckets + (lsc_hash(e->key, cache->nkeywords) & (cache->nbuckets-1));
+  while (*ep != e) ep = &((*ep)->hnext);
+  *ep = e->hnext;
+  lsc_unlink(cache, e);
+  cache->nentries--;
+  cache->bytes -= e->bytes;
+  jerasure_free_schedule(e->schedule);
+  free(e);
+}
+
+static void lsc_insert(jerasure_lazy_schedule_cache *cache, lsc_entry *e)
+{
+  lsc_entry **buckets, *x, *next;
+  int i, nbuckets;
+  unsigned int h;
+
+  /* Keep the chains short by doubling the table when it fills up.  If that
+     fails, the chains just get longer. */
+
+  if (cache->nentries >= cache->nbuckets) {
+    nbuckets = cache->nbuckets*2;
+    buckets = (lsc_entry **) calloc(nbuckets, sizeof(lsc_entry *));
+    if (buckets != NULL) {
+      for (i = 0; i < cache->nbuckets; i++) {
+        for (x = cache->buckets[i]; x != NULL; x = next) {
+          next = x->hnext;
+          h = lsc_hash(x->key, cache->nkeywords) & (nbuckets-1);
+          x->hnext = buckets[h];
+          buckets[h] = x;
         }
       }
+      free(cache->buckets);
+      cache->buckets = buckets;
+      cache->nbuckets = nbuckets;
     }
   }
 
-  /* Now the matrix is upper triangular.  Start at the top and multiply down */
+  h = lsc_hash(e->key, cache->nkeywords) & (cache->nbuckets-1);
+  e->hnext = cache->buckets[h];
+  cache->buckets[h] = e;
+  lsc_push_front(cache, e);
+  cache->nentries++;
+  cache->bytes += e->bytes;
+}
 
-  for (i = rows-1; i >= 0; i--) {
-    for (j = 0; j < i; j++) {
-      if (mat[j*cols+i]) {
-        for (k = 0; k < cols; k++) {
-          mat[j*cols+k] ^= mat[i*cols+k]; 
-          inv[j*cols+k] ^= inv[i*cols+k];
-        }
+static void lsc_run(int k, int m, int w, int **schedule, char **ptrs, int size, int packetsize)
+{
+  int i, tdone;
+
+  for (tdone = 0; tdone < size; tdone += packetsize*w) {
+    jerasure_do_scheduled_operations(ptrs, schedule, packetsize);
+    for (i = 0; i < k+m; i++) ptrs[i] += (packetsize*w);
+  }
+}
+
+int jerasure_schedule_decode_lazy_cache_scratch(jerasure_lazy_schedule_cache *cache, int *erasures,
+                                                char **data_ptrs, char **coding_ptrs, int size,
+                                                int packetsize, char **ptrs)
+{
+  lsc_entry *e, *victim;
+  int **schedule;
+  size_t bytes;
+  int n;
+
+  pthread_mutex_lock(&cache->lock);
+  n = lsc_set_key(cache, erasures);
+  if (n <= 0) {
+    pthread_mutex_unlock(&cache->lock);
+    return n;
+  }
+  e = lsc_find(cache);
+  if (e != NULL) {
+    cache->hits++;
+    e->refs++;
+    lsc_unlink(cache, e);
+    lsc_push_front(cache, e);
+  } else {
+    cache->misses++;
+  }
+  pthread_mutex_unlock(&cache->lock);
+
+  fill_ptrs_for_scheduled_decoding(cache->k, cache->m, erasures, data_ptrs, coding_ptrs, ptrs);
+
+  if (e != NULL) {
+    lsc_run(cache->k, cache->m, cache->w, e->schedule, ptrs, size, packetsize);
+    pthread_mutex_lock(&cache->lock);
+    e->refs--;
+    pthread_mutex_unlock(&cache->lock);
+    return 0;
+  }
+
+  /* Miss -- generate the schedule without holding the lock, and then add it
+     if there is room once unused entries are thrown out.  If there isn't, or
+     another thread added it first, the schedule is freed after decoding. */
+
+  schedule = generate_packed_decoding_schedule(cache->k, cache->m, cache->w, cache->bitmatrix,
+                                               erasures, cache->smart, cache->rows, cache->rows_arg);
+  if (schedule == NULL) return -1;
+  for (n = 0; schedule[n][0] >= 0; n++) ;
+  bytes = sizeof(lsc_entry) + sizeof(uint64_t)*cache->nkeywords +
+          (n+1)*(sizeof(int *) + 5*sizeof(int));
+
+  e = NULL;
+  pthread_mutex_lock(&cache->lock);
+  lsc_set_key(cache, erasures);
+  if (bytes <= cache->max_bytes && lsc_find(cache) == NULL) {
+    victim = cache->tail;
+    while (cache->bytes + bytes > cache->max_bytes && victim != NULL) {
+      if (victim->refs == 0) {
+        lsc_remove(cache, victim);
+        cache->evictions++;
+        victim = cache->tail;
+      } else {
+        victim = victim->prev;
       }
     }
-  } 
+    if (cache->bytes + bytes <= cache->max_bytes) {
+      e = (lsc_entry *) malloc(sizeof(lsc_entry) + sizeof(uint64_t)*cache->nkeywords);
+      if (e != NULL) {
+        e->key = (uint64_t *) (e+1);
+        memcpy(e->key, cache->key, sizeof(uint64_t)*cache->nkeywords);
+        e->schedule = schedule;
+        e->bytes = bytes;
+        e->refs = 1;
+        lsc_insert(cache, e);
+      }
+    }
+  }
+  pthread_mutex_unlock(&cache->lock);
+
+  lsc_run(cache->k, cache->m, cache->w, schedule, ptrs, size, packetsize);
+
+  if (e != NULL) {
+    pthread_mutex_lock(&cache->lock);
+    e->refs--;
+    pthread_mutex_unlock(&cache->lock);
+  } else {
+    jerasure_free_schedule(schedule);
+  }
   return 0;
 }
 
+int jerasure_schedule_decode_lazy_cache(jerasure_lazy_schedule_cache *cache, int *erasures,
+                                        char **data_ptrs, char **coding_ptrs, int size, int packetsize)
+{
+  char **ptrs;
+  int ret;
+
+  ptrs = talloc(char *, cache->k+cache->m);
+  if (ptrs == NULL) return -1;
+  ret = jerasure_schedule_decode_lazy_cache_scratch(cache, erasures, data_ptrs, coding_ptrs,
+                                                    size, packetsize, ptrs);
+  free(ptrs);
+  return ret;
+}
+
+/* The bitmatrix versions pack the matrix and use M4RI below */
+
+int jerasure_invert_bitmatrix(int *mat, int *inv, int rows)
+{
+  jerasure_packed_bitmatrix *pmat, *pinv;
+  int i, j, ret;
+
+  pmat = jerasure_pack_bitmatrix(mat, rows, rows);
+  pinv = jerasure_new_packed_bitmatrix(rows, rows);
+  ret = -1;
+  if (pmat != NULL && pinv != NULL) ret = jerasure_invert_packed_bitmatrix(pmat, pinv);
+  if (ret == 0) {
+    for (i = 0; i < rows; i++) {
+      for (j = 0; j < rows; j++) inv[i*rows+j] = PB_GET(pinv, i, j);
+    }
+  }
+  jerasure_free_packed_bitmatrix(pmat);
+  jerasure_free_packed_bitmatrix(pinv);
+  return ret;
+}
+
 int jerasure_invertible_bitmatrix(int *mat, int rows)
 {
-  int cols, i, j, k;
-  int tmp;
- 
-  cols = rows;
+  jerasure_packed_bitmatrix *pmat;
+  int ret;
+
+  pmat = jerasure_pack_bitmatrix(mat, rows, rows);
+  if (pmat == NULL) return 0;
+  ret = jerasure_invertible_packed_bitmatrix(pmat);
+  jerasure_free_packed_bitmatrix(pmat);
+  return ret;
+}
 
-  /* First -- convert into upper triangular */
+static void pb_swap_rows(uint64_t *a, uint64_t *b, int words)
+{
+  uint64_t tmp;
+  int i;
 
-  for (i = 0; i < cols; i++) {
+  for (i = 0; i < words; i++) {
+    tmp = a[i]; a[i] = b[i]; b[i] = tmp;
+  }
+}
 
-    /* Swap rows if we have a zero i,i element.  If we can't swap, then the 
-       matrix was not invertible */
+static void pb_xor_row(uint64_t *dst, const uint64_t *src, int words)
+{
+  int i;
 
-    if ((mat[i*cols+i]) == 0) { 
-      for (j = i+1; j < rows && (mat[j*cols+i]) == 0; j++) ;
-      if (j == rows) return 0;
-      for (k = 0; k < cols; k++) {
-        tmp = mat[i*cols+k]; mat[i*cols+k] = mat[j*cols+k]; mat[j*cols+k] = tmp;
+  for (i = 0; i < words; i++) dst[i] ^= src[i];
+}
+
+/* Bitmatrix inversion uses the Method of Four Russians (M4RI).  The rows are
+   packed, stride words apiece, and the square rows*rows part on the left is
+   reduced to the identity; the row operations are applied to all stride
+   words, so when the inverse sits to the right of the matrix, it comes out
+   there.  The columns are done M4RI_BITS at a time:
+
+     - The pivot rows for the block's columns are found and reduced among
+       themselves, so that they hold the identity in those columns.
+     - Every XOR of those pivot rows goes in a table of 2^M4RI_BITS rows,
+       indexed by the pattern of bits that it has in the block's columns.
+     - Every other row has its bits in the block's columns cleared with one
+       XOR of the table row that its bits index.
+
+   That's one row XOR per row per block, instead of one per row per column.
+   The pivot rows have zeros left of the block, so the XORs start at the
+   block's word.  Returns -1 if the matrix isn't invertible. */
+
+#define M4RI_BITS 8
+
+static int m4ri_reduce(uint64_t *a, int rows, int stride)
+{
+  uint64_t *table, *t, bit;
+  int c, kb, i, j, l, w0, nw, s;
+
+  table = talloc(uint64_t, (size_t) stride << M4RI_BITS);
+  if (table == NULL) return -1;
+
+  for (c = 0; c < rows; c += kb) {
+    kb = (rows-c < M4RI_BITS) ? rows-c : M4RI_BITS;
+    w0 = c/64;
+    nw = stride-w0;
+
+    /* Pivots.  A candidate row is reduced by the pivots already found before
+       its bit is looked at. */
+
+    for (i = 0; i < kb; i++) {
+      bit = 1ULL << ((c+i)%64);
+      for (j = c+i; j < rows; j++) {
+        for (l = 0; l < i; l++) {
+          if (a[(size_t) j*stride+w0] & (1ULL << ((c+l)%64))) {
+            pb_xor_row(a+(size_t) j*stride+w0, a+(size_t) (c+l)*stride+w0, nw);
+          }
+        }
+        if (a[(size_t) j*stride+w0] & bit) break;
       }
-    }
- 
-    /* Now for each j>i, add A_ji*Ai to Aj */
-    for (j = i+1; j != rows; j++) {
-      if (mat[j*cols+i] != 0) {
-        for (k = 0; k < cols; k++) {
-          mat[j*cols+k] ^= mat[i*cols+k]; 
+      if (j == rows) {
+        free(table);
+        return -1;
+      }
+      if (j != c+i) pb_swap_rows(a+(size_t) j*stride+w0, a+(size_t) (c+i)*stride+w0, nw);
+      for (l = 0; l < i; l++) {
+        if (a[(size_t) (c+l)*stride+w0] & bit) {
+          pb_xor_row(a+(size_t) (c+l)*stride+w0, a+(size_t) (c+i)*stride+w0, nw);
         }
       }
     }
+
+    /* The table -- each entry is a smaller one plus one pivot row */
+
+    memset(table, 0, sizeof(uint64_t)*nw);
+    for (s = 1; s < (1 << kb); s++) {
+      t = table+(size_t) s*nw;
+      memcpy(t, table+(size_t) (s & (s-1))*nw, sizeof(uint64_t)*nw);
+      pb_xor_row(t, a+(size_t) (c+__builtin_ctz(s))*stride+w0, nw);
+    }
+
+    for (j = 0; j < rows; j++) {
+      if (j == c) j += kb;
+      if (j >= rows) break;
+      s = (a[(size_t) j*stride+w0] >> (c%64)) & ((1 << kb)-1);
+      if (s != 0) pb_xor_row(a+(size_t) j*stride+w0, table+(size_t) s*nw, nw);
+    }
   }
-  return 1;
+  free(table);
+  return 0;
+}
+
+int jerasure_invert_packed_bitmatrix(jerasure_packed_bitmatrix *mat, jerasure_packed_bitmatrix *inv)
+{
+  uint64_t *a;
+  int rows, words, i, ret;
+
+  rows = mat->rows;
+  words = mat->words;
+  if (mat->cols != rows || inv->rows != rows || inv->cols != rows) return -1;
+
+  /* The inverse goes to the right of the matrix, and the identity there
+     becomes the inverse */
+
+  a = (uint64_t *) calloc((size_t) rows*2*words, sizeof(uint64_t));
+  if (a == NULL) return -1;
+  for (i = 0; i < rows; i++) {
+    memcpy(a+(size_t) i*2*words, PB_ROW(mat, i), sizeof(uint64_t)*words);
+    a[(size_t) i*2*words+words+i/64] = 1ULL << (i%64);
+  }
+  ret = m4ri_reduce(a, rows, 2*words);
+  for (i = 0; i < rows; i++) {
+    memcpy(PB_ROW(inv, i), a+(size_t) i*2*words+words, sizeof(uint64_t)*words);
+  }
+  free(a);
+  return ret;
+}
+
+int jerasure_invertible_packed_bitmatrix(jerasure_packed_bitmatrix *mat)
+{
+  if (mat->cols != mat->rows) return 0;
+  return (m4ri_reduce(mat->bits, mat->rows, mat->words) == 0);
 }
 
-  
 int *jerasure_matrix_multiply(int *m1, int *m2, int r1, int c1, int r2, int c2, int w)
 {
   int *product, i, j, k;
@@ -1195,157 +2493,353 @@ int *jerasure_matrix_multiply(int *m1, int *m2, int r1, int c1, int r2, int c2,
 
 void jerasure_get_stats(double *fill_in)
 {
-  fill_in[0] = jerasure_total_xor_bytes;
-  fill_in[1] = jerasure_total_gf_bytes;
-  fill_in[2] = jerasure_total_memcpy_bytes;
-  jerasure_total_xor_bytes = 0;
-  jerasure_total_gf_bytes = 0;
-  jerasure_total_memcpy_bytes = 0;
+#ifdef JERASURE_NO_STATS
+  fill_in[0] = 0;
+  fill_in[1] = 0;
+  fill_in[2] = 0;
+#else
+  uint64_t total[3];
+  stats_block *b;
+  int i;
+
+  /* Rather than zeroing the blocks, which their threads may be writing,
+     remember the totals and report the difference next time. */
+
+  pthread_mutex_lock(&stats_lock);
+  for (i = 0; i < 3; i++) {
+    total[i] = stats_exited[i] + __atomic_load_n(&stats_fallback.bytes[i], __ATOMIC_RELAXED);
+  }
+  for (b = stats_blocks; b != NULL; b = b->next) {
+    for (i = 0; i < 3; i++) total[i] += __atomic_load_n(&b->bytes[i], __ATOMIC_RELAXED);
+  }
+  for (i = 0; i < 3; i++) {
+    fill_in[i] = (double) (total[i] - stats_reported[i]);
+    stats_reported[i] = total[i];
+  }
+  pthread_mutex_unlock(&stats_lock);
+#endif
 }
 
+/* A schedule is mostly runs of operations into the same destination packet:
+   a copy or XOR followed by XORs.  Each run is done with one multi-source
+   XOR, so the destination is written once per run rather than once per
+   operation. */
+
 void jerasure_do_scheduled_operations(char **ptrs, int **operations, int packetsize)
 {
-  char *sptr;
+  char *srcs[XOR_BATCH];
   char *dptr;
-  int op;
+  int op, add, nsrc, ddev, dpkt;
 
-  for (op = 0; operations[op][0] >= 0; op++) {
-    sptr = ptrs[operations[op][0]] + operations[op][1]*packetsize;
-    dptr = ptrs[operations[op][2]] + operations[op][3]*packetsize;
-    if (operations[op][4]) {
-/*      printf("%d,%d %d,%d\n", operations[op][0], 
-      operations[op][1], 
-      operations[op][2], 
-      operations[op][3]); 
-      printf("xor(0x%x, 0x%x -> 0x%x, %d)\n", sptr, dptr, dptr, packetsize); */
-      galois_region_xor(sptr, dptr, packetsize);
-      jerasure_total_xor_bytes += packetsize;
-    } else {
-/*      printf("memcpy(0x%x <- 0x%x)\n", dptr, sptr); */
-      memcpy(dptr, sptr, packetsize);
-      jerasure_total_memcpy_bytes += packetsize;
+  op = 0;
+  while (operations[op][0] >= 0) {
+    ddev = operations[op][2];
+    dpkt = operations[op][3];
+    dptr = ptrs[ddev] + dpkt*packetsize;
+    add = operations[op][4];
+    nsrc = 0;
+    do {
+      if (nsrc == XOR_BATCH) {
+        xor_batch(srcs, nsrc, dptr, packetsize, add);
+        add = 1;
+        nsrc = 0;
+      }
+      srcs[nsrc++] = ptrs[operations[op][0]] + operations[op][1]*packetsize;
+      op++;
+    } while (operations[op][0] >= 0 && operations[op][4] &&
+             operations[op][2] == ddev && operations[op][3] == dpkt);
+    xor_batch(srcs, nsrc, dptr, packetsize, add);
+  }
+}
+
+jerasure_flat_schedule *jerasure_flatten_schedule(int **schedule, int packetsize)
+{
+  jerasure_flat_schedule *fs;
+  jerasure_flat_op *op;
+  int i, n;
+
+  for (n = 0; schedule[n][0] >= 0; n++) ;
+  if (schedule[n][0] != -1) return NULL;       /* Temporaries aren't supported */
+
+  fs = talloc(jerasure_flat_schedule, 1);
+  if (fs == NULL) return NULL;
+  fs->nops = n;
+  fs->packetsize = packetsize;
+  fs->ops = talloc(jerasure_flat_op, (n > 0) ? n : 1);
+  if (fs->ops == NULL) {
+    free(fs);
+    return NULL;
+  }
+
+  for (i = 0; i < n; i++) {
+    if (schedule[i][0] > 0xffff || schedule[i][2] > 0xffff ||
+        (long long) (schedule[i][1]+1) * packetsize > 0xffffffffLL ||
+        (long long) (schedule[i][3]+1) * packetsize > 0xffffffffLL) {
+      jerasure_free_flat_schedule(fs);
+      return NULL;
     }
-  }  
+    op = fs->ops+i;
+    op->op = (schedule[i][4]) ? JERASURE_FLAT_XOR : JERASURE_FLAT_COPY;
+    op->src = schedule[i][0];
+    op->dst = schedule[i][2];
+    op->pad = 0;
+    op->src_offset = (uint32_t) schedule[i][1] * packetsize;
+    op->dst_offset = (uint32_t) schedule[i][3] * packetsize;
+  }
+  return fs;
+}
+
+void jerasure_free_flat_schedule(jerasure_flat_schedule *schedule)
+{
+  free(schedule->ops);
+  free(schedule);
+}
+
+/* Packets are small enough that calling through GF-Complete for each XOR
+   costs as much as the XOR itself, so it is done inline, a long at a time.
+   Packet sizes are multiples of sizeof(long), and the compiler vectorizes
+   this loop. */
+
+static inline void flat_xor(const char *src, char *dst, int nbytes)
+{
+  const long *s;
+  long *d;
+  int i;
+
+  s = (const long *) src;
+  d = (long *) dst;
+  for (i = 0; i < nbytes / (int) sizeof(long); i++) d[i] ^= s[i];
+}
+
+void jerasure_do_flat_operations(char **ptrs, jerasure_flat_schedule *schedule)
+{
+  const jerasure_flat_op *op, *run, *end;
+  char *srcs[XOR_BATCH];
+  char *dptr;
+  int packetsize, nxors, nsrc, add;
+
+  packetsize = schedule->packetsize;
+  op = schedule->ops;
+  end = op + schedule->nops;
+  nxors = 0;
+  while (op < end) {
+
+    /* Find the run of XORs into op's destination */
+
+    for (run = op+1; run < end && run->op == JERASURE_FLAT_XOR &&
+                     run->dst == op->dst && run->dst_offset == op->dst_offset; run++) ;
+    dptr = ptrs[op->dst] + op->dst_offset;
+    add = (op->op == JERASURE_FLAT_XOR);
+    nxors += (run - op) - !add;
+
+    if (run - op == 1) {
+      if (add) {
+        flat_xor(ptrs[op->src] + op->src_offset, dptr, packetsize);
+      } else {
+        memcpy(dptr, ptrs[op->src] + op->src_offset, packetsize);
+      }
+      op = run;
+      continue;
+    }
+
+    while (op < run) {
+      for (nsrc = 0; nsrc < XOR_BATCH && op < run; nsrc++, op++) {
+        srcs[nsrc] = ptrs[op->src] + op->src_offset;
+      }
+      galois_region_xor_multi(srcs, nsrc, dptr, packetsize, add);
+      add = 1;
+    }
+  }
+  STATS_ADD(STATS_XOR, (uint64_t) nxors*packetsize);
+  STATS_ADD(STATS_MEMCPY, (uint64_t) (schedule->nops-nxors)*packetsize);
+}
+
+void jerasure_flat_schedule_encode(int k, int m, int w, jerasure_flat_schedule *schedule,
+                                   char **data_ptrs, char **coding_ptrs, int size)
+{
+  char *ptrs[64], **ptr_copy;
+  int i, tdone, stride;
+
+  /* Small k+m is the common case, and needs no allocation */
+
+  ptr_copy = (k+m <= 64) ? ptrs : talloc(char *, (k+m));
+  if (ptr_copy == NULL) {
+    fprintf(stderr, "jerasure_flat_schedule_encode - can't allocate pointers\n");
+    assert(0);
+  }
+  for (i = 0; i < k; i++) ptr_copy[i] = data_ptrs[i];
+  for (i = 0; i < m; i++) ptr_copy[i+k] = coding_ptrs[i];
+  stride = schedule->packetsize*w;
+  for (tdone = 0; tdone < size; tdone += stride) {
+    jerasure_do_flat_operations(ptr_copy, schedule);
+    for (i = 0; i < k+m; i++) ptr_copy[i] += stride;
+  }
+  if (ptr_copy != ptrs) free(ptr_copy);
 }
 
 void jerasure_schedule_encode(int k, int m, int w, int **schedule,
                                    char **data_ptrs, char **coding_ptrs, int size, int packetsize)
 {
   char **ptr_copy;
-  int i, tdone;
+  int i;
 
-  ptr_copy = talloc(char *, (k+m));
+  ptr_copy = talloc(char *, (k+m+1));
+  if (ptr_copy == NULL) {
+    fprintf(stderr, "jerasure_schedule_encode - can't allocate pointers\n");
+    assert(0);
+  }
   for (i = 0; i < k; i++) ptr_copy[i] = data_ptrs[i];
   for (i = 0; i < m; i++) ptr_copy[i+k] = coding_ptrs[i];
-  for (tdone = 0; tdone < size; tdone += packetsize*w) {
-    jerasure_do_scheduled_operations(ptr_copy, schedule, packetsize);
-    for (i = 0; i < k+m; i++) ptr_copy[i] += (packetsize*w);
+  if (do_scheduled_stripes(k, m, w, schedule, ptr_copy, size, packetsize) < 0) {
+    fprintf(stderr, "jerasure_schedule_encode - can't allocate temporaries\n");
+    assert(0);
   }
   free(ptr_copy);
 }
+
+void jerasure_schedule_encode_scratch(int k, int m, int w, int **schedule,
+                                      char **data_ptrs, char **coding_ptrs, int size,
+                                      int packetsize, char **ptrs, char *temps)
+{
+  int i;
+
+  for (i = 0; i < k; i++) ptrs[i] = data_ptrs[i];
+  for (i = 0; i < m; i++) ptrs[i+k] = coding_ptrs[i];
+  run_scheduled_stripes(k, m, w, schedule, ptrs, temps, size, packetsize);
+}
     
 int **jerasure_dumb_bitmatrix_to_schedule(int k, int m, int w, int *bitmatrix)
+{
+  jerasure_packed_bitmatrix *pb;
+  int **schedule;
+
+  pb = jerasure_pack_bitmatrix(bitmatrix, m*w, k*w);
+  if (pb == NULL) return NULL;
+  schedule = dumb_bitmatrix_to_schedule(k, m, w, pb->bits, pb->words);
+  jerasure_free_packed_bitmatrix(pb);
+  return schedule;
+}
+
+int **jerasure_dumb_packed_bitmatrix_to_schedule(int k, int m, int w, jerasure_packed_bitmatrix *pb)
+{
+  if (pb->rows != m*w || pb->cols != k*w) return NULL;
+  return dumb_bitmatrix_to_schedule(k, m, w, pb->bits, pb->words);
+}
+
+int **jerasure_smart_bitmatrix_to_schedule(int k, int m, int w, int *bitmatrix)
+{
+  jerasure_packed_bitmatrix *pb;
+  int **schedule;
+
+  pb = jerasure_pack_bitmatrix(bitmatrix, m*w, k*w);
+  if (pb == NULL) return NULL;
+  schedule = smart_bitmatrix_to_schedule(k, m, w, pb->bits, pb->words);
+  jerasure_free_packed_bitmatrix(pb);
+  return schedule;
+}
+
+int **jerasure_smart_packed_bitmatrix_to_schedule(int k, int m, int w, jerasure_packed_bitmatrix *pb)
+{
+  if (pb->rows != m*w || pb->cols != k*w) return NULL;
+  return smart_bitmatrix_to_schedule(k, m, w, pb->bits, pb->words);
+}
+
+int **jerasure_cse_bitmatrix_to_schedule(int k, int m, int w, int *bitmatrix, int *ntemps)
+{
+  jerasure_packed_bitmatrix *pb;
+  int **schedule;
+
+  pb = jerasure_pack_bitmatrix(bitmatrix, m*w, k*w);
+  if (pb == NULL) return NULL;
+  schedule = cse_bitmatrix_to_schedule(k, m*w, w, pb->bits, pb->words, k+m, ntemps);
+  jerasure_free_packed_bitmatrix(pb);
+  return schedule;
+}
+
+int **jerasure_cse_packed_bitmatrix_to_schedule(int k, int m, int w, jerasure_packed_bitmatrix *pb,
+                                                int *ntemps)
+{
+  if (pb->rows != m*w || pb->cols != k*w) return NULL;
+  return cse_bitmatrix_to_schedule(k, m*w, w, pb->bits, pb->words, k+m, ntemps);
+}
+
+static int schedule_add_op(int **operations, int op, int sdev, int spkt, int ddev, int dpkt, int xor)
+{
+  operations[op] = talloc(int, 5);
+  if (operations[op] == NULL) return -1;
+  operations[op][0] = sdev;
+  operations[op][1] = spkt;
+  operations[op][2] = ddev;
+  operations[op][3] = dpkt;
+  operations[op][4] = xor;
+  return 0;
+}
+
+static int **dumb_bitmatrix_to_schedule(int k, int m, int w, const uint64_t *bits, int words)
 {
   int **operations;
-  int op;
-  int index, optodo, i, j;
+  int op, optodo, i, j, b;
+  const uint64_t *row;
+  uint64_t x;
 
   operations = talloc(int *, k*m*w*w+1);
   if (!operations) return NULL;
   op = 0;
-  
-  index = 0;
+
   for (i = 0; i < m*w; i++) {
     optodo = 0;
-    for (j = 0; j < k*w; j++) {
-      if (bitmatrix[index]) {
-        operations[op] = talloc(int, 5);
-	if (!operations[op]) {
-	  // -ENOMEM
-          goto error;
-        }
-        operations[op][4] = optodo;
-        operations[op][0] = j/w;
-        operations[op][1] = j%w;
-        operations[op][2] = k+i/w;
-        operations[op][3] = i%w;
+    row = bits + (size_t) i*words;
+    for (j = 0; j < words; j++) {
+      for (x = row[j]; x != 0; x &= x-1) {
+        b = j*64 + __builtin_ctzll(x);
+        if (schedule_add_op(operations, op, b/w, b%w, k+i/w, i%w, optodo) < 0) goto error;
         optodo = 1;
         op++;
-        
       }
-      index++;
     }
   }
-  operations[op] = talloc(int, 5);
-  if (!operations[op]) {
-    // -ENOMEM
-    goto error;
-  }
-  operations[op][0] = -1;
+  if (schedule_add_op(operations, op, -1, 0, 0, 0, 0) < 0) goto error;
   return operations;
 
 error:
-  for (i = 0; i <= op; i++) {
-    free(operations[op]);
-  }
+  for (i = 0; i < op; i++) free(operations[i]);
   free(operations);
   return NULL;
 }
 
-int **jerasure_smart_bitmatrix_to_schedule(int k, int m, int w, int *bitmatrix)
+/* The rows are packed into bitmaps, so the number of differences between two
+   rows is a popcount of their XOR, and the operations of a row are found a
+   word at a time.  The rows are chosen, and the operations written, in the
+   same order as when the rows were compared an int at a time, so the
+   schedule is the same. */
+
+static int **smart_bitmatrix_to_schedule(int k, int m, int w, const uint64_t *bits, int nwords)
 {
   int **operations;
   int op;
-  int i, j;
-  int *diff, *from, *b1, *flink, *blink;
-  int *ptr, no, row;
+  int i, j, kw;
+  int *diff, *from, *flink, *blink;
+  const uint64_t *rb, *fb;
+  uint64_t x;
+  int no, row;
   int optodo;
   int bestrow = 0, bestdiff, top;
 
-/*   printf("Scheduling:\n\n");
-  jerasure_print_bitmatrix(bitmatrix, m*w, k*w, w); */
-
-  operations = talloc(int *, k*m*w*w+1);
-  if (!operations) return NULL;
+  kw = k*w;
   op = 0;
-  
-  diff = talloc(int, m*w);
-  if (!diff) {
-    free(operations);
-    return NULL;
-  }
-  from = talloc(int, m*w);
-  if (!from) {
-    free(operations);
-    free(diff);
-    return NULL;
-  }
-  flink = talloc(int, m*w);
-  if (!flink) {
-    free(operations);
-    free(diff);
-    free(from);
-    return NULL;
-  }
-  blink = talloc(int, m*w);
-  if (!blink) {
-    free(operations);
-    free(diff);
-    free(from);
-    free(flink);
-    return NULL;
-  }
-
-  ptr = bitmatrix;
+  operations = talloc(int *, k*m*w*w+1);
+  diff = talloc(int, 4*m*w);
+  if (operations == NULL || diff == NULL) goto error;
+  from = diff + m*w;
+  flink = from + m*w;
+  blink = flink + m*w;
 
-  bestdiff = k*w+1;
+  bestdiff = kw+1;
   top = 0;
   for (i = 0; i < m*w; i++) {
+    rb = bits + i*nwords;
     no = 0;
-    for (j = 0; j < k*w; j++) {
-      no += *ptr;
-      ptr++;
-    }
+    for (j = 0; j < nwords; j++) no += __builtin_popcountll(rb[j]);
     diff[i] = no;
     from[i] = -1;
     flink[i] = i+1;
@@ -1372,51 +2866,36 @@ int **jerasure_smart_bitmatrix_to_schedule(int k, int m, int w, int *bitmatrix)
       }
     }
 
-    ptr = bitmatrix + row*k*w;
+    rb = bits + row*nwords;
     if (from[row] == -1) {
       optodo = 0;
-      for (j = 0; j < k*w; j++) {
-        if (ptr[j]) {
-          operations[op] = talloc(int, 5);
-          if (!operations[op]) goto error;
-          operations[op][4] = optodo;
-          operations[op][0] = j/w;
-          operations[op][1] = j%w;
-          operations[op][2] = k+row/w;
-          operations[op][3] = row%w;
+      for (i = 0; i < nwords; i++) {
+        for (x = rb[i]; x != 0; x &= x-1) {
+          j = i*64 + __builtin_ctzll(x);
+          if (schedule_add_op(operations, op, j/w, j%w, k+row/w, row%w, optodo) < 0) goto error;
           optodo = 1;
           op++;
         }
       }
     } else {
-      operations[op] = talloc(int, 5);
-      if (!operations[op]) goto error;
-      operations[op][4] = 0;
-      operations[op][0] = k+from[row]/w;
-      operations[op][1] = from[row]%w;
-      operations[op][2] = k+row/w;
-      operations[op][3] = row%w;
+      if (schedule_add_op(operations, op, k+from[row]/w, from[row]%w, k+row/w, row%w, 0) < 0) {
+        goto error;
+      }
       op++;
-      b1 = bitmatrix + from[row]*k*w;
-      for (j = 0; j < k*w; j++) {
-        if (ptr[j] ^ b1[j]) {
-          operations[op] = talloc(int, 5);
-          if (!operations[op]) goto error;
-          operations[op][4] = 1;
-          operations[op][0] = j/w;
-          operations[op][1] = j%w;
-          operations[op][2] = k+row/w;
-          operations[op][3] = row%w;
-          optodo = 1;
+      fb = bits + from[row]*nwords;
+      for (i = 0; i < nwords; i++) {
+        for (x = rb[i] ^ fb[i]; x != 0; x &= x-1) {
+          j = i*64 + __builtin_ctzll(x);
+          if (schedule_add_op(operations, op, j/w, j%w, k+row/w, row%w, 1) < 0) goto error;
           op++;
         }
       }
     }
-    bestdiff = k*w+1;
+    bestdiff = kw+1;
     for (i = top; i != -1; i = flink[i]) {
       no = 1;
-      b1 = bitmatrix + i*k*w;
-      for (j = 0; j < k*w; j++) no += (ptr[j] ^ b1[j]);
+      fb = bits + i*nwords;
+      for (j = 0; j < nwords; j++) no += __builtin_popcountll(rb[j] ^ fb[j]);
       if (no < diff[i]) {
         from[i] = row;
         diff[i] = no;
@@ -1428,25 +2907,225 @@ int **jerasure_smart_bitmatrix_to_schedule(int k, int m, int w, int *bitmatrix)
     }
   }
   
-  operations[op] = talloc(int, 5);
-  if (!operations[op]) goto error;
-  operations[op][0] = -1;
-  free(from);
+  if (schedule_add_op(operations, op, -1, 0, 0, 0, 0) < 0) goto error;
   free(diff);
-  free(blink);
-  free(flink);
-
   return operations;
 
 error:
-  for (i = 0; i <= op; i++) {
-    free(operations[op]);
+  if (operations != NULL) {
+    for (i = 0; i < op; i++) free(operations[i]);
+    free(operations);
   }
-  free(operations);
-  free(from);
   free(diff);
-  free(blink);
-  free(flink);
+  return NULL;
+}
+
+/* Common subexpression elimination, after Paar's greedy algorithm.  Each row
+   of the bitmatrix is a set of variables: the k*w input packets, and
+   temporaries that each hold the XOR of two other variables.  The pair of
+   variables that occurs together in the most rows becomes a new temporary,
+   and replaces the pair in those rows, until no pair is in more than one row.
+   The sets are kept by column, as bitmaps of the rows that use a variable, so
+   a pair's count is a popcount of the AND of two columns.
+
+   Each new temporary takes at least two ones out of the matrix, so there
+   are at most ones/2 of them.  A temporary is computed just before the first
+   row that needs it, and its packet is reused after its last use, which
+   keeps the temporary area small.  That area is device tdev. */
+
+#define CSE_HAS(col, r) (((col)[(r)/64] >> ((r)%64)) & 1)
+
+typedef struct {
+  int kw, nvars, nwords;
+  uint64_t *cols;                   /* nvars columns of nwords words */
+  int *ta, *tb;                     /* Operands of temporary v are ta[v], tb[v] */
+  int *order, norder;               /* Temporaries and rows, in schedule order */
+  int *emitted;
+} cse_state;
+
+static void cse_emit_temp(cse_state *cs, int v)
+{
+  if (v < cs->kw || cs->emitted[v]) return;
+  cse_emit_temp(cs, cs->ta[v]);
+  cse_emit_temp(cs, cs->tb[v]);
+  cs->emitted[v] = 1;
+  cs->order[cs->norder++] = v;
+}
+
+static int **cse_bitmatrix_to_schedule(int k, int rows, int w, const uint64_t *bits, int words,
+                                       int tdev, int *ntemps)
+{
+  cse_state cs;
+  uint64_t *ca, *cb, *ct, x;
+  int **operations;
+  int *ints, *cnt, *lastuse, *slot, *freeslots, *node_vars;
+  int maxvars, ones, i, j, r, v, a, b, c, besta, bestb, bestc, p, nfree, nslots;
+  int nops, op, nv, first;
+
+  operations = NULL;
+  op = 0;
+  ones = 0;
+  for (i = 0; i < rows*words; i++) ones += __builtin_popcountll(bits[i]);
+  cs.kw = k*w;
+  cs.nwords = (rows+63)/64;
+  maxvars = cs.kw + ones/2 + 1;
+
+  cs.cols = (uint64_t *) calloc((size_t) maxvars*cs.nwords, sizeof(uint64_t));
+  ints = talloc(int, 9*maxvars + rows);
+  if (cs.cols == NULL || ints == NULL) {
+    free(cs.cols);
+    free(ints);
+    return NULL;
+  }
+  cs.ta = ints;
+  cs.tb = cs.ta + maxvars;
+  cnt = cs.tb + maxvars;
+  cs.emitted = cnt + maxvars;
+  lastuse = cs.emitted + maxvars;
+  slot = lastuse + maxvars;
+  freeslots = slot + maxvars;
+  node_vars = freeslots + maxvars;
+  cs.order = node_vars + maxvars;
+  memset(cs.emitted, 0, sizeof(int)*maxvars);
+
+  for (r = 0; r < rows; r++) {
+    for (i = 0; i < words; i++) {
+      for (x = bits[(size_t) r*words+i]; x != 0; x &= x-1) {
+        j = i*64 + __builtin_ctzll(x);
+        cs.cols[j*cs.nwords+r/64] |= (1ULL << (r%64));
+      }
+    }
+  }
+  for (j = 0; j < cs.kw; j++) {
+    cnt[j] = 0;
+    for (i = 0; i < cs.nwords; i++) cnt[j] += __builtin_popcountll(cs.cols[j*cs.nwords+i]);
+  }
+
+  /* Find the most common pair, and make it a temporary, until there are none */
+
+  cs.nvars = cs.kw;
+  while (cs.nvars < maxvars) {
+    bestc = 1;
+    besta = bestb = -1;
+    for (a = 0; a < cs.nvars; a++) {
+      if (cnt[a] <= bestc) continue;
+      ca = cs.cols + a*cs.nwords;
+      for (b = a+1; b < cs.nvars; b++) {
+        if (cnt[b] <= bestc) continue;
+        cb = cs.cols + b*cs.nwords;
+        c = 0;
+        for (i = 0; i < cs.nwords; i++) c += __builtin_popcountll(ca[i] & cb[i]);
+        if (c > bestc) {
+          bestc = c;
+          besta = a;
+          bestb = b;
+        }
+      }
+    }
+    if (besta == -1) break;
+
+    v = cs.nvars++;
+    ca = cs.cols + besta*cs.nwords;
+    cb = cs.cols + bestb*cs.nwords;
+    ct = cs.cols + v*cs.nwords;
+    for (i = 0; i < cs.nwords; i++) {
+      ct[i] = ca[i] & cb[i];
+      ca[i] &= ~ct[i];
+      cb[i] &= ~ct[i];
+    }
+    cnt[v] = bestc;
+    cnt[besta] -= bestc;
+    cnt[bestb] -= bestc;
+    cs.ta[v] = besta;
+    cs.tb[v] = bestb;
+  }
+
+  /* Order the temporaries and rows.  Rows are nvars+r in order[]. */
+
+  cs.norder = 0;
+  for (r = 0; r < rows; r++) {
+    for (v = cs.kw; v < cs.nvars; v++) {
+      if (CSE_HAS(cs.cols + v*cs.nwords, r)) cse_emit_temp(&cs, v);
+    }
+    cs.order[cs.norder++] = cs.nvars + r;
+  }
+
+  /* Find the last use of each temporary, then give each one a packet */
+
+  for (p = 0; p < cs.norder; p++) {
+    v = cs.order[p];
+    if (v < cs.nvars) {
+      lastuse[cs.ta[v]] = p;
+      lastuse[cs.tb[v]] = p;
+    } else {
+      for (j = cs.kw; j < cs.nvars; j++) {
+        if (CSE_HAS(cs.cols + j*cs.nwords, v - cs.nvars)) lastuse[j] = p;
+      }
+    }
+  }
+
+  nfree = 0;
+  nslots = 0;
+  nops = 0;
+  for (p = 0; p < cs.norder; p++) {
+    v = cs.order[p];
+    if (v < cs.nvars) {
+      slot[v] = (nfree > 0) ? freeslots[--nfree] : nslots++;
+      node_vars[0] = cs.ta[v];
+      node_vars[1] = cs.tb[v];
+      nv = 2;
+    } else {
+      nv = 0;
+      for (j = 0; j < cs.nvars; j++) {
+        if (CSE_HAS(cs.cols + j*cs.nwords, v - cs.nvars)) node_vars[nv++] = j;
+      }
+    }
+    nops += nv;
+    for (i = 0; i < nv; i++) {
+      if (node_vars[i] >= cs.kw && lastuse[node_vars[i]] == p) freeslots[nfree++] = slot[node_vars[i]];
+    }
+  }
+
+  /* Now write the schedule */
+
+  operations = talloc(int *, nops+1);
+  if (operations == NULL) goto error;
+  op = 0;
+  for (p = 0; p < cs.norder; p++) {
+    v = cs.order[p];
+    if (v < cs.nvars) {
+      for (i = 0; i < 2; i++) {
+        a = (i == 0) ? cs.ta[v] : cs.tb[v];
+        if (schedule_add_op(operations, op, (a < cs.kw) ? a/w : tdev, (a < cs.kw) ? a%w : slot[a],
+                       tdev, slot[v], i) < 0) goto error;
+        op++;
+      }
+    } else {
+      r = v - cs.nvars;
+      first = 1;
+      for (j = 0; j < cs.nvars; j++) {
+        if (!CSE_HAS(cs.cols + j*cs.nwords, r)) continue;
+        if (schedule_add_op(operations, op, (j < cs.kw) ? j/w : tdev, (j < cs.kw) ? j%w : slot[j],
+                       k+r/w, r%w, !first) < 0) goto error;
+        first = 0;
+        op++;
+      }
+    }
+  }
+  if (schedule_add_op(operations, op, -1-nslots, 0, 0, 0, 0) < 0) goto error;
+
+  if (ntemps != NULL) *ntemps = nslots;
+  free(cs.cols);
+  free(ints);
+  return operations;
+
+error:
+  if (operations != NULL) {
+    for (i = 0; i < op; i++) free(operations[i]);
+    free(operations);
+  }
+  free(cs.cols);
+  free(ints);
   return NULL;
 }
 
@@ -1470,6 +3149,26 @@ void jerasure_bitmatrix_encode(int k, int m, int w, int *bitmatrix,
   }
 }
 
+void jerasure_packed_bitmatrix_encode(int k, int m, int w, jerasure_packed_bitmatrix *pb,
+                                      char **data_ptrs, char **coding_ptrs, int size, int packetsize)
+{
+  int i;
+
+  if (packetsize%sizeof(long) != 0) {
+    fprintf(stderr, "jerasure_packed_bitmatrix_encode - packetsize(%d) %c sizeof(long) != 0\n", packetsize, '%');
+    assert(0);
+  }
+  if (size%(packetsize*w) != 0) {
+    fprintf(stderr, "jerasure_packed_bitmatrix_encode - size(%d) %c (packetsize(%d)*w(%d))) != 0\n", 
+         size, '%', packetsize, w);
+    assert(0);
+  }
+
+  for (i = 0; i < m; i++) {
+    jerasure_packed_bitmatrix_dotprod(k, w, pb, i*w, NULL, k+i, data_ptrs, coding_ptrs, size, packetsize);
+  }
+}
+
 /*
  * Exported function for use by autoconf to perform quick 
  * spot-check.
@@ -0,0 +1,471 @@
+/* *
+ * Copyright (c) 2014, James S. Plank and Kevin Greenan
+ * All rights reserved.
+ *
+ * Jerasure - A C/C++ Library for a Variety of Reed-Solomon and RAID-6 Erasure
+ * Coding Techniques
+ *
+ * Revision 2.0: Galois Field backend now links to GF-Complete
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  - Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ *  - Neither the name of the University of Tennessee nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Codec handles.  Everything that the coding routines would otherwise work out
+   or allocate on each call is done once, in jerasure_codec_new. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#ifdef HAVE_DLOPEN
+#include <dlfcn.h>
+#endif
+
+#include "galois.h"
+#include "jerasure.h"
+#include "jerasure_codec.h"
+#include "reed_sol.h"
+#include "cauchy.h"
+#include "liberation.h"
+
+#define talloc(type, num) (type *) malloc(sizeof(type)*(num))
+
+/* Decoding schedules are kept until they take this much memory, and at most
+   this many decoding plans are kept. */
+
+#define JERASURE_CODEC_SCHEDULE_BYTES (4*1024*1024)
+#define JERASURE_CODEC_MAX_PLANS 256
+
+struct jerasure_codec {
+  jerasure_technique technique;
+  int k, m, w;
+  int packetsize;
+  int altmap;                         /* Chunks are in the ALTMAP layout */
+  int *matrix;                        /* NULL for the bitmatrix-only codes */
+  int *bitmatrix;                     /* NULL for Reed-Solomon */
+  int *X, *Y;                         /* Cauchy points, if the inverse has a closed form */
+  galois_region_table **tables;       /* Region tables for the matrix, or NULL */
+  jerasure_flat_schedule *schedule;   /* Encoding schedule for bitmatrix codes */
+  jerasure_plan_cache *plans;         /* Decoding, for Reed-Solomon */
+  jerasure_lazy_schedule_cache *schedules;  /* Decoding, for bitmatrix codes */
+  char **ptrs;                        /* k+m pointers of scratch */
+  const jerasure_kernel_set *kernels; /* Generated kernels, or NULL */
+};
+
+/* The registered kernel tables, and the ones from plugins, on one list */
+
+typedef struct kernel_table {
+  const jerasure_kernel_set *sets;
+  struct kernel_table *next;
+} kernel_table;
+
+static kernel_table *kernel_tables = NULL;
+static pthread_mutex_t kernel_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t plugin_once = PTHREAD_ONCE_INIT;
+
+static int add_kernel_table(const jerasure_kernel_set *sets)
+{
+  kernel_table *t;
+
+  t = talloc(kernel_table, 1);
+  if (t == NULL) return -1;
+  t->sets = sets;
+  pthread_mutex_lock(&kernel_lock);
+  t->next = kernel_tables;
+  kernel_tables = t;
+  pthread_mutex_unlock(&kernel_lock);
+  return 0;
+}
+
+int jerasure_codec_register_kernels(const jerasure_kernel_set *sets)
+{
+  return add_kernel_table(sets);
+}
+
+/* The plugins stay loaded until the process exits.  In setuid programs,
+   secure_getenv ignores JERASURE_PLUGINS, so it can't load the user's code. */
+
+static void load_plugins(void)
+{
+#ifdef HAVE_DLOPEN
+  char *env, *list, *path, *save;
+  void *handle;
+  const jerasure_kernel_set *sets;
+
+#ifdef HAVE_SECURE_GETENV
+  env = secure_getenv("JERASURE_PLUGINS");
+#else
+  env = getenv("JERASURE_PLUGINS");
+#endif
+  if (env == NULL) return;
+  list = strdup(env);
+  if (list == NULL) return;
+
+  for (path = strtok_r(list, ":", &save); path != NULL; path = strtok_r(NULL, ":", &save)) {
+    handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (handle == NULL) {
+      fprintf(stderr, "jerasure: can't load plugin %s: %s\n", path, dlerror());
+      continue;
+    }
+    sets = (const jerasure_kernel_set *) dlsym(handle, "jerasure_kernel_sets");
+    if (sets == NULL) {
+      fprintf(stderr, "jerasure: plugin %s has no jerasure_kernel_sets\n", path);
+      dlclose(handle);
+    } else if (add_kernel_table(sets) < 0) {
+      fprintf(stderr, "jerasure: can't register plugin %s: out of memory\n", path);
+      dlclose(handle);
+    }
+  }
+  free(list);
+#endif
+}
+
+static const jerasure_kernel_set *find_kernels(jerasure_codec *codec)
+{
+  kernel_table *t;
+  const jerasure_kernel_set *s, *found;
+
+  if (codec->bitmatrix == NULL || codec->k + codec->m > 64) return NULL;
+  pthread_once(&plugin_once, load_plugins);
+
+  found = NULL;
+  pthread_mutex_lock(&kernel_lock);
+  for (t = kernel_tables; t != NULL && found == NULL; t = t->next) {
+    for (s = t->sets; s->encode != NULL; s++) {
+      if (s->technique == codec->technique && s->k == codec->k && s->m == codec->m &&
+          s->w == codec->w && s->packetsize == codec->packetsize) {
+        found = s;
+        break;
+      }
+    }
+  }
+  pthread_mutex_unlock(&kernel_lock);
+  return found;
+}
+
+static jerasure_kernel find_decode_kernel(const jerasure_kernel_set *kernels, int *erasures)
+{
+  uint64_t erased;
+  int i, lo, hi, mid;
+
+  erased = 0;
+  for (i = 0; erasures[i] != -1; i++) {
+    if (erasures[i] < 0 || erasures[i] >= 64) return NULL;
+    erased |= ((uint64_t) 1 << erasures[i]);
+  }
+
+  lo = 0;
+  hi = kernels->ndecoders-1;
+  while (lo <= hi) {
+    mid = (lo+hi)/2;
+    if (kernels->decoders[mid].erased == erased) return kernels->decoders[mid].decode;
+    if (kernels->decoders[mid].erased < erased) lo = mid+1; else hi = mid-1;
+  }
+  return NULL;
+}
+
+/* The number of erasure patterns that can be decoded, capped at max */
+
+static int n_patterns(int n, int m, int max)
+{
+  long total, c;
+  int e;
+
+  total = 0;
+  c = 1;
+  for (e = 1; e <= m && total < max; e++) {
+    c = c * (n-e+1) / e;
+    total += c;
+  }
+  return (total < max) ? (int) total : max;
+}
+
+/* The lazy schedule cache's decoder for Cauchy codes */
+
+static int cauchy_decoding_rows(void *arg, int *erased, int nrows, int *row_ids,
+                                int *decoding_rows, int *dm_ids)
+{
+  jerasure_codec *codec = (jerasure_codec *) arg;
+
+  return cauchy_make_decoding_rows(codec->k, codec->m, codec->w, codec->matrix, codec->X, codec->Y,
+                                   erased, nrows, row_ids, decoding_rows, dm_ids);
+}
+
+/* Both Cauchy constructions use X[i] = i and Y[j] = m+j, but the good matrix
+   for m = 2 isn't Cauchy, so it's checked once here rather than on every miss. */
+
+static void set_up_cauchy_points(jerasure_codec *codec)
+{
+  int *erased, *dm_ids;
+  int i;
+
+  codec->X = talloc(int, codec->m);
+  codec->Y = talloc(int, codec->k);
+  erased = (int *) calloc(codec->k+codec->m, sizeof(int));
+  dm_ids = talloc(int, codec->k);
+  if (codec->X != NULL && codec->Y != NULL && erased != NULL && dm_ids != NULL) {
+    for (i = 0; i < codec->m; i++) codec->X[i] = i;
+    for (i = 0; i < codec->k; i++) codec->Y[i] = codec->m+i;
+    if (cauchy_make_decoding_rows(codec->k, codec->m, codec->w, codec->matrix, codec->X, codec->Y,
+                                  erased, 0, NULL, NULL, dm_ids) == 0) {
+      free(erased);
+      free(dm_ids);
+      return;
+    }
+  }
+  free(codec->X);
+  free(codec->Y);
+  codec->X = NULL;
+  codec->Y = NULL;
+  free(erased);
+  free(dm_ids);
+}
+
+static jerasure_codec *codec_new(jerasure_technique technique, int k, int m, int w,
+                                 int packetsize, int altmap)
+{
+  jerasure_codec *codec;
+  int bitmatrix_code;
+  int **schedule;
+
+  if (k <= 0 || m <= 0 || w <= 0 || w > 32) return NULL;
+  if (altmap && technique != JERASURE_REED_SOL_VAN) return NULL;
+
+  codec = talloc(jerasure_codec, 1);
+  if (codec == NULL) return NULL;
+  memset(codec, 0, sizeof(jerasure_codec));
+  codec->technique = technique;
+  codec->k = k;
+  codec->m = m;
+  codec->w = w;
+  codec->packetsize = packetsize;
+  codec->altmap = altmap;
+
+  bitmatrix_code = 1;
+  switch (technique) {
+    case JERASURE_REED_SOL_VAN:
+      if (w != 4 && w != 8 && w != 16 && w != 32) break;
+      codec->matrix = reed_sol_vandermonde_coding_matrix(k, m, w);
+      bitmatrix_code = 0;
+      break;
+    case JERASURE_REED_SOL_R6:
+      if (m != 2 || (w != 8 && w != 16 && w != 32)) break;
+      codec->matrix = reed_sol_r6_coding_matrix(k, w);
+      bitmatrix_code = 0;
+      break;
+    case JERASURE_CAUCHY_ORIG:
+      codec->matrix = cauchy_original_coding_matrix(k, m, w);
+      if (codec->matrix != NULL) codec->bitmatrix = jerasure_matrix_to_bitmatrix(k, m, w, codec->matrix);
+      break;
+    case JERASURE_CAUCHY_GOOD:
+      codec->matrix = cauchy_good_general_coding_matrix(k, m, w);
+      if (codec->matrix != NULL) codec->bitmatrix = jerasure_matrix_to_bitmatrix(k, m, w, codec->matrix);
+      break;
+    case JERASURE_LIBERATION:
+      if (m == 2) codec->bitmatrix = liberation_coding_bitmatrix(k, w);
+      break;
+    case JERASURE_BLAUM_ROTH:
+      if (m == 2) codec->bitmatrix = blaum_roth_coding_bitmatrix(k, w);
+      break;
+    case JERASURE_LIBER8TION:
+      if (m == 2 && w == 8) codec->bitmatrix = liber8tion_coding_bitmatrix(k);
+      break;
+  }
+
+  if (bitmatrix_code) {
+    if (codec->bitmatrix == NULL || packetsize <= 0 || packetsize % sizeof(long) != 0) {
+      jerasure_codec_free(codec);
+      return NULL;
+    }
+    schedule = jerasure_smart_bitmatrix_to_schedule(k, m, w, codec->bitmatrix);
+    if (schedule != NULL) {
+      codec->schedule = jerasure_flatten_schedule(schedule, packetsize);
+      jerasure_free_schedule(schedule);
+    }
+    codec->schedules = jerasure_make_lazy_schedule_cache(k, m, w, codec->bitmatrix, 1,
+                                                         JERASURE_CODEC_SCHEDULE_BYTES);
+    if (codec->schedule == NULL || codec->schedules == NULL) {
+      jerasure_codec_free(codec);
+      return NULL;
+    }
+    if (codec->matrix != NULL) {
+      set_up_cauchy_points(codec);
+      if (codec->X != NULL) {
+        jerasure_set_lazy_schedule_cache_decoder(codec->schedules, cauchy_decoding_rows, codec);
+      }
+    }
+  } else {
+    if (codec->matrix == NULL) {
+      jerasure_codec_free(codec);
+      return NULL;
+    }
+
+    /* RAID-6 decodes in closed form, and needs no plans */
+
+    if (technique != JERASURE_REED_SOL_R6) {
+      if (altmap) {
+        codec->tables = jerasure_matrix_to_altmap_region_tables(m, k, w, codec->matrix);
+      } else {
+        codec->tables = jerasure_matrix_to_region_tables(m, k, w, codec->matrix);
+      }
+      codec->plans = jerasure_generate_plan_cache(k, m, w, codec->matrix, 1,
+                                                  n_patterns(k+m, m, JERASURE_CODEC_MAX_PLANS));
+      if (codec->plans == NULL || (altmap && codec->tables == NULL)) {
+        jerasure_codec_free(codec);
+        return NULL;
+      }
+      jerasure_set_plan_cache_altmap(codec->plans, altmap);
+    }
+  }
+
+  codec->ptrs = talloc(char *, k+m);
+  if (codec->ptrs == NULL) {
+    jerasure_codec_free(codec);
+    return NULL;
+  }
+  codec->kernels = find_kernels(codec);
+  return codec;
+}
+
+jerasure_codec *jerasure_codec_new(jerasure_technique technique, int k, int m, int w, int packetsize)
+{
+  return codec_new(technique, k, m, w, packetsize, 0);
+}
+
+jerasure_codec *jerasure_codec_new_altmap(jerasure_technique technique, int k, int m, int w,
+                                          int packetsize)
+{
+  return codec_new(technique, k, m, w, packetsize, 1);
+}
+
+void jerasure_codec_free(jerasure_codec *codec)
+{
+  if (codec == NULL) return;
+  if (codec->schedule != NULL) jerasure_free_flat_schedule(codec->schedule);
+  if (codec->schedules != NULL) jerasure_free_lazy_schedule_cache(codec->schedules);
+  if (codec->plans != NULL) jerasure_free_plan_cache(codec->plans);
+  free(codec->matrix);
+  free(codec->bitmatrix);
+  free(codec->X);
+  free(codec->Y);
+  jerasure_free_region_tables(codec->tables, codec->k*codec->m);
+  free(codec->ptrs);
+  free(codec);
+}
+
+static int jerasure_codec_check_size(jerasure_codec *codec, int size)
+{
+  if (size < 0) return -1;
+  if (codec->bitmatrix != NULL) return (size % (codec->packetsize*codec->w) == 0) ? 0 : -1;
+  if (codec->altmap) return (size % (2*codec->w) == 0) ? 0 : -1;
+  return (size % sizeof(long) == 0) ? 0 : -1;
+}
+
+int jerasure_codec_encode(jerasure_codec *codec, char **data_ptrs, char **coding_ptrs, int size)
+{
+  int i, k, m, tdone, stride;
+
+  if (jerasure_codec_check_size(codec, size) < 0) return -1;
+  k = codec->k;
+  m = codec->m;
+
+  switch (codec->technique) {
+    case JERASURE_REED_SOL_VAN:
+      jerasure_matrix_multi_dotprod_tables(k, codec->w, codec->matrix, codec->tables, NULL, m,
+                                           NULL, NULL, data_ptrs, coding_ptrs, size);
+      return 0;
+    case JERASURE_REED_SOL_R6:
+      return reed_sol_r6_encode(k, codec->w, data_ptrs, coding_ptrs, size) ? 0 : -1;
+    default:
+      break;
+  }
+
+  if (codec->kernels != NULL) {
+    codec->kernels->encode(data_ptrs, coding_ptrs, size);
+    return 0;
+  }
+
+  /* This is jerasure_flat_schedule_encode, with the codec's pointers */
+
+  stride = codec->packetsize*codec->w;
+  for (i = 0; i < k; i++) codec->ptrs[i] = data_ptrs[i];
+  for (i = 0; i < m; i++) codec->ptrs[i+k] = coding_ptrs[i];
+  for (tdone = 0; tdone < size; tdone += stride) {
+    jerasure_do_flat_operations(codec->ptrs, codec->schedule);
+    for (i = 0; i < k+m; i++) codec->ptrs[i] += stride;
+  }
+  return 0;
+}
+
+int jerasure_codec_decode(jerasure_codec *codec, int *erasures,
+                          char **data_ptrs, char **coding_ptrs, int size)
+{
+  jerasure_kernel kernel;
+
+  if (jerasure_codec_check_size(codec, size) < 0) return -1;
+  if (erasures[0] == -1) return 0;
+
+  if (codec->kernels != NULL) {
+    kernel = find_decode_kernel(codec->kernels, erasures);
+    if (kernel != NULL) {
+      kernel(data_ptrs, coding_ptrs, size);
+      return 0;
+    }
+  }
+  if (codec->technique == JERASURE_REED_SOL_R6) {
+    return reed_sol_r6_decode(codec->k, codec->w, erasures, data_ptrs, coding_ptrs, size);
+  }
+  if (codec->bitmatrix != NULL) {
+    return jerasure_schedule_decode_lazy_cache_scratch(codec->schedules, erasures, data_ptrs,
+                                                       coding_ptrs, size, codec->packetsize,
+                                                       codec->ptrs);
+  }
+  return jerasure_plan_decode_cache(codec->plans, erasures, data_ptrs, coding_ptrs, size);
+}
+
+int *jerasure_codec_matrix(jerasure_codec *codec)
+{
+  return codec->matrix;
+}
+
+int *jerasure_codec_bitmatrix(jerasure_codec *codec)
+{
+  return codec->bitmatrix;
+}
+
+int jerasure_codec_has_kernels(jerasure_codec *codec)
+{
+  return codec->kernels != NULL;
+}
@@ -0,0 +1,432 @@
+/* *
+ * Copyright (c) 2014, James S. Plank and Kevin Greenan
+ * All rights reserved.
+ *
+ * Jerasure - A C/C++ Library for a Variety of Reed-Solomon and RAID-6 Erasure
+ * Coding Techniques
+ *
+ * Revision 2.0: Galois Field backend now links to GF-Complete
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  - Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ *  - Neither the name of the University of Tennessee nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Multithreaded versions of the encoding and decoding routines.  The regions
+   are split on word or packet boundaries and the pieces are handed to a
+   persistent pool of worker threads.  The calling thread works on one piece
+   too.  Each piece is coded with the single-threaded routines. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+#include <sched.h>
+#endif
+
+#include "galois.h"
+#include "jerasure.h"
+#include "jerasure_private.h"
+
+#define talloc(type, num) (type *) malloc(sizeof(type)*(num))
+
+enum mt_op { MT_MATRIX_ENCODE, MT_BITMATRIX_ENCODE, MT_SCHEDULE_ENCODE,
+             MT_MATRIX_DECODE, MT_SCHEDULE_DECODE_CACHE };
+
+typedef struct mt_job {
+  enum mt_op op;
+  int k, m, w;
+  int *matrix;
+  int **schedule;
+  int ***scache;
+  jerasure_decoding_plan *plan;
+  int *erasures;
+  char **data_ptrs;
+  char **coding_ptrs;
+  int packetsize;
+
+  int nparts;
+  int *offsets;             /* Part i is bytes offsets[i] to offsets[i+1]-1 */
+  char **ptrs;              /* (k+m) pointers for each part, from the pool */
+
+  int next;                 /* Next part to hand out */
+  int remaining;            /* Parts that have not finished */
+  int ret;
+} mt_job;
+
+static struct {
+  pthread_mutex_t lock;
+  pthread_cond_t work;
+  pthread_cond_t done;
+  pthread_mutex_t submit;   /* One job at a time */
+  pthread_t *threads;
+  int nworkers;
+  int nthreads;             /* Workers plus the calling thread */
+  int pin;
+  int shutdown;
+  mt_job *job;
+  int *offsets;             /* nthreads+1 part offsets, for every job */
+  char **ptrs;              /* Part pointers, for every job */
+  int ndevices;             /* ptrs has nthreads*ndevices of them */
+} pool = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER,
+           PTHREAD_MUTEX_INITIALIZER, NULL, 0, 0, 0, 0, NULL, NULL, NULL, 0 };
+
+/* Room for this many devices per part is made when the workers start.  Jobs
+   with more grow it, once. */
+
+#define MT_DEVICES 32
+
+static void mt_do_part(mt_job *job, int part)
+{
+  int i, k, m, size, ret;
+  char **dp, **cp;
+
+  k = job->k;
+  m = job->m;
+  dp = job->ptrs + part*(k+m);
+  cp = dp + k;
+  for (i = 0; i < k; i++) dp[i] = job->data_ptrs[i] + job->offsets[part];
+  for (i = 0; i < m; i++) cp[i] = job->coding_ptrs[i] + job->offsets[part];
+  size = job->offsets[part+1] - job->offsets[part];
+
+  ret = 0;
+  switch (job->op) {
+    case MT_MATRIX_ENCODE:
+      jerasure_matrix_encode(k, m, job->w, job->matrix, dp, cp, size);
+      break;
+    case MT_BITMATRIX_ENCODE:
+      jerasure_bitmatrix_encode(k, m, job->w, job->matrix, dp, cp, size, job->packetsize);
+      break;
+    case MT_SCHEDULE_ENCODE:
+      jerasure_schedule_encode(k, m, job->w, job->schedule, dp, cp, size, job->packetsize);
+      break;
+    case MT_MATRIX_DECODE:
+      ret = jerasure_plan_decode(job->plan, dp, cp, size);
+      break;
+    case MT_SCHEDULE_DECODE_CACHE:
+      ret = jerasure_schedule_decode_cache(k, m, job->w, job->scache, job->erasures,
+                                           dp, cp, size, job->packetsize);
+      break;
+  }
+
+  pthread_mutex_lock(&pool.lock);
+  if (ret < 0) job->ret = -1;
+  job->remaining--;
+  if (job->remaining == 0) pthread_cond_broadcast(&pool.done);
+  pthread_mutex_unlock(&pool.lock);
+}
+
+static void *mt_worker(void *arg)
+{
+  mt_job *job;
+  int part;
+
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+  if (pool.pin) {
+    cpu_set_t cpus;
+    long ncpus;
+
+    ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (ncpus > 0) {
+      CPU_ZERO(&cpus);
+      CPU_SET((int) ((long) arg % ncpus), &cpus);
+      pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    }
+  }
+#else
+  (void) arg;
+#endif
+
+  pthread_mutex_lock(&pool.lock);
+  while (1) {
+    while (!pool.shutdown && (pool.job == NULL || pool.job->next == pool.job->nparts)) {
+      pthread_cond_wait(&pool.work, &pool.lock);
+    }
+    if (pool.shutdown) break;
+    job = pool.job;
+    part = job->next++;
+    pthread_mutex_unlock(&pool.lock);
+    mt_do_part(job, part);
+    pthread_mutex_lock(&pool.lock);
+  }
+  pthread_mutex_unlock(&pool.lock);
+  return NULL;
+}
+
+static void mt_stop_workers()
+{
+  int i;
+
+  pthread_mutex_lock(&pool.lock);
+  pool.shutdown = 1;
+  pthread_cond_broadcast(&pool.work);
+  pthread_mutex_unlock(&pool.lock);
+
+  for (i = 0; i < pool.nworkers; i++) pthread_join(pool.threads[i], NULL);
+  free(pool.threads);
+  pool.threads = NULL;
+  pool.nworkers = 0;
+  pool.shutdown = 0;
+}
+
+static void mt_free_buffers()
+{
+  free(pool.offsets);
+  free(pool.ptrs);
+  pool.offsets = NULL;
+  pool.ptrs = NULL;
+  pool.ndevices = 0;
+}
+
+static int mt_start_workers(int nthreads, int pin)
+{
+  int i;
+
+  pool.offsets = talloc(int, nthreads+1);
+  pool.ptrs = talloc(char *, nthreads*MT_DEVICES);
+  if (pool.offsets == NULL || pool.ptrs == NULL) {
+    mt_free_buffers();
+    pool.nthreads = 0;
+    return -1;
+  }
+  pool.ndevices = MT_DEVICES;
+  pool.nthreads = nthreads;
+  pool.pin = pin;
+  if (nthreads <= 1) return 0;
+
+  pool.threads = talloc(pthread_t, nthreads-1);
+  if (pool.threads == NULL) {
+    pool.nthreads = 1;
+    return -1;
+  }
+  for (i = 0; i < nthreads-1; i++) {
+    if (pthread_create(pool.threads+i, NULL, mt_worker, (void *) (long) (i+1)) != 0) {
+      pool.nworkers = i;
+      mt_stop_workers();
+      pool.nthreads = 1;
+      return -1;
+    }
+    pool.nworkers = i+1;
+  }
+  return 0;
+}
+
+int jerasure_mt_set_threads(int nthreads, int pin)
+{
+  int ret;
+
+  if (nthreads <= 0) {
+    nthreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (nthreads <= 0) nthreads = 1;
+  }
+
+  pthread_mutex_lock(&pool.submit);
+  mt_stop_workers();
+  mt_free_buffers();
+  ret = mt_start_workers(nthreads, pin);
+  pthread_mutex_unlock(&pool.submit);
+  return ret;
+}
+
+int jerasure_mt_get_threads()
+{
+  int nthreads;
+
+  pthread_mutex_lock(&pool.submit);
+  nthreads = pool.nthreads;
+  pthread_mutex_unlock(&pool.submit);
+  return (nthreads == 0) ? (int) sysconf(_SC_NPROCESSORS_ONLN) : nthreads;
+}
+
+void jerasure_mt_shutdown()
+{
+  pthread_mutex_lock(&pool.submit);
+  mt_stop_workers();
+  mt_free_buffers();
+  pool.nthreads = 0;
+  pthread_mutex_unlock(&pool.submit);
+}
+
+/* Splits size bytes into at most nthreads parts, each a multiple of unit bytes
+   (except that the last part picks up anything left over), and runs them.
+   Returns -1 if the job couldn't be run, and 0 if it was, with its result in
+   job->ret. */
+
+static int mt_run(mt_job *job, int size, int unit)
+{
+  int i, nunits, nparts;
+  char **ptrs;
+
+  pthread_mutex_lock(&pool.submit);
+  if (pool.nthreads == 0 && mt_start_workers((int) sysconf(_SC_NPROCESSORS_ONLN), 0) < 0) {
+    pthread_mutex_unlock(&pool.submit);
+    return -1;
+  }
+  if (job->k+job->m > pool.ndevices) {
+    ptrs = (char **) realloc(pool.ptrs, sizeof(char *)*pool.nthreads*(job->k+job->m));
+    if (ptrs == NULL) {
+      pthread_mutex_unlock(&pool.submit);
+      return -1;
+    }
+    pool.ptrs = ptrs;
+    pool.ndevices = job->k+job->m;
+  }
+
+  nunits = size / unit;
+  nparts = pool.nthreads;
+  if (nparts > nunits) nparts = nunits;
+  if (nparts < 1) nparts = 1;
+
+  job->offsets = pool.offsets;
+  job->ptrs = pool.ptrs;
+  for (i = 0; i < nparts; i++) {
+    job->offsets[i] = (int) (((long long) nunits * i / nparts) * unit);
+  }
+  job->offsets[nparts] = size;
+
+  job->nparts = nparts;
+  job->next = 0;
+  job->remaining = nparts;
+  job->ret = 0;
+
+  pthread_mutex_lock(&pool.lock);
+  pool.job = job;
+  pthread_cond_broadcast(&pool.work);
+  while (job->next < nparts) {
+    i = job->next++;
+    pthread_mutex_unlock(&pool.lock);
+    mt_do_part(job, i);
+    pthread_mutex_lock(&pool.lock);
+  }
+  while (job->remaining > 0) pthread_cond_wait(&pool.done, &pool.lock);
+  pool.job = NULL;
+  pthread_mutex_unlock(&pool.lock);
+
+  pthread_mutex_unlock(&pool.submit);
+  return 0;
+}
+
+static void mt_job_init(mt_job *job, enum mt_op op, int k, int m, int w,
+                        char **data_ptrs, char **coding_ptrs)
+{
+  memset(job, 0, sizeof(mt_job));
+  job->op = op;
+  job->k = k;
+  job->m = m;
+  job->w = w;
+  job->data_ptrs = data_ptrs;
+  job->coding_ptrs = coding_ptrs;
+}
+
+/* Matrix coding is split on 64-byte boundaries when it can be, so that the
+   SIMD region code sees aligned pieces.  Otherwise the pieces are longwords. */
+
+static int mt_matrix_unit(int size)
+{
+  return (size % 64 == 0) ? 64 : sizeof(long);
+}
+
+void jerasure_matrix_encode_mt(int k, int m, int w, int *matrix,
+                          char **data_ptrs, char **coding_ptrs, int size)
+{
+  mt_job job;
+
+  mt_job_init(&job, MT_MATRIX_ENCODE, k, m, w, data_ptrs, coding_ptrs);
+  job.matrix = matrix;
+  if (mt_run(&job, size, mt_matrix_unit(size)) < 0) {
+    jerasure_matrix_encode(k, m, w, matrix, data_ptrs, coding_ptrs, size);
+  }
+}
+
+void jerasure_bitmatrix_encode_mt(int k, int m, int w, int *bitmatrix,
+                            char **data_ptrs, char **coding_ptrs, int size, int packetsize)
+{
+  mt_job job;
+
+  mt_job_init(&job, MT_BITMATRIX_ENCODE, k, m, w, data_ptrs, coding_ptrs);
+  job.matrix = bitmatrix;
+  job.packetsize = packetsize;
+  if (mt_run(&job, size, packetsize*w) < 0) {
+    jerasure_bitmatrix_encode(k, m, w, bitmatrix, data_ptrs, coding_ptrs, size, packetsize);
+  }
+}
+
+void jerasure_schedule_encode_mt(int k, int m, int w, int **schedule,
+                                  char **data_ptrs, char **coding_ptrs, int size, int packetsize)
+{
+  mt_job job;
+
+  mt_job_init(&job, MT_SCHEDULE_ENCODE, k, m, w, data_ptrs, coding_ptrs);
+  job.schedule = schedule;
+  job.packetsize = packetsize;
+  if (mt_run(&job, size, packetsize*w) < 0) {
+    jerasure_schedule_encode(k, m, w, schedule, data_ptrs, coding_ptrs, size, packetsize);
+  }
+}
+
+int jerasure_matrix_decode_mt(int k, int m, int w, 
+                          int *matrix, int row_k_ones, int *erasures,
+                          char **data_ptrs, char **coding_ptrs, int size)
+{
+  mt_job job;
+  jerasure_decoding_plan *plan;
+
+  plan = jerasure_make_oneshot_decoding_plan(k, m, w, matrix, row_k_ones, erasures);
+  if (plan == NULL) return -1;
+
+  mt_job_init(&job, MT_MATRIX_DECODE, k, m, w, data_ptrs, coding_ptrs);
+  job.plan = plan;
+  if (mt_run(&job, size, mt_matrix_unit(size)) < 0) {
+    jerasure_plan_decode(plan, data_ptrs, coding_ptrs, size);
+  }
+  jerasure_free_decoding_plan(plan);
+  return 0;
+}
+
+int jerasure_schedule_decode_cache_mt(int k, int m, int w, int ***scache, int *erasures,
+                            char **data_ptrs, char **coding_ptrs, int size, int packetsize)
+{
+  mt_job job;
+
+  mt_job_init(&job, MT_SCHEDULE_DECODE_CACHE, k, m, w, data_ptrs, coding_ptrs);
+  job.scache = scache;
+  job.erasures = erasures;
+  job.packetsize = packetsize;
+  if (mt_run(&job, size, packetsize*w) < 0) {
+    return jerasure_schedule_decode_cache(k, m, w, scache, erasures, data_ptrs, coding_ptrs,
+                                          size, packetsize);
+  }
+  return job.ret;
+}
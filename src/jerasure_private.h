@@ -0,0 +1,16 @@
+/* Private to the library: routines that jerasure.c shares with the other
+   source files, but that aren't part of the API. */
+
+#ifndef JERASURE_INCLUDED__JERASURE_PRIVATE_H
+#define JERASURE_INCLUDED__JERASURE_PRIVATE_H
+
+#include "jerasure.h"
+
+/* A decoding plan for one decode: it has no region tables, so the rows are
+   multiplied through the field, as jerasure_matrix_decode always has.  Free
+   it with jerasure_free_decoding_plan. */
+
+jerasure_decoding_plan *jerasure_make_oneshot_decoding_plan(int k, int m, int w, int *matrix,
+                                                            int row_k_ones, int *erasures);
+
+#endif
@@ -44,15 +44,22 @@
    Revision 1.0 - 2007: James S. Plank
  */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
+#include <stdint.h>
 
 #include <gf_complete.h>
 #include "galois.h"
 #include "jerasure.h"
 #include "reed_sol.h"
+#include "galois_simd.h"
 
 #define talloc(type, num) (type *) malloc(sizeof(type)*(num))
 
@@ -100,77 +107,428 @@ int *reed_sol_vandermonde_coding_matrix(int k, int m, int w)
 
 static int prim08 = -1;
 static gf_t GF08;
+static pthread_once_t GF08_once = PTHREAD_ONCE_INIT;
 
-void reed_sol_galois_w08_region_multby_2(char *region, int nbytes)
+static void reed_sol_init_w08_multby_2(void)
 {
-  if (prim08 == -1) {
-    prim08 = galois_single_multiply((1 << 7), 2, 8);
-    if (!gf_init_hard(&GF08, 8, GF_MULT_BYTWO_b, GF_REGION_DEFAULT, GF_DIVIDE_DEFAULT,
-                      prim08, 0, 0, NULL, NULL)) {
-      fprintf(stderr, "Error: Can't initialize the GF for reed_sol_galois_w08_region_multby_2\n");
-      assert(0);
-    }
+  prim08 = galois_single_multiply((1 << 7), 2, 8);
+  if (!gf_init_hard(&GF08, 8, GF_MULT_BYTWO_b, GF_REGION_DEFAULT, GF_DIVIDE_DEFAULT,
+                    prim08, 0, 0, NULL, NULL)) {
+    fprintf(stderr, "Error: Can't initialize the GF for reed_sol_galois_w08_region_multby_2\n");
+    assert(0);
   }
+}
+
+void reed_sol_galois_w08_region_multby_2(char *region, int nbytes)
+{
+  pthread_once(&GF08_once, reed_sol_init_w08_multby_2);
   GF08.multiply_region.w32(&GF08, region, region, 2, nbytes, 0);
 }
 
 static int prim16 = -1;
 static gf_t GF16;
+static pthread_once_t GF16_once = PTHREAD_ONCE_INIT;
 
-void reed_sol_galois_w16_region_multby_2(char *region, int nbytes)
+static void reed_sol_init_w16_multby_2(void)
 {
-  if (prim16 == -1) {
-    prim16 = galois_single_multiply((1 << 15), 2, 16);
-    if (!gf_init_hard(&GF16, 16, GF_MULT_BYTWO_b, GF_REGION_DEFAULT, GF_DIVIDE_DEFAULT,
-                      prim16, 0, 0, NULL, NULL)) {
-      fprintf(stderr, "Error: Can't initialize the GF for reed_sol_galois_w16_region_multby_2\n");
-      assert(0);
-    }
+  prim16 = galois_single_multiply((1 << 15), 2, 16);
+  if (!gf_init_hard(&GF16, 16, GF_MULT_BYTWO_b, GF_REGION_DEFAULT, GF_DIVIDE_DEFAULT,
+                    prim16, 0, 0, NULL, NULL)) {
+    fprintf(stderr, "Error: Can't initialize the GF for reed_sol_galois_w16_region_multby_2\n");
+    assert(0);
   }
+}
+
+void reed_sol_galois_w16_region_multby_2(char *region, int nbytes)
+{
+  pthread_once(&GF16_once, reed_sol_init_w16_multby_2);
   GF16.multiply_region.w32(&GF16, region, region, 2, nbytes, 0);
 }
 
 static int prim32 = -1;
 static gf_t GF32;
+static pthread_once_t GF32_once = PTHREAD_ONCE_INIT;
+
+static void reed_sol_init_w32_multby_2(void)
+{
+  prim32 = galois_single_multiply(((gf_val_32_t)1 << 31), 2, 32);
+  if (!gf_init_hard(&GF32, 32, GF_MULT_BYTWO_b, GF_REGION_DEFAULT, GF_DIVIDE_DEFAULT,
+                    prim32, 0, 0, NULL, NULL)) {
+    fprintf(stderr, "Error: Can't initialize the GF for reed_sol_galois_w32_region_multby_2\n");
+    assert(0);
+  }
+}
 
 void reed_sol_galois_w32_region_multby_2(char *region, int nbytes)
 {
-  if (prim32 == -1) {
-    prim32 = galois_single_multiply(((gf_val_32_t)1 << 31), 2, 32);
-    if (!gf_init_hard(&GF32, 32, GF_MULT_BYTWO_b, GF_REGION_DEFAULT, GF_DIVIDE_DEFAULT,
-                      prim32, 0, 0, NULL, NULL)) {
-      fprintf(stderr, "Error: Can't initialize the GF for reed_sol_galois_w32_region_multby_2\n");
-      assert(0);
+  pthread_once(&GF32_once, reed_sol_init_w32_multby_2);
+  GF32.multiply_region.w32(&GF32, region, region, 2, nbytes, 0);
+}
+
+/* The RAID-6 encoder computes P = D0 ^ ... ^ Dk-1 and, by Horner's rule,
+   Q = (((Dk-1)*2 ^ Dk-2)*2 ^ ...)*2 ^ D0, for a vector of words at a time
+   with both parities held in registers.  The data is read once and each
+   coding region is written once.  Multiplying by 2 is a shift, plus an XOR
+   of the low bits of the field's polynomial into the words whose high bit
+   was set. */
+
+/* hibits has the high bit of every w-bit word set.  Each word of
+   (x & hibits) >> (w-1) is 0 or 1, so the multiply by prim cannot carry
+   between words. */
+
+static inline uint64_t r6_mul2_64(uint64_t x, uint64_t hibits, uint64_t prim, int w)
+{
+  uint64_t t;
+
+  t = x & hibits;
+  return ((x ^ t) << 1) ^ ((t >> (w-1)) * prim);
+}
+
+#ifdef GALOIS_X86
+/* The vector versions, one for each instruction set.  Each does what it can
+   from byte i on and returns where it stopped.  The inline ones are
+   specialized for each w by the switch that calls them. */
+
+static inline TARGET("sse2") __m128i r6_mul2_sse2(__m128i x, __m128i prim, int w)
+{
+  __m128i hi;
+
+  switch (w) {
+    case 8:  hi = _mm_cmplt_epi8(x, _mm_setzero_si128()); x = _mm_add_epi8(x, x); break;
+    case 16: hi = _mm_srai_epi16(x, 15); x = _mm_add_epi16(x, x); break;
+    default: hi = _mm_srai_epi32(x, 31); x = _mm_add_epi32(x, x); break;
+  }
+  return _mm_xor_si128(x, _mm_and_si128(hi, prim));
+}
+
+static inline TARGET("sse2") int sse2_r6_words(int k, int w, uint32_t prim, char **data_ptrs,
+                                               int offset, int x, int y, char *p, char *q,
+                                               int i, int size)
+{
+  __m128i vprim, vp, vq, vd;
+  int j;
+
+  vprim = (w == 8) ? _mm_set1_epi8(prim) :
+          (w == 16) ? _mm_set1_epi16(prim) : _mm_set1_epi32(prim);
+  for ( ; i + 16 <= size; i += 16) {
+    vp = vq = _mm_setzero_si128();
+    for (j = k-1; j >= 0; j--) {
+      vq = r6_mul2_sse2(vq, vprim, w);
+      if (j == x || j == y) continue;
+      vd = _mm_loadu_si128((__m128i *) (data_ptrs[j]+offset+i));
+      vp = _mm_xor_si128(vp, vd);
+      vq = _mm_xor_si128(vq, vd);
     }
+    _mm_storeu_si128((__m128i *) (p+i), vp);
+    _mm_storeu_si128((__m128i *) (q+i), vq);
   }
-  GF32.multiply_region.w32(&GF32, region, region, 2, nbytes, 0);
+  return i;
 }
 
-int reed_sol_r6_encode(int k, int w, char **data_ptrs, char **coding_ptrs, int size)
+static TARGET("sse2") int sse2_r6_encode_words(int k, int w, uint32_t prim, char **data_ptrs,
+                                               int offset, int x, int y, char *p, char *q,
+                                               int i, int size)
+{
+  switch (w) {
+    case 8:  return sse2_r6_words(k, 8, prim, data_ptrs, offset, x, y, p, q, i, size);
+    case 16: return sse2_r6_words(k, 16, prim, data_ptrs, offset, x, y, p, q, i, size);
+    default: return sse2_r6_words(k, 32, prim, data_ptrs, offset, x, y, p, q, i, size);
+  }
+}
+
+static inline TARGET("avx2") __m256i r6_mul2_avx2(__m256i x, __m256i prim, int w)
+{
+  __m256i hi;
+
+  switch (w) {
+    case 8:  hi = _mm256_cmpgt_epi8(_mm256_setzero_si256(), x); x = _mm256_add_epi8(x, x); break;
+    case 16: hi = _mm256_srai_epi16(x, 15); x = _mm256_add_epi16(x, x); break;
+    default: hi = _mm256_srai_epi32(x, 31); x = _mm256_add_epi32(x, x); break;
+  }
+  return _mm256_xor_si256(x, _mm256_and_si256(hi, prim));
+}
+
+static inline TARGET("avx2") int avx2_r6_words(int k, int w, uint32_t prim, char **data_ptrs,
+                                               int offset, int x, int y, char *p, char *q,
+                                               int i, int size)
+{
+  __m256i vprim, vp, vq, vd;
+  int j;
+
+  vprim = (w == 8) ? _mm256_set1_epi8(prim) :
+          (w == 16) ? _mm256_set1_epi16(prim) : _mm256_set1_epi32(prim);
+  for ( ; i + 32 <= size; i += 32) {
+    vp = vq = _mm256_setzero_si256();
+    for (j = k-1; j >= 0; j--) {
+      vq = r6_mul2_avx2(vq, vprim, w);
+      if (j == x || j == y) continue;
+      vd = _mm256_loadu_si256((__m256i *) (data_ptrs[j]+offset+i));
+      vp = _mm256_xor_si256(vp, vd);
+      vq = _mm256_xor_si256(vq, vd);
+    }
+    _mm256_storeu_si256((__m256i *) (p+i), vp);
+    _mm256_storeu_si256((__m256i *) (q+i), vq);
+  }
+  return i;
+}
+
+static TARGET("avx2") int avx2_r6_encode_words(int k, int w, uint32_t prim, char **data_ptrs,
+                                               int offset, int x, int y, char *p, char *q,
+                                               int i, int size)
+{
+  switch (w) {
+    case 8:  i = avx2_r6_words(k, 8, prim, data_ptrs, offset, x, y, p, q, i, size); break;
+    case 16: i = avx2_r6_words(k, 16, prim, data_ptrs, offset, x, y, p, q, i, size); break;
+    default: i = avx2_r6_words(k, 32, prim, data_ptrs, offset, x, y, p, q, i, size); break;
+  }
+  return sse2_r6_encode_words(k, w, prim, data_ptrs, offset, x, y, p, q, i, size);
+}
+
+static inline TARGET(AVX512) __m512i r6_mul2_avx512(__m512i x, __m512i prim, int w)
+{
+  __m512i hi;
+
+  switch (w) {
+    case 8:  hi = _mm512_movm_epi8(_mm512_movepi8_mask(x)); x = _mm512_add_epi8(x, x); break;
+    case 16: hi = _mm512_srai_epi16(x, 15); x = _mm512_add_epi16(x, x); break;
+    default: hi = _mm512_srai_epi32(x, 31); x = _mm512_add_epi32(x, x); break;
+  }
+  return _mm512_xor_si512(x, _mm512_and_si512(hi, prim));
+}
+
+static inline TARGET(AVX512) int avx512_r6_words(int k, int w, uint32_t prim,
+                                                             char **data_ptrs, int offset,
+                                                             int x, int y, char *p, char *q,
+                                                             int size)
+{
+  __m512i vprim, vp, vq, vd;
+  int i, j;
+
+  vprim = (w == 8) ? _mm512_set1_epi8(prim) :
+          (w == 16) ? _mm512_set1_epi16(prim) : _mm512_set1_epi32(prim);
+  for (i = 0; i + 64 <= size; i += 64) {
+    vp = vq = _mm512_setzero_si512();
+    for (j = k-1; j >= 0; j--) {
+      vq = r6_mul2_avx512(vq, vprim, w);
+      if (j == x || j == y) continue;
+      vd = _mm512_loadu_si512((void *) (data_ptrs[j]+offset+i));
+      vp = _mm512_xor_si512(vp, vd);
+      vq = _mm512_xor_si512(vq, vd);
+    }
+    _mm512_storeu_si512((void *) (p+i), vp);
+    _mm512_storeu_si512((void *) (q+i), vq);
+  }
+  return i;
+}
+
+static TARGET(AVX512) int avx512_r6_encode_words(int k, int w, uint32_t prim,
+                                                             char **data_ptrs, int offset,
+                                                             int x, int y, char *p, char *q,
+                                                             int size)
 {
   int i;
 
-  /* First, put the XOR into coding region 0 */
+  switch (w) {
+    case 8:  i = avx512_r6_words(k, 8, prim, data_ptrs, offset, x, y, p, q, size); break;
+    case 16: i = avx512_r6_words(k, 16, prim, data_ptrs, offset, x, y, p, q, size); break;
+    default: i = avx512_r6_words(k, 32, prim, data_ptrs, offset, x, y, p, q, size); break;
+  }
+  return avx2_r6_encode_words(k, w, prim, data_ptrs, offset, x, y, p, q, i, size);
+}
+#endif
+
+/* Sets p to the XOR, and q to the RAID-6 Q parity, of size bytes at offset
+   in each data region.  Regions x and y (-1 for none) are taken to be zero,
+   which is what the decoder needs. */
+
+static inline void r6_encode_words(int k, int w, uint32_t prim, char **data_ptrs, int offset,
+                                   int x, int y, char *p, char *q, int size)
+{
+  int i, j, n;
+  uint64_t P, Q, d, hibits;
+  char *dp;
+
+  i = 0;
+
+#ifdef GALOIS_X86
+  switch (galois_get_isa()) {
+    case GALOIS_ISA_GFNI:
+    case GALOIS_ISA_AVX512:
+      i = avx512_r6_encode_words(k, w, prim, data_ptrs, offset, x, y, p, q, size);
+      break;
+    case GALOIS_ISA_AVX2:
+      i = avx2_r6_encode_words(k, w, prim, data_ptrs, offset, x, y, p, q, 0, size);
+      break;
+    case GALOIS_ISA_SSSE3:
+    case GALOIS_ISA_SSE2:
+      i = sse2_r6_encode_words(k, w, prim, data_ptrs, offset, x, y, p, q, 0, size);
+      break;
+    default:
+      break;
+  }
+#endif
+
+  hibits = (w == 8) ? 0x8080808080808080ULL :
+           (w == 16) ? 0x8000800080008000ULL : 0x8000000080000000ULL;
+
+  /* The last partial word is done in a zero-padded temporary */
+
+  for ( ; i < size; i += 8) {
+    n = (size - i < 8) ? size - i : 8;
+    P = Q = 0;
+    for (j = k-1; j >= 0; j--) {
+      Q = r6_mul2_64(Q, hibits, prim, w);
+      if (j == x || j == y) continue;
+      dp = data_ptrs[j]+offset+i;
+      d = 0;
+      memcpy(&d, dp, n);
+      P ^= d;
+      Q ^= d;
+    }
+    memcpy(p+i, &P, n);
+    memcpy(q+i, &Q, n);
+  }
+}
+
+/* The polynomial comes from the same place as for the multby_2 routines */
 
-  memcpy(coding_ptrs[0], data_ptrs[0], size);
+static int r6_prim(int w, uint32_t *prim)
+{
+  switch (w) {
+    case 8:
+      pthread_once(&GF08_once, reed_sol_init_w08_multby_2);
+      *prim = (uint32_t) prim08;
+      return 0;
+    case 16:
+      pthread_once(&GF16_once, reed_sol_init_w16_multby_2);
+      *prim = (uint32_t) prim16;
+      return 0;
+    case 32:
+      pthread_once(&GF32_once, reed_sol_init_w32_multby_2);
+      *prim = (uint32_t) prim32;
+      return 0;
+  }
+  return -1;
+}
+
+int reed_sol_r6_encode(int k, int w, char **data_ptrs, char **coding_ptrs, int size)
+{
+  uint32_t prim;
+
+  if (r6_prim(w, &prim) < 0) return 0;
+  switch (w) {
+    case 8:  r6_encode_words(k, 8, prim, data_ptrs, 0, -1, -1, coding_ptrs[0], coding_ptrs[1], size); break;
+    case 16: r6_encode_words(k, 16, prim, data_ptrs, 0, -1, -1, coding_ptrs[0], coding_ptrs[1], size); break;
+    case 32: r6_encode_words(k, 32, prim, data_ptrs, 0, -1, -1, coding_ptrs[0], coding_ptrs[1], size); break;
+  }
+  return 1;
+}
+
+/* The decoder works through the regions R6_CHUNK bytes at a time.  The
+   surviving data is read once, into the XOR and Q of the survivors, and
+   what is lost is solved for from those two chunks while they are still in
+   cache.  With Dj the data regions, Q = sum (2^j)*Dj, so:
+
+     Dx and P lost:   Dx = (Q ^ Q') / 2^x
+     Dx and Dy lost:  Dy = (Q ^ Q') * a ^ (P ^ P') * b,  Dx = (P ^ P') ^ Dy
+                      where b = 1 / (2^(y-x) ^ 1) and a = b / 2^x */
+
+#define R6_CHUNK 4096
 
-  for (i = 1; i < k; i++) galois_region_xor(data_ptrs[i], coding_ptrs[0], size);
+static void r6_region_multiply(int w, char *src, int c, int nbytes, char *dest, int add)
+{
+  switch (w) {
+    case 8:  galois_w08_region_multiply(src, c, nbytes, dest, add); break;
+    case 16: galois_w16_region_multiply(src, c, nbytes, dest, add); break;
+    case 32: galois_w32_region_multiply(src, c, nbytes, dest, add); break;
+  }
+}
 
-  /* Next, put the sum of (2^j)*Dj into coding region 1 */
+int reed_sol_r6_decode(int k, int w, int *erasures, char **data_ptrs, char **coding_ptrs, int size)
+{
+  long pbuf[R6_CHUNK/sizeof(long)], qbuf[R6_CHUNK/sizeof(long)];
+  char *pp, *qp, *srcs[2];
+  uint32_t prim;
+  int i, x, y, p_lost, q_lost, gx, a, b, offset, n;
+
+  if (r6_prim(w, &prim) < 0) return -1;
+
+  x = y = -1;
+  p_lost = q_lost = 0;
+  for (i = 0; erasures[i] != -1; i++) {
+    if (erasures[i] < 0 || erasures[i] > k+1) return -1;
+    if (erasures[i] == k) {
+      p_lost = 1;
+    } else if (erasures[i] == k+1) {
+      q_lost = 1;
+    } else if (x == -1 || x == erasures[i]) {
+      x = erasures[i];
+    } else if (y == -1 || y == erasures[i]) {
+      y = erasures[i];
+    } else {
+      return -1;
+    }
+  }
+  if ((x != -1) + (y != -1) + p_lost + q_lost > 2) return -1;
+  if (x == -1 && !p_lost && !q_lost) return 0;
+  if (y != -1 && y < x) {
+    i = x;
+    x = y;
+    y = i;
+  }
 
-  memcpy(coding_ptrs[1], data_ptrs[k-1], size);
+  /* gx = 2^x, and the constants for two lost data regions */
 
-  for (i = k-2; i >= 0; i--) {
+  gx = 1;
+  for (i = 0; i < x; i++) gx = galois_single_multiply(gx, 2, w);
+  a = b = 0;
+  if (y != -1) {
+    b = 1;
+    for (i = 0; i < y-x; i++) b = galois_single_multiply(b, 2, w);
+    b = galois_inverse(b ^ 1, w);
+    a = galois_single_divide(b, gx, w);
+  }
+
+  pp = (char *) pbuf;
+  qp = (char *) qbuf;
+  for (offset = 0; offset < size; offset += n) {
+    n = (size - offset < R6_CHUNK) ? size - offset : R6_CHUNK;
     switch (w) {
-      case 8:  reed_sol_galois_w08_region_multby_2(coding_ptrs[1], size); break;
-      case 16: reed_sol_galois_w16_region_multby_2(coding_ptrs[1], size); break;
-      case 32: reed_sol_galois_w32_region_multby_2(coding_ptrs[1], size); break;
-      default: return 0;
+      case 8:  r6_encode_words(k, 8, prim, data_ptrs, offset, x, y, pp, qp, n); break;
+      case 16: r6_encode_words(k, 16, prim, data_ptrs, offset, x, y, pp, qp, n); break;
+      case 32: r6_encode_words(k, 32, prim, data_ptrs, offset, x, y, pp, qp, n); break;
     }
 
-    galois_region_xor(data_ptrs[i], coding_ptrs[1], size);
+    if (x == -1) {
+      if (p_lost) memcpy(coding_ptrs[0]+offset, pp, n);
+      if (q_lost) memcpy(coding_ptrs[1]+offset, qp, n);
+
+    } else if (y != -1) {
+      galois_region_xor(coding_ptrs[0]+offset, pp, n);
+      galois_region_xor(coding_ptrs[1]+offset, qp, n);
+      r6_region_multiply(w, qp, a, n, data_ptrs[y]+offset, 0);
+      r6_region_multiply(w, pp, b, n, data_ptrs[y]+offset, 1);
+      srcs[0] = pp;
+      srcs[1] = data_ptrs[y]+offset;
+      galois_region_xor_multi(srcs, 2, data_ptrs[x]+offset, n, 0);
+
+    } else if (!p_lost) {
+      srcs[0] = pp;
+      srcs[1] = coding_ptrs[0]+offset;
+      galois_region_xor_multi(srcs, 2, data_ptrs[x]+offset, n, 0);
+      if (q_lost) {
+        r6_region_multiply(w, data_ptrs[x]+offset, gx, n, qp, 1);
+        memcpy(coding_ptrs[1]+offset, qp, n);
+      }
+
+    } else {
+      galois_region_xor(coding_ptrs[1]+offset, qp, n);
+      r6_region_multiply(w, qp, galois_inverse(gx, w), n, data_ptrs[x]+offset, 0);
+      galois_region_xor(data_ptrs[x]+offset, pp, n);
+      memcpy(coding_ptrs[0]+offset, pp, n);
+    }
   }
-  return 1;
+  return 0;
 }
 
 int *reed_sol_extended_vandermonde_matrix(int rows, int cols, int w)